@@ -0,0 +1,184 @@
+/*
+ * Copyright 2014 sgminer developers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "miner.h"
+#include "algorithm.h"
+#include "precalc.h"
+
+#define X11_CHAIN "blake512,bmw512,groestl512,skein512,jh512,keccak512," \
+		  "luffa512,cubehash512,shavite512,simd512,echo512"
+#define X13_CHAIN X11_CHAIN ",hamsi512,fugue512"
+#define QUARK_BRANCHES "[groestl512|skein512],groestl512,jh512," \
+		       "[blake512|bmw512],keccak512,skein512,[keccak512|jh512]"
+
+#define X11_STAGES "blake", "bmw", "groestl", "skein", "jh", "keccak", \
+		   "luffa", "cubehash", "shavite", "simd"
+
+/* First-block state and how it is split over the kernel arguments */
+#define BLAKE512_STATE		.precalc = precalc_blake512, .state = { 32 }
+#define SHAVITE512_STATE	.precalc = precalc_shavite512, .state = { 16, 8 }
+#define LUFFA512_STATE		.precalc = precalc_luffa512, .state = { 16, 16, 8 }
+#define FUGUE256_STATE		.precalc = precalc_fugue256, .state = { 16, 16 }
+
+#define SCRYPT(NAME, KL, FLAGS) \
+	{ .name = NAME, .kernel = KL, .file = NAME, .family = "scrypt", \
+	  .dm = DM_LITECOIN, .flags = ALGO_SCRYPT | (FLAGS) }
+
+/* A search kernel generated from CHAIN, see kernel/chain.cl */
+#define GENERATED(NAME, KL, FAMILY, DM, CHAIN) \
+	{ .name = NAME, .kernel = KL, .file = "chain", .family = FAMILY, .dm = DM, \
+	  .flags = ALGO_NONCE_LOOP | ALGO_EXPERIMENTAL | ALGO_HASH_OUT | ALGO_GENERATED, \
+	  .chain = CHAIN }
+
+const struct algorithm algorithms[] = {
+	SCRYPT(CKOLIVAS_KERNNAME,	KL_CKOLIVAS,	0),
+	SCRYPT(ALEXKARNEW_KERNNAME,	KL_ALEXKARNEW,	ALGO_EXPERIMENTAL),
+	SCRYPT(ALEXKAROLD_KERNNAME,	KL_ALEXKAROLD,	ALGO_EXPERIMENTAL),
+	SCRYPT(PSW_KERNNAME,		KL_PSW,		ALGO_EXPERIMENTAL),
+	SCRYPT(ZUIKKIS_KERNNAME,	KL_ZUIKKIS,	ALGO_EXPERIMENTAL),
+	{ .name = QUARKCOIN_KERNNAME, .kernel = KL_QUARKCOIN, .file = QUARKCOIN_KERNNAME,
+	  .family = "quarkcoin", .dm = DM_QUARKCOIN, .flags = ALGO_NONCE_LOOP | ALGO_EXPERIMENTAL | ALGO_HASH_OUT,
+	  .chain = "blake512,bmw512," QUARK_BRANCHES, BLAKE512_STATE },
+	{ .name = QUBITCOIN_KERNNAME, .kernel = KL_QUBITCOIN, .file = QUBITCOIN_KERNNAME,
+	  .family = "qubitcoin", .dm = DM_QUARKCOIN, .flags = ALGO_EXPERIMENTAL | ALGO_HASH_OUT,
+	  .chain = "luffa512,cubehash512,shavite512,simd512,echo512", LUFFA512_STATE },
+	{ .name = FRESH_KERNNAME, .kernel = KL_FRESH, .file = FRESH_KERNNAME,
+	  .family = "fresh", .dm = DM_QUARKCOIN, .flags = ALGO_NONCE_LOOP | ALGO_EXPERIMENTAL | ALGO_HASH_OUT,
+	  .chain = "shavite512,simd512,shavite512,simd512,echo512", SHAVITE512_STATE },
+	{ .name = FRESHMOD_KERNNAME, .kernel = KL_FRESHMOD, .file = FRESHMOD_KERNNAME,
+	  .family = "fresh", .dm = DM_QUARKCOIN, .flags = ALGO_EXPERIMENTAL,
+	  .chain = "shavite512,simd512,shavite512,simd512,echo512", SHAVITE512_STATE,
+	  .stages = { "shavite80", "simd", "shavite", "simd", "echo" } },
+	{ .name = INKCOIN_KERNNAME, .kernel = KL_INKCOIN, .file = INKCOIN_KERNNAME,
+	  .family = "inkcoin", .dm = DM_QUARKCOIN, .flags = ALGO_EXPERIMENTAL | ALGO_HASH_OUT,
+	  .chain = "shavite512,shavite512", SHAVITE512_STATE },
+	{ .name = ANIMECOIN_KERNNAME, .kernel = KL_ANIMECOIN, .file = ANIMECOIN_KERNNAME,
+	  .family = "animecoin", .dm = DM_QUARKCOIN, .flags = ALGO_EXPERIMENTAL | ALGO_HASH_OUT,
+	  .chain = "bmw512,blake512," QUARK_BRANCHES },
+	{ .name = SIFCOIN_KERNNAME, .kernel = KL_SIFCOIN, .file = SIFCOIN_KERNNAME,
+	  .family = "sifcoin", .dm = DM_QUARKCOIN, .flags = ALGO_EXPERIMENTAL | ALGO_HASH_OUT,
+	  .chain = "blake512,bmw512,groestl512,jh512,keccak512,skein512", BLAKE512_STATE },
+	{ .name = DARKCOIN_KERNNAME, .kernel = KL_DARKCOIN, .file = DARKCOIN_KERNNAME,
+	  .family = "x11", .dm = DM_BITCOIN, .flags = ALGO_NONCE_LOOP | ALGO_EXPERIMENTAL | ALGO_HASH_OUT,
+	  .chain = X11_CHAIN, BLAKE512_STATE },
+	{ .name = X11MOD_KERNNAME, .kernel = KL_X11MOD, .file = X11MOD_KERNNAME,
+	  .family = "x11", .dm = DM_BITCOIN, .flags = ALGO_EXPERIMENTAL,
+	  .chain = X11_CHAIN, BLAKE512_STATE,
+	  .stages = { X11_STAGES, "echo" } },
+	{ .name = MYRIADCOIN_GROESTL_KERNNAME, .kernel = KL_MYRIADCOIN_GROESTL, .file = MYRIADCOIN_GROESTL_KERNNAME,
+	  .family = "myriadcoin-groestl", .dm = DM_BITCOIN, .flags = ALGO_EXPERIMENTAL | ALGO_HASH_OUT,
+	  .chain = "groestl512,sha256" },
+	{ .name = FUGUECOIN_KERNNAME, .kernel = KL_FUGUECOIN, .file = FUGUECOIN_KERNNAME,
+	  .family = "fuguecoin", .dm = DM_BITCOIN, .flags = ALGO_SHA256_MERKLE | ALGO_EXPERIMENTAL,
+	  .chain = "fugue256", FUGUE256_STATE },
+	{ .name = GROESTLCOIN_KERNNAME, .kernel = KL_GROESTLCOIN, .file = GROESTLCOIN_KERNNAME,
+	  .family = "groestlcoin", .dm = DM_BITCOIN, .flags = ALGO_SHA256_MERKLE | ALGO_EXPERIMENTAL | ALGO_HASH_OUT,
+	  .chain = "groestl512,groestl512" },
+	{ .name = TWECOIN_KERNNAME, .kernel = KL_TWECOIN, .file = TWECOIN_KERNNAME,
+	  .family = "twecoin", .dm = DM_BITCOIN, .flags = ALGO_SHA256_MERKLE | ALGO_EXPERIMENTAL,
+	  .chain = "fugue256,shavite256,hamsi256,panama", FUGUE256_STATE },
+	{ .name = MARUCOIN_KERNNAME, .kernel = KL_MARUCOIN, .file = MARUCOIN_KERNNAME,
+	  .family = "x13", .dm = DM_BITCOIN, .flags = ALGO_EXPERIMENTAL | ALGO_HASH_OUT,
+	  .chain = X13_CHAIN, BLAKE512_STATE },
+	{ .name = X13MOD_KERNNAME, .kernel = KL_X13MOD, .file = X13MOD_KERNNAME,
+	  .family = "x13", .dm = DM_BITCOIN, .flags = ALGO_EXPERIMENTAL,
+	  .chain = X13_CHAIN, BLAKE512_STATE,
+	  .stages = { X11_STAGES, "echo", "hamsi", "fugue" } },
+	/* x13mod.cl with the last three hashes in one kernel for VLIW parts */
+	{ .name = X13MODOLD_KERNNAME, .kernel = KL_X13MODOLD, .file = X13MOD_KERNNAME,
+	  .family = "x13", .dm = DM_BITCOIN, .flags = ALGO_EXPERIMENTAL,
+	  .chain = X13_CHAIN, .options = " -D X13MODOLD", BLAKE512_STATE,
+	  .stages = { X11_STAGES, "echo_hamsi_fugue" } },
+	GENERATED(QUARKCHAIN_KERNNAME, KL_QUARKCHAIN, "quarkcoin", DM_QUARKCOIN, "blake512,bmw512," QUARK_BRANCHES),
+	GENERATED(X11CHAIN_KERNNAME, KL_X11CHAIN, "x11", DM_BITCOIN, X11_CHAIN),
+	GENERATED(X13CHAIN_KERNNAME, KL_X13CHAIN, "x13", DM_BITCOIN, X13_CHAIN),
+	{ .name = NULL, .kernel = KL_NONE },
+};
+
+#define ALGORITHMS (sizeof(algorithms) / sizeof(algorithms[0]) - 1)
+
+static struct chain chains[ALGORITHMS];
+
+/* The first --kernel's, for pools without --pool-algorithm */
+const struct algorithm *default_algorithm;
+
+/* Parse the hash chains once, before any thread hashes with them */
+bool init_algorithms(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ALGORITHMS; i++) {
+		if (algorithms[i].chain && !chain_parse(&chains[i], algorithms[i].chain))
+			return false;
+	}
+	return true;
+}
+
+const struct algorithm *find_algorithm(const char *name)
+{
+	const struct algorithm *algo;
+
+	for (algo = algorithms; algo->name; algo++) {
+		if (!strcmp(algo->name, name))
+			return algo;
+	}
+	return NULL;
+}
+
+/* The algorithm of a device's kernel, ckolivas when none was chosen as in
+ * initCl */
+const struct algorithm *kernel_algorithm(enum cl_kernels kernel)
+{
+	const struct algorithm *algo;
+
+	if (kernel == KL_NONE)
+		kernel = KL_CKOLIVAS;
+	for (algo = algorithms; algo->name; algo++) {
+		if (algo->kernel == kernel)
+			return algo;
+	}
+	return NULL;
+}
+
+/* The parsed chain, NULL for scrypt */
+const struct chain *algorithm_chain(const struct algorithm *algo)
+{
+	if (!algo->chain)
+		return NULL;
+	return &chains[algo - algorithms];
+}
+
+unsigned int algorithm_stages(const struct algorithm *algo)
+{
+	unsigned int n = 0;
+
+	while (algo->stages[n])
+		n++;
+	return n;
+}
+
+/* Work for one can be mined by the other's kernel */
+bool algorithm_compatible(const struct algorithm *a, const struct algorithm *b)
+{
+	return a == b || !strcmp(a->family, b->family);
+}
+
+/* What the pool's work is hashed, merkled and measured with */
+const struct algorithm *pool_algorithm(const struct pool *pool)
+{
+	if (pool->algorithm)
+		return pool->algorithm;
+	if (default_algorithm)
+		return default_algorithm;
+	return kernel_algorithm(KL_NONE);
+}
@@ -0,0 +1,55 @@
+#ifndef __ALGORITHM_H__
+#define __ALGORITHM_H__
+
+#include "miner.h"
+#include "chain.h"
+
+/* Most kernels enqueued per scanhash, x13mod has 13 */
+#define MAX_KERNEL_STAGES 16
+
+/* scrypt kernel, sized by lookup gap and thread concurrency */
+#define ALGO_SCRYPT		(1 << 0)
+/* Built with the NONCES_PER_THREAD and VECTORS loops */
+#define ALGO_NONCE_LOOP		(1 << 1)
+/* The coinbase goes into the merkle root with a single sha256 */
+#define ALGO_SHA256_MERKLE	(1 << 2)
+#define ALGO_EXPERIMENTAL	(1 << 3)
+/* Checks the full target and reports each hash when built with HASHOUT */
+#define ALGO_HASH_OUT		(1 << 4)
+/* Source generated from the chain by chain_kernel_source, file is its head */
+#define ALGO_GENERATED		(1 << 5)
+
+/*
+ * Everything that differs between the kernels. An algorithm with stages
+ * runs them in order over the hash buffer, the first taking the header
+ * and the last writing the results; otherwise the program has a single
+ * "search" kernel.
+ */
+struct algorithm {
+	const char *name;		/* --kernel and the binary name */
+	enum cl_kernels kernel;
+	const char *file;		/* kernel/<file>.cl */
+	const char *family;		/* Kernels autotune may swap between */
+	enum diff_calc_mode dm;
+	unsigned int flags;
+	const char *chain;		/* CPU hash, NULL for scrypt */
+	const char *options;		/* Extra compiler options */
+	/* Fills in blk->sph_state from the flipped header, NULL if unused */
+	void (*precalc)(dev_blk_ctx *blk, const unsigned char *data);
+	/* Sizes in words of the kernel arguments sph_state is passed as */
+	unsigned char state[4];
+	const char *stages[MAX_KERNEL_STAGES + 1];
+};
+
+extern const struct algorithm algorithms[];
+extern const struct algorithm *default_algorithm;
+
+extern bool init_algorithms(void);
+extern const struct algorithm *find_algorithm(const char *name);
+extern const struct algorithm *kernel_algorithm(enum cl_kernels kernel);
+extern const struct chain *algorithm_chain(const struct algorithm *algo);
+extern unsigned int algorithm_stages(const struct algorithm *algo);
+extern bool algorithm_compatible(const struct algorithm *a, const struct algorithm *b);
+extern const struct algorithm *pool_algorithm(const struct pool *pool);
+
+#endif /* __ALGORITHM_H__ */
@@ -124,7 +124,7 @@ static const char GPUSEP = ',';
 #define JOIN_CMD "CMD="
 #define BETWEEN_JOIN SEPSTR
 
-static const char *APIVERSION = "3.1";
+static const char *APIVERSION = "3.2";
 static const char *DEAD = "Dead";
 static const char *SICK = "Sick";
 static const char *NOSTART = "NoStart";
@@ -182,6 +182,7 @@ static const char *OSINFO =
 #define _MINECOIN	"COIN"
 #define _DEBUGSET	"DEBUG"
 #define _SETCONFIG	"SETCONFIG"
+#define _GPUPROFILE	"GPUPROFILE"
 
 static const char ISJSON = '{';
 #define JSON0		"{"
@@ -213,6 +214,7 @@ static const char ISJSON = '{';
 #define JSON_MINECOIN	JSON1 _MINECOIN JSON2
 #define JSON_DEBUGSET	JSON1 _DEBUGSET JSON2
 #define JSON_SETCONFIG	JSON1 _SETCONFIG JSON2
+#define JSON_GPUPROFILE	JSON1 _GPUPROFILE JSON2
 
 #define JSON_END	JSON4 JSON5
 #define JSON_END_TRUNCATED	JSON4_TRUNCATED JSON5
@@ -307,6 +309,8 @@ static const char *JSON_PARAMETER = "parameter";
 #define MSG_SETQUOTA 122
 #define MSG_LOCKOK 123
 #define MSG_LOCKDIS 124
+#define MSG_GPUPROFILE 125
+#define MSG_NOPROFILE 126
 
 enum code_severity {
 	SEVERITY_ERR,
@@ -424,6 +428,8 @@ struct CODES {
  { SEVERITY_SUCC,  MSG_ZERNOSUM, PARAM_STR,	"Zeroed %s stats without summary" },
  { SEVERITY_SUCC,  MSG_LOCKOK,	PARAM_NONE,	"Lock stats created" },
  { SEVERITY_WARN,  MSG_LOCKDIS,	PARAM_NONE,	"Lock stats not enabled" },
+ { SEVERITY_SUCC,  MSG_GPUPROFILE, PARAM_NONE,	"GPU profile" },
+ { SEVERITY_WARN,  MSG_NOPROFILE, PARAM_NONE,	"GPU profiling not enabled" },
  { SEVERITY_FAIL, 0, 0, NULL }
 };
 
@@ -1831,6 +1837,7 @@ static void poolstatus(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __m
 		root = api_add_int(root, "Works", &pool->works, false);
 		root = api_add_uint(root, "Discarded", &(pool->discarded_work), false);
 		root = api_add_uint(root, "Stale", &(pool->stale_shares), false);
+		root = api_add_uint(root, "Duplicates", &(pool->duplicate_shares), false);
 		root = api_add_uint(root, "Get Failures", &(pool->getfail_occasions), false);
 		root = api_add_uint(root, "Remote Failures", &(pool->remotefail_occasions), false);
 		root = api_add_escape(root, "User", pool->rpc_user, false);
@@ -2700,6 +2707,8 @@ static void devdetails(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __m
 		root = api_add_const(root, "Kernel", cgpu->kname ? : BLANK, false);
 		root = api_add_const(root, "Model", cgpu->name ? : BLANK, false);
 		root = api_add_const(root, "Device Path", cgpu->device_path ? : BLANK, false);
+		if (cgpu->drv->get_api_profile && cgpu->thr && cgpu->thr[0])
+			root = cgpu->drv->get_api_profile(cgpu->thr[0], root);
 
 		root = print_data(root, buf, isjson, isjson && (i > 0));
 		io_add(io_data, buf);
@@ -2709,6 +2718,54 @@ static void devdetails(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __m
 		io_close(io_data);
 }
 
+static void gpuprofile(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __maybe_unused char *param, bool isjson, __maybe_unused char group)
+{
+	struct api_data *root = NULL;
+	char buf[TMPBUFSIZ];
+	bool io_open = false;
+	struct cgpu_info *cgpu;
+	int i, j, n = 0;
+
+	if (!opt_gpu_profile) {
+		message(io_data, MSG_NOPROFILE, 0, NULL, isjson);
+		return;
+	}
+
+	if (total_devices == 0) {
+		message(io_data, MSG_NODEVS, 0, NULL, isjson);
+		return;
+	}
+
+	message(io_data, MSG_GPUPROFILE, 0, NULL, isjson);
+
+	if (isjson)
+		io_open = io_add(io_data, COMSTR JSON_GPUPROFILE);
+
+	for (i = 0; i < total_devices; i++) {
+		cgpu = get_devices(i);
+		if (!cgpu->drv->get_api_profile || !cgpu->thr)
+			continue;
+
+		for (j = 0; j < cgpu->threads; j++) {
+			if (!cgpu->thr[j])
+				continue;
+
+			root = api_add_int(root, "GPUPROFILE", &n, true);
+			root = api_add_string(root, "Name", cgpu->drv->name, false);
+			root = api_add_int(root, "ID", &(cgpu->device_id), false);
+			root = api_add_int(root, "Thread", &j, true);
+			root = cgpu->drv->get_api_profile(cgpu->thr[j], root);
+
+			root = print_data(root, buf, isjson, isjson && (n > 0));
+			io_add(io_data, buf);
+			n++;
+		}
+	}
+
+	if (isjson && io_open)
+		io_close(io_data);
+}
+
 void dosave(struct io_data *io_data, __maybe_unused SOCKETTYPE c, char *param, bool isjson, __maybe_unused char group)
 {
 	char filename[PATH_MAX];
@@ -2740,6 +2797,25 @@ void dosave(struct io_data *io_data, __maybe_unused SOCKETTYPE c, char *param, b
 	ptr = NULL;
 }
 
+static struct api_data *api_add_latency(struct api_data *root, char *name, struct latency_histogram *hist)
+{
+	char buf[64];
+	double ms;
+
+	snprintf(buf, sizeof(buf), "%s Count", name);
+	root = api_add_uint64(root, buf, &(hist->count), false);
+	ms = latency_percentile(hist, 50);
+	snprintf(buf, sizeof(buf), "%s P50", name);
+	root = api_add_double(root, buf, &ms, true);
+	ms = latency_percentile(hist, 90);
+	snprintf(buf, sizeof(buf), "%s P90", name);
+	root = api_add_double(root, buf, &ms, true);
+	ms = latency_percentile(hist, 99);
+	snprintf(buf, sizeof(buf), "%s P99", name);
+	root = api_add_double(root, buf, &ms, true);
+	return root;
+}
+
 static int itemstats(struct io_data *io_data, int i, char *id, struct sgminer_stats *stats, struct sgminer_pool_stats *pool_stats, struct api_data *extra, struct cgpu_info *cgpu, bool isjson)
 {
 	struct api_data *root = NULL;
@@ -2775,6 +2851,9 @@ static int itemstats(struct io_data *io_data, int i, char *id, struct sgminer_st
 		root = api_add_uint64(root, "Bytes Recv", &(pool_stats->bytes_received), false);
 		root = api_add_uint64(root, "Net Bytes Sent", &(pool_stats->net_bytes_sent), false);
 		root = api_add_uint64(root, "Net Bytes Recv", &(pool_stats->net_bytes_received), false);
+		root = api_add_latency(root, "Notify Work", &(pool_stats->notify_work));
+		root = api_add_latency(root, "Found Submit", &(pool_stats->found_submit));
+		root = api_add_latency(root, "Submit Ack", &(pool_stats->submit_ack));
 	}
 
 	if (extra)
@@ -3070,6 +3149,7 @@ struct CMDS {
 	{ "privileged",		privileged,	true,	false },
 	{ "notify",		notify,		false,	true },
 	{ "devdetails",		devdetails,	false,	true },
+	{ "gpuprofile",		gpuprofile,	false,	true },
 	{ "restart",		dorestart,	true,	false },
 	{ "stats",		minerstats,	false,	true },
 	{ "check",		checkcommand,	false,	false },
@@ -0,0 +1,438 @@
+/*
+ * Copyright 2014 sgminer developers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <jansson.h>
+
+#include "miner.h"
+#include "ocl.h"
+#include "algorithm.h"
+#include "autotune.h"
+
+bool opt_autotune;
+char *opt_autotune_profile;
+int opt_autotune_time = 3;
+
+#define AUTOTUNE_MIN_INTENSITY 10
+#define AUTOTUNE_MAX_INTENSITY 24
+
+/* Stop raising intensity once this many steps in a row were no faster */
+#define AUTOTUNE_MAX_WORSE 2
+
+static const int autotune_worksizes[] = { 64, 128, 256 };
+
+/* scrypt kernels are then tried at each lookup gap with this many fractions
+ * of the most thread concurrency the device can allocate */
+#define AUTOTUNE_MAX_LOOKUP_GAP 4
+#define AUTOTUNE_TC_STEPS 4
+
+struct autotune_result {
+	enum cl_kernels kernel;
+	int intensity;
+	int worksize;
+	int lookup_gap;		/* 0 for non-scrypt kernels */
+	size_t thread_concurrency;
+	double hashrate;	/* H/s */
+	double latency;		/* ms per scanhash call */
+};
+
+static void autotune_profile_file(char *filename)
+{
+	if (opt_autotune_profile && *opt_autotune_profile) {
+		strcpy(filename, opt_autotune_profile);
+		return;
+	}
+
+#if defined(unix) || defined(__APPLE__)
+	if (getenv("HOME") && *getenv("HOME")) {
+		strcpy(filename, getenv("HOME"));
+		strcat(filename, "/");
+	}
+	else
+		strcpy(filename, "");
+	strcat(filename, ".sgminer/");
+	mkdir(filename, 0777);
+#else
+	strcpy(filename, "");
+#endif
+	strcat(filename, "autotune.json");
+}
+
+/* Returns the profile root object, an empty one if the file doesn't exist
+ * or can't be parsed. */
+static json_t *autotune_load(const char *filename)
+{
+	json_error_t err;
+	json_t *root = NULL;
+
+	if (!access(filename, R_OK)) {
+		root = json_load_file(filename, 0, &err);
+		if (!root)
+			applog(LOG_WARNING, "Ignoring autotune profile %s: %s (line %d)",
+			       filename, err.text, err.line);
+	}
+
+	if (root && !json_is_array(json_object_get(root, "profiles"))) {
+		applog(LOG_WARNING, "Ignoring autotune profile %s: no profiles array", filename);
+		json_decref(root);
+		root = NULL;
+	}
+
+	if (!root) {
+		root = json_object();
+		json_object_set_new(root, "profiles", json_array());
+	}
+
+	return root;
+}
+
+static json_t *autotune_find_entry(json_t *profiles, const char *name,
+				   const char *driver, const char *algorithm)
+{
+	size_t i;
+
+	for (i = 0; i < json_array_size(profiles); i++) {
+		json_t *entry = json_array_get(profiles, i);
+		const char *s;
+
+		s = json_string_value(json_object_get(entry, "device"));
+		if (!s || strcmp(s, name))
+			continue;
+		s = json_string_value(json_object_get(entry, "driver"));
+		if (!s || strcmp(s, driver))
+			continue;
+		s = json_string_value(json_object_get(entry, "algorithm"));
+		if (!s || strcmp(s, algorithm))
+			continue;
+		return entry;
+	}
+	return NULL;
+}
+
+static void autotune_store(json_t *profiles, const char *name, const char *driver,
+			   const char *algorithm, struct autotune_result *res)
+{
+	json_t *entry = autotune_find_entry(profiles, name, driver, algorithm);
+
+	if (!entry) {
+		entry = json_object();
+		json_array_append_new(profiles, entry);
+	}
+
+	json_object_set_new(entry, "device", json_string(name));
+	json_object_set_new(entry, "driver", json_string(driver));
+	json_object_set_new(entry, "algorithm", json_string(algorithm));
+	json_object_set_new(entry, "kernel", json_string(kernel_algorithm(res->kernel)->name));
+	json_object_set_new(entry, "intensity", json_integer(res->intensity));
+	json_object_set_new(entry, "worksize", json_integer(res->worksize));
+	if (res->lookup_gap) {
+		json_object_set_new(entry, "lookup-gap", json_integer(res->lookup_gap));
+		json_object_set_new(entry, "thread-concurrency", json_integer(res->thread_concurrency));
+	} else {
+		json_object_del(entry, "lookup-gap");
+		json_object_del(entry, "thread-concurrency");
+	}
+	json_object_set_new(entry, "hashrate", json_real(res->hashrate));
+	json_object_set_new(entry, "latency", json_real(res->latency));
+}
+
+/* Apply the saved settings for this device and algorithm, called before the
+ * kernel is built. Explicit intensity or worksize settings are left alone, as
+ * are explicit lookup gap and thread concurrency. */
+bool autotune_apply_profile(struct cgpu_info *cgpu)
+{
+	const struct algorithm *tk, *pk;
+	char filename[PATH_MAX];
+	char name[256], driver[256];
+	json_t *root, *entry;
+	bool ret = false;
+	int intensity, worksize, lookup_gap, tc;
+
+	if (opt_autotune || !cgpu->dynamic || cgpu->work_size)
+		return false;
+
+	tk = kernel_algorithm(cgpu->kernel);
+	if (!tk)
+		return false;
+
+	autotune_profile_file(filename);
+	if (access(filename, R_OK))
+		return false;
+
+	if (!clDeviceInfo(cgpu->virtual_gpu, name, sizeof(name), driver, sizeof(driver)))
+		return false;
+
+	root = autotune_load(filename);
+	entry = autotune_find_entry(json_object_get(root, "profiles"), name, driver, tk->family);
+	if (!entry)
+		goto out;
+
+	pk = find_algorithm(json_string_value(json_object_get(entry, "kernel")) ? : "");
+	intensity = json_integer_value(json_object_get(entry, "intensity"));
+	worksize = json_integer_value(json_object_get(entry, "worksize"));
+	lookup_gap = json_integer_value(json_object_get(entry, "lookup-gap"));
+	tc = json_integer_value(json_object_get(entry, "thread-concurrency"));
+	if (!pk || strcmp(pk->family, tk->family) ||
+	    intensity < MIN_INTENSITY || intensity > MAX_INTENSITY || worksize < 1 ||
+	    lookup_gap < 0 || tc < 0) {
+		applogsiz(LOG_WARNING, LOGBUFSIZ + sizeof(name), "GPU %d: Ignoring invalid autotune profile entry for %s",
+			  cgpu->device_id, name);
+		goto out;
+	}
+
+	cgpu->kernel = pk->kernel;
+	cgpu->dynamic = false;
+	cgpu->intensity = intensity;
+	cgpu->xintensity = 0;
+	cgpu->rawintensity = 0;
+	cgpu->work_size = worksize;
+	applog(LOG_NOTICE, "GPU %d: Using autotuned kernel %s, intensity %d, worksize %d",
+	       cgpu->device_id, pk->name, intensity, worksize);
+	if (lookup_gap && tc && !cgpu->opt_lg && !cgpu->opt_tc) {
+		cgpu->opt_lg = lookup_gap;
+		cgpu->opt_tc = tc;
+		applog(LOG_NOTICE, "GPU %d: Using autotuned lookup gap %d, thread concurrency %d",
+		       cgpu->device_id, lookup_gap, tc);
+	}
+	ret = true;
+out:
+	json_decref(root);
+	return ret;
+}
+
+/* Build and hash benchmark work with one configuration for opt_autotune_time
+ * seconds. Returns false if the configuration can't run on this device. */
+static bool autotune_measure(struct thr_info *thr, struct autotune_result *res)
+{
+	struct timeval tv_start, tv_launch, tv_end;
+	struct cgpu_info *cgpu = thr->cgpu;
+	struct device_drv *drv = cgpu->drv;
+	int64_t hashes = 0, ret;
+	double launch_us = 0;
+	struct work *work;
+	int launches = 0;
+	bool ok = false;
+
+	cgpu->kernel = res->kernel;
+	cgpu->kname = NULL;
+	cgpu->dynamic = false;
+	cgpu->intensity = res->intensity;
+	cgpu->xintensity = 0;
+	cgpu->rawintensity = 0;
+	cgpu->work_size = res->worksize;
+	/* 0 lets initCl pick them as it does without --lookup-gap and
+	 * --thread-concurrency */
+	cgpu->opt_lg = res->lookup_gap;
+	cgpu->opt_tc = res->thread_concurrency;
+	cgpu->max_hashes = 0;
+	cgpu->deven = DEV_ENABLED;
+
+	if (!drv->thread_prepare(thr))
+		return false;
+	if (!drv->thread_init(thr))
+		goto out_shutdown;
+
+	work = calloc(1, sizeof(*work));
+	if (unlikely(!work))
+		quit(1, "Failed to calloc work in autotune_measure");
+	get_benchmark_work(work);
+	/* Nothing hashes below a zero target so no results are ever posted */
+	memset(work->device_target, 0, sizeof(work->device_target));
+	drv->prepare_work(thr, work);
+
+	/* The first launch pays for setting up the buffers, don't time it */
+	if (drv->scanhash(thr, work, 0) < 0)
+		goto out_work;
+
+	cgtime(&tv_start);
+	do {
+		cgtime(&tv_launch);
+		ret = drv->scanhash(thr, work, 0);
+		cgtime(&tv_end);
+		if (unlikely(ret < 0))
+			goto out_work;
+		hashes += ret;
+		launch_us += us_tdiff(&tv_end, &tv_launch);
+		launches++;
+	} while (tdiff(&tv_end, &tv_start) < opt_autotune_time);
+
+	res->hashrate = hashes / tdiff(&tv_end, &tv_start);
+	res->latency = launch_us / launches / 1000;
+	/* set_threads_hashes may have raised it to fill the worksize */
+	res->intensity = cgpu->intensity;
+	if (kernel_algorithm(res->kernel)->flags & ALGO_SCRYPT) {
+		res->lookup_gap = cgpu->lookup_gap;
+		res->thread_concurrency = cgpu->thread_concurrency;
+	}
+	ok = true;
+out_work:
+	free_work(work);
+out_shutdown:
+	drv->thread_shutdown(thr);
+	return ok;
+}
+
+/* Keeps res if it beats best */
+static void autotune_report(struct cgpu_info *cgpu, struct autotune_result *best,
+			    struct autotune_result *res)
+{
+	const struct algorithm *algo = kernel_algorithm(res->kernel);
+
+	if (res->lookup_gap)
+		applog(LOG_NOTICE, "GPU %d: %s worksize %d intensity %d lookup gap %d thread concurrency %d: %.0f H/s, %.2f ms per launch",
+		       cgpu->device_id, algo->name, res->worksize, res->intensity,
+		       res->lookup_gap, (int)res->thread_concurrency, res->hashrate, res->latency);
+	else
+		applog(LOG_NOTICE, "GPU %d: %s worksize %d intensity %d: %.0f H/s, %.2f ms per launch",
+		       cgpu->device_id, algo->name, res->worksize, res->intensity,
+		       res->hashrate, res->latency);
+
+	if (res->hashrate > best->hashrate)
+		memcpy(best, res, sizeof(*best));
+}
+
+/* With the best kernel, intensity and worksize found, try each lookup gap
+ * with thread concurrencies up to what fits the device's largest buffer */
+static void autotune_scrypt(struct thr_info *thr, struct autotune_result *best)
+{
+	struct cgpu_info *cgpu = thr->cgpu;
+	struct autotune_result res;
+	int lookup_gap, step;
+
+	for (lookup_gap = 1; lookup_gap <= AUTOTUNE_MAX_LOOKUP_GAP; lookup_gap++) {
+		size_t ipt = (1024 / lookup_gap + (1024 % lookup_gap > 0));
+		size_t max_tc = cgpu->max_alloc / (128 * ipt) / 64 * 64;
+
+		for (step = 1; step <= AUTOTUNE_TC_STEPS; step++) {
+			memcpy(&res, best, sizeof(res));
+			res.lookup_gap = lookup_gap;
+			res.thread_concurrency = max_tc * step / AUTOTUNE_TC_STEPS / 64 * 64;
+			if (!res.thread_concurrency)
+				continue;
+			if (!autotune_measure(thr, &res)) {
+				applog(LOG_INFO, "GPU %d: lookup gap %d thread concurrency %d failed",
+				       cgpu->device_id, lookup_gap, (int)res.thread_concurrency);
+				continue;
+			}
+			autotune_report(cgpu, best, &res);
+		}
+	}
+}
+
+static void autotune_device(struct cgpu_info *cgpu, json_t *profiles)
+{
+	const struct algorithm *tk, *vk;
+	struct autotune_result best, res;
+	char name[256], driver[256];
+	struct thr_info thr;
+	unsigned int w;
+
+	tk = kernel_algorithm(cgpu->kernel);
+	if (!tk) {
+		applog(LOG_ERR, "GPU %d: No autotune support for this kernel", cgpu->device_id);
+		return;
+	}
+
+	if (!clDeviceInfo(cgpu->virtual_gpu, name, sizeof(name), driver, sizeof(driver)))
+		return;
+
+	applogsiz(LOG_NOTICE, LOGBUFSIZ + sizeof(name) + sizeof(driver), "GPU %d: Autotuning %s on %s (driver %s)",
+		  cgpu->device_id, tk->family, name, driver);
+
+	memset(&best, 0, sizeof(best));
+	memset(&thr, 0, sizeof(thr));
+	thr.id = cgpu->device_id;
+	thr.cgpu = cgpu;
+
+	for (vk = algorithms; vk->name; vk++) {
+		if (strcmp(vk->family, tk->family))
+			continue;
+
+		for (w = 0; w < sizeof(autotune_worksizes) / sizeof(autotune_worksizes[0]); w++) {
+			double sweep_best = 0;
+			int intensity, worse = 0;
+
+			for (intensity = AUTOTUNE_MIN_INTENSITY; intensity <= AUTOTUNE_MAX_INTENSITY; intensity++) {
+				memset(&res, 0, sizeof(res));
+				res.kernel = vk->kernel;
+				res.worksize = autotune_worksizes[w];
+				res.intensity = intensity;
+				if (!autotune_measure(&thr, &res)) {
+					applog(LOG_INFO, "GPU %d: %s worksize %d intensity %d failed",
+					       cgpu->device_id, vk->name, res.worksize, intensity);
+					break;
+				}
+
+				autotune_report(cgpu, &best, &res);
+				if (res.hashrate > sweep_best) {
+					sweep_best = res.hashrate;
+					worse = 0;
+				} else if (++worse >= AUTOTUNE_MAX_WORSE)
+					break;
+				/* Already clamped up past this intensity */
+				if (res.intensity > intensity)
+					intensity = res.intensity;
+			}
+		}
+	}
+
+	if (!best.hashrate) {
+		applog(LOG_ERR, "GPU %d: Autotune found no working configuration", cgpu->device_id);
+		return;
+	}
+
+	if (tk->flags & ALGO_SCRYPT)
+		autotune_scrypt(&thr, &best);
+
+	applog(LOG_NOTICE, "GPU %d: Best %s is kernel %s, intensity %d, worksize %d: %.0f H/s, %.2f ms per launch",
+	       cgpu->device_id, tk->family, kernel_algorithm(best.kernel)->name,
+	       best.intensity, best.worksize, best.hashrate, best.latency);
+	if (best.lookup_gap)
+		applog(LOG_NOTICE, "GPU %d: Best lookup gap %d, thread concurrency %d",
+		       cgpu->device_id, best.lookup_gap, (int)best.thread_concurrency);
+	autotune_store(profiles, name, driver, tk->family, &best);
+}
+
+/* Tune every enabled GPU in turn and save the winners. Runs before any
+ * mining threads exist. */
+void autotune_devices(void)
+{
+	char filename[PATH_MAX];
+	json_t *root;
+	int i;
+
+	/* Benchmark work accounts its difficulty against pools[0] */
+	if (!total_pools)
+		add_pool();
+
+	autotune_profile_file(filename);
+	root = autotune_load(filename);
+
+	for (i = 0; i < total_devices; i++) {
+		struct cgpu_info *cgpu = devices[i];
+
+		if (cgpu->drv->drv_id != DRIVER_opencl || cgpu->deven == DEV_DISABLED)
+			continue;
+		autotune_device(cgpu, json_object_get(root, "profiles"));
+	}
+
+	if (json_dump_file(root, filename, JSON_INDENT(2)))
+		applogsiz(LOG_ERR, LOGBUFSIZ + PATH_MAX, "Failed to write autotune profile %s", filename);
+	else
+		applogsiz(LOG_NOTICE, LOGBUFSIZ + PATH_MAX, "Saved autotune profile %s", filename);
+	json_decref(root);
+}
@@ -0,0 +1,13 @@
+#ifndef __AUTOTUNE_H__
+#define __AUTOTUNE_H__
+
+#include "miner.h"
+
+extern bool opt_autotune;
+extern char *opt_autotune_profile;
+extern int opt_autotune_time;
+
+extern bool autotune_apply_profile(struct cgpu_info *cgpu);
+extern void autotune_devices(void);
+
+#endif /* __AUTOTUNE_H__ */
@@ -0,0 +1,347 @@
+/*
+ * Copyright 2014 sgminer developers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "miner.h"
+#include "chain.h"
+
+#include "sph/sph_blake.h"
+#include "sph/sph_bmw.h"
+#include "sph/sph_groestl.h"
+#include "sph/sph_skein.h"
+#include "sph/sph_jh.h"
+#include "sph/sph_keccak.h"
+#include "sph/sph_luffa.h"
+#include "sph/sph_cubehash.h"
+#include "sph/sph_shavite.h"
+#include "sph/sph_simd.h"
+#include "sph/sph_echo.h"
+#include "sph/sph_hamsi.h"
+#include "sph/sph_fugue.h"
+#include "sph/sph_panama.h"
+#include "sph/sph_sha2.h"
+
+/* Byte order of the hash a kernel/chain-<hash>.cl block takes and leaves */
+enum chain_order {
+	CHAIN_NONE,	/* No block for the hash */
+	CHAIN_MEM,	/* The bytes sph hashes */
+	CHAIN_BE64,	/* Each 64 bit word byte swapped */
+	CHAIN_BE32,	/* Each 32 bit word byte swapped */
+};
+
+struct chain_func {
+	const char *name;
+	void (*init)(void *cc);
+	void (*update)(void *cc, const void *data, size_t len);
+	void (*close)(void *cc, void *dst);
+	enum chain_order in, out;
+};
+
+union chain_context {
+	sph_blake512_context blake512;
+	sph_bmw512_context bmw512;
+	sph_groestl512_context groestl512;
+	sph_skein512_context skein512;
+	sph_jh512_context jh512;
+	sph_keccak512_context keccak512;
+	sph_luffa512_context luffa512;
+	sph_cubehash512_context cubehash512;
+	sph_shavite256_context shavite256;
+	sph_shavite512_context shavite512;
+	sph_simd512_context simd512;
+	sph_echo512_context echo512;
+	sph_hamsi256_context hamsi256;
+	sph_hamsi512_context hamsi512;
+	sph_fugue256_context fugue256;
+	sph_fugue512_context fugue512;
+	sph_panama_context panama;
+	sph_sha256_context sha256;
+};
+
+/* The first hash after the 76 bytes of header before the nonce */
+struct chain_midstate {
+	union chain_context ctx;
+};
+
+#define CHAIN_FUNC(NAME, IN, OUT) \
+	{ #NAME, sph_##NAME##_init, sph_##NAME, sph_##NAME##_close, CHAIN_##IN, CHAIN_##OUT }
+
+static const struct chain_func chain_funcs[] = {
+	CHAIN_FUNC(blake512, BE64, BE64),
+	CHAIN_FUNC(bmw512, BE64, BE64),
+	CHAIN_FUNC(groestl512, BE64, BE64),
+	CHAIN_FUNC(skein512, BE64, BE64),
+	CHAIN_FUNC(jh512, BE64, BE64),
+	CHAIN_FUNC(keccak512, BE64, BE64),
+	CHAIN_FUNC(luffa512, BE64, BE64),
+	CHAIN_FUNC(cubehash512, BE64, MEM),
+	CHAIN_FUNC(shavite256, NONE, NONE),
+	CHAIN_FUNC(shavite512, MEM, MEM),
+	CHAIN_FUNC(simd512, MEM, MEM),
+	CHAIN_FUNC(echo512, MEM, MEM),
+	CHAIN_FUNC(hamsi256, NONE, NONE),
+	CHAIN_FUNC(hamsi512, MEM, BE32),
+	CHAIN_FUNC(fugue256, NONE, NONE),
+	CHAIN_FUNC(fugue512, BE32, MEM),
+	CHAIN_FUNC(panama, NONE, NONE),
+	CHAIN_FUNC(sha256, NONE, NONE),
+};
+
+static const struct chain_func *chain_func(const char *name, size_t len)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(chain_funcs) / sizeof(chain_funcs[0]); i++) {
+		if (strlen(chain_funcs[i].name) == len && !strncmp(chain_funcs[i].name, name, len))
+			return &chain_funcs[i];
+	}
+	return NULL;
+}
+
+/* Parse spec into chain, logging what is wrong with it on failure */
+bool chain_parse(struct chain *chain, const char *spec)
+{
+	const char *p = spec;
+
+	memset(chain, 0, sizeof(*chain));
+	while (*p) {
+		struct chain_step *step = &chain->step[chain->steps];
+		bool branch = (*p == '[');
+		size_t len;
+
+		if (chain->steps >= MAX_CHAIN_STEPS) {
+			applog(LOG_ERR, "Chain %s is longer than %d hashes", spec, MAX_CHAIN_STEPS);
+			return false;
+		}
+		if (branch)
+			p++;
+		len = strcspn(p, branch ? "|" : ",");
+		step->func = chain_func(p, len);
+		if (!step->func) {
+			applog(LOG_ERR, "Unknown hash %.*s in chain %s", (int)len, p, spec);
+			return false;
+		}
+		p += len;
+		if (branch) {
+			if (*p++ != '|')
+				goto bad_branch;
+			len = strcspn(p, "]");
+			step->alt = chain_func(p, len);
+			if (!step->alt) {
+				applog(LOG_ERR, "Unknown hash %.*s in chain %s", (int)len, p, spec);
+				return false;
+			}
+			p += len;
+			if (*p++ != ']')
+				goto bad_branch;
+		}
+		chain->steps++;
+		if (*p == ',' && *++p)
+			continue;
+		if (*p) {
+			applog(LOG_ERR, "Expected a comma at %s in chain %s", p, spec);
+			return false;
+		}
+	}
+	if (!chain->steps) {
+		applog(LOG_ERR, "Empty algorithm chain");
+		return false;
+	}
+	return true;
+
+bad_branch:
+	applog(LOG_ERR, "Branch in chain %s is not [hash|hash]", spec);
+	return false;
+}
+
+/* A branch in the first step sees an all zero hash so takes alt */
+static const struct chain_func *chain_first(const struct chain *chain)
+{
+	return chain->step[0].alt ? chain->step[0].alt : chain->step[0].func;
+}
+
+/* Close the first step's ctx, which has seen the whole header, and run the
+ * rest of the chain into the 32 bytes of state */
+static void chain_finish(const struct chain *chain, union chain_context *ctx, void *state)
+{
+	unsigned char hash[64] = { 0 };
+	unsigned int i;
+
+	chain_first(chain)->close(ctx, hash);
+	for (i = 1; i < chain->steps; i++) {
+		const struct chain_step *step = &chain->step[i];
+		const struct chain_func *func = step->func;
+
+		if (step->alt && !(hash[0] & 0x8))
+			func = step->alt;
+		func->init(ctx);
+		func->update(ctx, hash, 64);
+		memset(hash, 0, sizeof(hash));
+		func->close(ctx, hash);
+	}
+	memcpy(state, hash, 32);
+}
+
+/* Hash the 80 byte big endian header in input into the 32 bytes of state */
+void chain_hash(const struct chain *chain, void *state, const void *input)
+{
+	const struct chain_func *func = chain_first(chain);
+	union chain_context ctx;
+
+	func->init(&ctx);
+	func->update(&ctx, input, 80);
+	chain_finish(chain, &ctx, state);
+}
+
+struct chain_midstate *chain_midstate_alloc(void)
+{
+	struct chain_midstate *mid = malloc(sizeof(*mid));
+
+	if (unlikely(!mid))
+		quit(1, "Failed to malloc chain midstate");
+	return mid;
+}
+
+/* Feed the first 76 bytes of the big endian header in input to the first
+ * hash, so hashing each nonce only has to add the last word. How much that
+ * saves depends on the hash's block size: all of it but the final block for
+ * luffa, fugue or sha256, only the byte swapping for 128 byte blocks. */
+void chain_midstate(const struct chain *chain, struct chain_midstate *mid, const void *input)
+{
+	const struct chain_func *func = chain_first(chain);
+
+	func->init(&mid->ctx);
+	func->update(&mid->ctx, input, 76);
+}
+
+/* chain_hash of the header mid was made from with nonce, big endian, as its
+ * last word */
+void chain_hash_nonce(const struct chain *chain, const struct chain_midstate *mid,
+		      void *state, uint32_t nonce)
+{
+	union chain_context ctx;
+
+	memcpy(&ctx, &mid->ctx, sizeof(ctx));
+	chain_first(chain)->update(&ctx, &nonce, 4);
+	chain_finish(chain, &ctx, state);
+}
+
+void chain_regenhash(const struct chain *chain, struct work *work)
+{
+	uint32_t data[20];
+	uint32_t *nonce = (uint32_t *)(work->data + 76);
+	int i;
+
+	for (i = 0; i < 19; i++)
+		data[i] = htobe32(((const uint32_t *)work->data)[i]);
+	data[19] = htobe32(*nonce);
+	chain_hash(chain, work->hash, data);
+}
+
+/* chain_midstate of the header in work->data, flipped as chain_regenhash
+ * does */
+void chain_work_midstate(const struct chain *chain, struct chain_midstate *mid, const struct work *work)
+{
+	uint32_t data[19];
+	int i;
+
+	for (i = 0; i < 19; i++)
+		data[i] = htobe32(((const uint32_t *)work->data)[i]);
+	chain_midstate(chain, mid, data);
+}
+
+/* chain_regenhash from mid, made by chain_work_midstate from this work or
+ * another with the same header up to the nonce */
+void chain_regenhash_mid(const struct chain *chain, const struct chain_midstate *mid, struct work *work)
+{
+	uint32_t *nonce = (uint32_t *)(work->data + 76);
+
+	chain_hash_nonce(chain, mid, work->hash, htobe32(*nonce));
+}
+
+/* Append the swaps taking the kernel's hash from byte order from to to. Both
+ * swaps, through memory order, swap the halves of each 64 bit word. */
+static char *chain_kernel_order(char *src, enum chain_order from, enum chain_order to)
+{
+	if (from == to)
+		return src;
+	if (from == CHAIN_BE64 || to == CHAIN_BE64)
+		src = realloc_strcat(src, "HASH_SWAP8\n");
+	if (from == CHAIN_BE32 || to == CHAIN_BE32)
+		src = realloc_strcat(src, "HASH_SWAP4\n");
+	return src;
+}
+
+/* Append func's block, the hash in byte order *order before and after */
+static char *chain_kernel_block(char *src, const struct chain_func *func, enum chain_order *order)
+{
+	char block[64];
+
+	src = chain_kernel_order(src, *order, func->in);
+	snprintf(block, sizeof(block), "{\n#include \"chain-%s.cl\"\n}\n", func->name);
+	src = realloc_strcat(src, block);
+	*order = func->out;
+	return src;
+}
+
+/* The OpenCL source of a search kernel hashing the chain, built from
+ * kernel/chain.cl and a kernel/chain-<hash>.cl block per hash. NULL, logging
+ * why, when a hash has no block or the chain doesn't start with blake512,
+ * the only hash with a block for the 80 byte header. */
+char *chain_kernel_source(const struct chain *chain)
+{
+	enum chain_order order = CHAIN_BE64;
+	char *src;
+	unsigned int i;
+
+	if (chain->step[0].alt || strcmp(chain->step[0].func->name, "blake512")) {
+		applog(LOG_ERR, "Only chains starting with blake512 have a generated kernel");
+		return NULL;
+	}
+	for (i = 1; i < chain->steps; i++) {
+		const struct chain_step *step = &chain->step[i];
+
+		if (step->func->in == CHAIN_NONE || (step->alt && step->alt->in == CHAIN_NONE)) {
+			applog(LOG_ERR, "No kernel/chain-%s.cl block for a generated kernel",
+			       step->func->in == CHAIN_NONE ? step->func->name : step->alt->name);
+			return NULL;
+		}
+	}
+
+	src = strdup("#include \"chain.cl\"\n{\n#include \"chain-blake512-80.cl\"\n}\n");
+	if (unlikely(!src))
+		quit(1, "Failed to strdup chain kernel source");
+	for (i = 1; i < chain->steps; i++) {
+		const struct chain_step *step = &chain->step[i];
+
+		if (!step->alt) {
+			src = chain_kernel_block(src, step->func, &order);
+			continue;
+		}
+		/* Both sides of a branch start and end in memory order */
+		src = chain_kernel_order(src, order, CHAIN_MEM);
+		src = realloc_strcat(src, "if (hash.h1[0] & 0x8) {\n");
+		order = CHAIN_MEM;
+		src = chain_kernel_block(src, step->func, &order);
+		src = chain_kernel_order(src, order, CHAIN_MEM);
+		src = realloc_strcat(src, "} else {\n");
+		order = CHAIN_MEM;
+		src = chain_kernel_block(src, step->alt, &order);
+		src = chain_kernel_order(src, order, CHAIN_MEM);
+		src = realloc_strcat(src, "}\n");
+		order = CHAIN_MEM;
+	}
+	src = chain_kernel_order(src, order, CHAIN_MEM);
+	return realloc_strcat(src, "#include \"chain-end.cl\"\n");
+}
@@ -0,0 +1,50 @@
+#ifndef __CHAIN_H__
+#define __CHAIN_H__
+
+#include "miner.h"
+
+/*
+ * An algorithm chain is a comma separated list of sph hashes applied in
+ * turn, e.g. "shavite512,simd512,shavite512,simd512,echo512". The first one
+ * hashes the 80 byte header, every later one the 64 bytes left by the one
+ * before (zero padded after a 256 bit hash), and the result is the first 32
+ * bytes. "[groestl512|skein512]" is a quark style branch taking the first
+ * hash when bit 3 of the first byte so far is set, the second otherwise.
+ *
+ * chain_regenhash checks the GPU's nonces and is the CPU miner's hash.
+ * Most OpenCL kernels are written by hand in kernel/<file>.cl, but for a
+ * chain of 512 bit hashes starting with blake512, chain_kernel_source
+ * generates one from the kernel/chain-<hash>.cl blocks.
+ * A new algorithm is its entry, chain included, in algorithm.c, and a hand
+ * written kernel if it is worth one.
+ */
+
+#define MAX_CHAIN_STEPS 32
+
+struct chain_func;
+
+struct chain_step {
+	const struct chain_func *func;
+	/* Taken instead of func when bit 3 of hash[0] is clear */
+	const struct chain_func *alt;
+};
+
+struct chain {
+	unsigned int steps;
+	struct chain_step step[MAX_CHAIN_STEPS];
+};
+
+struct chain_midstate;
+
+extern bool chain_parse(struct chain *chain, const char *spec);
+extern void chain_hash(const struct chain *chain, void *state, const void *input);
+extern void chain_regenhash(const struct chain *chain, struct work *work);
+extern struct chain_midstate *chain_midstate_alloc(void);
+extern void chain_midstate(const struct chain *chain, struct chain_midstate *mid, const void *input);
+extern void chain_hash_nonce(const struct chain *chain, const struct chain_midstate *mid,
+			     void *state, uint32_t nonce);
+extern void chain_work_midstate(const struct chain *chain, struct chain_midstate *mid, const struct work *work);
+extern void chain_regenhash_mid(const struct chain *chain, const struct chain_midstate *mid, struct work *work);
+extern char *chain_kernel_source(const struct chain *chain);
+
+#endif /* __CHAIN_H__ */
@@ -45,6 +45,9 @@
 /* int execv(const char*, const char*const*); */
 #define EXECV_2ND_ARG_TYPE const char* const*
 
+/* Filename for FRESH staged kernel */
+#define FRESHMOD_KERNNAME "freshmod"
+
 /* Filename for FRESH optimised kernel */
 #define FRESH_KERNNAME "fresh"
 
@@ -264,6 +267,9 @@
 /* Define to 1 if you have the <sys/bitypes.h> header file. */
 /* #undef HAVE_SYS_BITYPES_H */
 
+/* Define to 1 if you have the <sys/epoll.h> header file. */
+#define HAVE_SYS_EPOLL_H 1
+
 /* Define to 1 if you have the <sys/inttypes.h> header file. */
 /* #undef HAVE_SYS_INTTYPES_H */
 
@@ -338,6 +344,9 @@
    'ptrdiff_t'. */
 /* #undef PTRDIFF_T_SUFFIX */
 
+/* Name of the QuarkCoin kernel generated from its chain */
+#define QUARKCHAIN_KERNNAME "quarkchain"
+
 /* Filename for QuarkCoin optimised kernel */
 #define QUARKCOIN_KERNNAME "quarkcoin"
 
@@ -395,9 +404,15 @@
    'wint_t'. */
 /* #undef WINT_T_SUFFIX */
 
+/* Name of the X11 kernel generated from its chain */
+#define X11CHAIN_KERNNAME "x11chain"
+
 /* Filename for X11mod optimised kernel */
 #define X11MOD_KERNNAME "x11mod"
 
+/* Name of the X13 kernel generated from its chain */
+#define X13CHAIN_KERNNAME "x13chain"
+
 /* Filename for X13mod optimised kernel (AMD HD 5xxx/6xxx) */
 #define X13MODOLD_KERNNAME "x13modold"
 
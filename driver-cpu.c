@@ -0,0 +1,169 @@
+/*
+ * Copyright 2014 sgminer developers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "compat.h"
+#include "miner.h"
+#include "driver-cpu.h"
+#include "algorithm.h"
+
+int opt_cpu_threads;
+/* Set by --cpu-kernel, NULL hashes the first --kernel's algorithm */
+const struct algorithm *cpu_algorithm;
+
+static struct cgpu_info cpu_cgpu;
+
+char *set_cpu_kernel(char *arg)
+{
+	const struct algorithm *algo = find_algorithm(arg);
+
+	if (!algo)
+		return "Invalid parameter to set_cpu_kernel";
+	cpu_algorithm = algo;
+	return NULL;
+}
+
+static void cpu_detect(bool hotplug)
+{
+	const struct algorithm *algo = cpu_algorithm ? cpu_algorithm : default_algorithm;
+
+	if (hotplug || opt_cpu_threads < 1)
+		return;
+
+	cpu_cgpu.drv = &cpu_drv;
+	cpu_cgpu.deven = DEV_ENABLED;
+	cpu_cgpu.threads = opt_cpu_threads;
+	cpu_cgpu.name = "CPU";
+	/* Only takes work from pools of a compatible algorithm */
+	cpu_cgpu.kernel = algo ? algo->kernel : KL_NONE;
+	cpu_drv.max_diff = 65536;
+	add_cgpu(&cpu_cgpu);
+}
+
+static bool cpu_thread_prepare(struct thr_info *thr)
+{
+	struct timeval now;
+
+	cgtime(&now);
+	get_datestamp(thr->cgpu->init, sizeof(thr->cgpu->init), &now);
+
+	return true;
+}
+
+/* Keep each hashing thread on its own core so they don't bounce their
+ * hash contexts between caches */
+static bool cpu_thread_init(struct thr_info *thr)
+{
+#ifdef __linux__
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t set;
+
+	if (ncpus > 0) {
+		CPU_ZERO(&set);
+		CPU_SET(thr->device_thread % ncpus, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+			applog(LOG_INFO, "CPU %d: Unable to bind thread %d to core %ld",
+			       thr->cgpu->device_id, thr->device_thread, thr->device_thread % ncpus);
+	}
+#endif
+	thr->cgpu_data = chain_midstate_alloc();
+	thr->cgpu->status = LIFE_WELL;
+	thr->cgpu->device_last_well = time(NULL);
+
+	return true;
+}
+
+/* Start with a small range, hash_sole_work scales it to the log interval */
+static uint64_t cpu_can_limit_work(struct thr_info __maybe_unused *thr)
+{
+	return 0xffff;
+}
+
+static void cpu_thread_shutdown(struct thr_info *thr)
+{
+	free(thr->cgpu_data);
+	thr->cgpu_data = NULL;
+}
+
+/* Hash the nonces from work->blk.nonce up to max_nonce with the same
+ * per-algorithm hash functions used to check GPU results, only taking the
+ * slow path through submit_nonce for hashes that meet the device target.
+ * Chains start each nonce from the first hash's state after the rest of the
+ * header; scrypt has no chain and rehashes the whole header. */
+static int64_t cpu_scanhash(struct thr_info *thr, struct work *work, int64_t max_nonce)
+{
+	const struct chain *chain = algorithm_chain(kernel_algorithm(thr->cgpu->kernel));
+	struct chain_midstate *mid = thr->cgpu_data;
+	const uint32_t first = work->blk.nonce;
+	const uint32_t last = max_nonce > 0xffffffffLL ? 0xffffffff : (uint32_t)max_nonce;
+	const uint32_t htarg = le32toh(((uint32_t *)work->device_target)[7]);
+	uint32_t *hash7 = (uint32_t *)(work->hash + 28);
+	uint32_t nonce = first;
+
+	if (chain) {
+		uint32_t hash[8];
+
+		chain_work_midstate(chain, mid, work);
+
+		while (nonce < last) {
+			chain_hash_nonce(chain, mid, hash, htobe32(nonce));
+			if (unlikely(le32toh(hash[7]) <= htarg))
+				submit_nonce(thr, work, nonce);
+			nonce++;
+			if (unlikely(thr->work_restart))
+				break;
+		}
+	} else {
+		while (nonce < last) {
+			rebuild_nonce(work, nonce);
+			if (unlikely(le32toh(*hash7) <= htarg))
+				submit_nonce(thr, work, nonce);
+			nonce++;
+			if (unlikely(thr->work_restart))
+				break;
+		}
+	}
+
+	work->blk.nonce = nonce;
+
+	return nonce - first;
+}
+
+static struct api_data *cpu_api_stats(struct cgpu_info *cgpu)
+{
+	struct api_data *root = NULL;
+
+	root = api_add_int(root, "Threads", &cgpu->threads, false);
+
+	return root;
+}
+
+struct device_drv cpu_drv = {
+	.drv_id = DRIVER_cpu,
+	.dname = "cpu",
+	.name = "CPU",
+	.drv_detect = cpu_detect,
+	.get_api_stats = cpu_api_stats,
+	.thread_prepare = cpu_thread_prepare,
+	.can_limit_work = cpu_can_limit_work,
+	.thread_init = cpu_thread_init,
+	.thread_shutdown = cpu_thread_shutdown,
+	.scanhash = cpu_scanhash,
+};
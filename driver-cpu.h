@@ -0,0 +1,13 @@
+#ifndef __DEVICE_CPU_H__
+#define __DEVICE_CPU_H__
+
+#include "miner.h"
+
+extern int opt_cpu_threads;
+extern const struct algorithm *cpu_algorithm;
+
+extern char *set_cpu_kernel(char *arg);
+
+extern struct device_drv cpu_drv;
+
+#endif /* __DEVICE_CPU_H__ */
@@ -30,9 +30,12 @@
 #include "miner.h"
 #include "driver-opencl.h"
 #include "findnonce.h"
+#include "precalc.h"
 #include "ocl.h"
+#include "algorithm.h"
 #include "adl.h"
 #include "util.h"
+#include "autotune.h"
 
 #define CL_CHECK(_expr) \
     do { \
@@ -68,7 +71,6 @@ extern bool opt_loginput;
 extern char *opt_kernel_path;
 extern int gpur_thr_id;
 extern bool opt_noadl;
-extern enum diff_calc_mode dm_mode;
 
 extern void *miner_thread(void *userdata);
 extern int dev_from_id(int thr_id);
@@ -140,6 +142,35 @@ char *set_worksize(char *arg)
 	return NULL;
 }
 
+char *set_nonces_per_thread(char *arg)
+{
+	int i, val = 0, device = 0;
+	char *nextptr;
+
+	nextptr = strtok(arg, ",");
+	if (nextptr == NULL)
+		return "Invalid parameters for set nonces per thread";
+	val = atoi(nextptr);
+	if (val < 1 || val > MAX_NONCES_PER_THREAD)
+		return "Invalid value passed to set_nonces_per_thread";
+
+	gpus[device++].nonces_per_thread = val;
+
+	while ((nextptr = strtok(NULL, ",")) != NULL) {
+		val = atoi(nextptr);
+		if (val < 1 || val > MAX_NONCES_PER_THREAD)
+			return "Invalid value passed to set_nonces_per_thread";
+
+		gpus[device++].nonces_per_thread = val;
+	}
+	if (device == 1) {
+		for (i = device; i < MAX_GPUDEVICES; i++)
+			gpus[i].nonces_per_thread = gpus[0].nonces_per_thread;
+	}
+
+	return NULL;
+}
+
 char *set_shaders(char *arg)
 {
 	int i, val = 0, device = 0;
@@ -217,48 +248,9 @@ char *set_thread_concurrency(char *arg)
 
 static enum cl_kernels select_kernel(char *arg)
 {
-	if (!strcmp(arg, ALEXKARNEW_KERNNAME))
-		return KL_ALEXKARNEW;
-	if (!strcmp(arg, ALEXKAROLD_KERNNAME))
-		return KL_ALEXKAROLD;
-	if (!strcmp(arg, CKOLIVAS_KERNNAME))
-		return KL_CKOLIVAS;
-	if (!strcmp(arg, ZUIKKIS_KERNNAME))
-		return KL_ZUIKKIS;
-	if (!strcmp(arg, PSW_KERNNAME))
-		return KL_PSW;
-	if (!strcmp(arg, DARKCOIN_KERNNAME))
-		return KL_DARKCOIN;
-	if (!strcmp(arg, X11MOD_KERNNAME))
-		return KL_X11MOD;
-	if (!strcmp(arg, QUBITCOIN_KERNNAME))
-		return KL_QUBITCOIN;
-	if (!strcmp(arg, FRESH_KERNNAME))
-		return KL_FRESH;
-	if (!strcmp(arg, QUARKCOIN_KERNNAME))
-		return KL_QUARKCOIN;
-	if (!strcmp(arg, MYRIADCOIN_GROESTL_KERNNAME))
-		return KL_MYRIADCOIN_GROESTL;
-	if (!strcmp(arg, FUGUECOIN_KERNNAME))
-		return KL_FUGUECOIN;
-	if (!strcmp(arg, INKCOIN_KERNNAME))
-		return KL_INKCOIN;
-	if (!strcmp(arg, ANIMECOIN_KERNNAME))
-		return KL_ANIMECOIN;
-	if (!strcmp(arg, GROESTLCOIN_KERNNAME))
-		return KL_GROESTLCOIN;
-	if (!strcmp(arg, SIFCOIN_KERNNAME))
-		return KL_SIFCOIN;
-	if (!strcmp(arg, TWECOIN_KERNNAME))
-		return KL_TWECOIN;
-	if (!strcmp(arg, MARUCOIN_KERNNAME))
-		return KL_MARUCOIN;
-	if (!strcmp(arg, X13MOD_KERNNAME))
-		return KL_X13MOD;
-	if (!strcmp(arg, X13MODOLD_KERNNAME))
-		return KL_X13MODOLD;
-
-	return KL_NONE;
+	const struct algorithm *algo = find_algorithm(arg);
+
+	return algo ? algo->kernel : KL_NONE;
 }
 
 char *set_kernel(char *arg)
@@ -274,12 +266,7 @@ char *set_kernel(char *arg)
 	if (kern == KL_NONE)
 		return "Invalid parameter to set_kernel";
 	gpus[device++].kernel = kern;
-	if (kern >= KL_DARKCOIN)
-		dm_mode = DM_BITCOIN;
-	else if(kern >= KL_QUARKCOIN)
-		dm_mode = DM_QUARKCOIN;
-	else
-		dm_mode = DM_LITECOIN;
+	default_algorithm = kernel_algorithm(kern);
 
 	while ((nextptr = strtok(NULL, ",")) != NULL) {
 		kern = select_kernel(nextptr);
@@ -296,6 +283,26 @@ char *set_kernel(char *arg)
 	return NULL;
 }
 
+const char *cl_device_select_names[] = {
+	"gpu",
+	"cpu",
+	"all"
+};
+
+char *set_cl_device_type(char *arg)
+{
+	int i;
+
+	for (i = CL_SELECT_GPU; i <= CL_SELECT_ALL; i++) {
+		if (!strcasecmp(arg, cl_device_select_names[i])) {
+			opt_cl_device_type = i;
+			return NULL;
+		}
+	}
+
+	return "Invalid value passed to cl-device-type, use gpu, cpu or all";
+}
+
 #ifdef HAVE_ADL
 /* This function allows us to map an adl device to an opencl device for when
  * simple enumeration has failed to match them. */
@@ -792,6 +799,8 @@ void pause_dynamic_threads(int gpu)
 }
 
 static _clState *clStates[MAX_GPUDEVICES];
+/* Guards the --gpu-profile data against readers from the API */
+static pthread_mutex_t profile_lock;
 
 #if defined(HAVE_CURSES)
 void manage_gpu(void)
@@ -992,7 +1001,7 @@ retry: // TODO: refactor
 		gpus[selected].xintensity = 0; // Disable xintensity when enabling intensity
 		gpus[selected].rawintensity = 0; // Disable raw intensity when enabling intensity
 
-		if ((gpus[selected].kernel == KL_X11MOD) || (gpus[selected].kernel == KL_X13MOD) || (gpus[selected].kernel == KL_X13MODOLD)) {
+		if (kernel_algorithm(gpus[selected].kernel)->stages[0]) {
 			for (i = 0; i < mining_threads; ++i) {
 				thr = get_thread(i);
 				cgpu = thr->cgpu;
@@ -1053,7 +1062,7 @@ retry: // TODO: refactor
 		gpus[selected].xintensity = xintensity;
 		gpus[selected].rawintensity = 0; // Disable raw intensity when enabling intensity
 
-		if ((gpus[selected].kernel == KL_X11MOD) || (gpus[selected].kernel == KL_X13MOD || (gpus[selected].kernel == KL_X13MODOLD))) {
+		if (kernel_algorithm(gpus[selected].kernel)->stages[0]) {
 			for (i = 0; i < mining_threads; ++i) {
 				thr = get_thread(i);
 				cgpu = thr->cgpu;
@@ -1114,7 +1123,7 @@ retry: // TODO: refactor
 		gpus[selected].xintensity = 0; // Disable xintensity when enabling intensity
 		gpus[selected].rawintensity = rawintensity; 
 
-		if ((gpus[selected].kernel == KL_X11MOD) || (gpus[selected].kernel == KL_X13MOD || (gpus[selected].kernel == KL_X13MODOLD))) {
+		if (kernel_algorithm(gpus[selected].kernel)->stages[0]) {
 			for (i = 0; i < mining_threads; ++i) {
 				thr = get_thread(i);
 				cgpu = thr->cgpu;
@@ -1202,118 +1211,38 @@ static cl_int queue_scrypt_kernel(_clState *clState, dev_blk_ctx *blk, __maybe_u
 
 static cl_int queue_sph_kernel(_clState *clState, dev_blk_ctx *blk, __maybe_unused cl_uint threads)
 {
-	unsigned char *midstate = blk->work->midstate;
+	const struct algorithm *algo = clState->algorithm;
 	cl_kernel *kernel = &clState->kernel;
-	unsigned int num = 0;
+	unsigned int num = 0, state, i;
 	cl_ulong le_target;
 	cl_int status = 0;
 
 	le_target = *(cl_ulong *)(blk->work->device_target + 24);
 	flip80(clState->cldata, blk->work->data);
-	status = clEnqueueWriteBuffer(clState->commandQueue, clState->CLbuffer0, true, 0, 80, clState->cldata, 0, NULL,NULL);
+	/* HASHOUT kernels find the full target after the header */
+	memcpy(clState->cldata + 80, blk->work->device_target, 32);
+	status = clEnqueueWriteBuffer(clState->commandQueue, clState->CLbuffer0, true, 0, clState->hashout ? 112 : 80,
+				      clState->cldata, 0, NULL,NULL);
 
 	CL_SET_ARG(clState->CLbuffer0);
 	CL_SET_ARG(clState->outputBuffer);
 	CL_SET_ARG(le_target);
 
-	return status;
-}
-
-static cl_int queue_x11mod_kernel(_clState *clState, dev_blk_ctx *blk, __maybe_unused cl_uint threads)
-{
-	unsigned char *midstate = blk->work->midstate;
-	cl_kernel *kernel;
-	unsigned int num = 0;
-	cl_ulong le_target;
-	cl_int status = 0;
-
-	le_target = *(cl_ulong *)(blk->work->device_target + 24);
-	flip80(clState->cldata, blk->work->data);
-	status = clEnqueueWriteBuffer(clState->commandQueue, clState->CLbuffer0, true, 0, 80, clState->cldata, 0, NULL,NULL);
-
-//clbuffer, hashes
-	kernel = &clState->kernel_blake;
-	CL_SET_ARG_N(0,clState->CLbuffer0);
-	CL_SET_ARG_N(1,clState->hash_buffer);
-	kernel = &clState->kernel_bmw;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_groestl;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_skein;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_jh;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_keccak;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_luffa;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_cubehash;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_shavite;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_simd;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-//hashes, output, target
-	kernel = &clState->kernel_echo;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	CL_SET_ARG_N(1,clState->outputBuffer);
-	CL_SET_ARG_N(2,le_target);
-
-	return status;
-}
-
-static cl_int queue_x13mod_kernel(_clState *clState, dev_blk_ctx *blk, __maybe_unused cl_uint threads)
-{
-	unsigned char *midstate = blk->work->midstate;
-	cl_kernel *kernel;
-	unsigned int num = 0;
-	cl_ulong le_target;
-	cl_int status = 0;
-
-	le_target = *(cl_ulong *)(blk->work->device_target + 24);
-	flip80(clState->cldata, blk->work->data);
-	status = clEnqueueWriteBuffer(clState->commandQueue, clState->CLbuffer0, true, 0, 80, clState->cldata, 0, NULL,NULL);
-
-//clbuffer, hashes
-	kernel = &clState->kernel_blake;
-	CL_SET_ARG_N(0,clState->CLbuffer0);
-	CL_SET_ARG_N(1,clState->hash_buffer);
-	kernel = &clState->kernel_bmw;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_groestl;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_skein;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_jh;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_keccak;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_luffa;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_cubehash;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_shavite;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_simd;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_echo;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_hamsi;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-//hashes, output, target
-	kernel = &clState->kernel_fugue;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	CL_SET_ARG_N(1,clState->outputBuffer);
-	CL_SET_ARG_N(2,le_target);
+	/* First-block state from precalc_sph() */
+	for (i = 0, state = 0; algo->state[i]; state += algo->state[i++])
+		CL_SET_VARG(algo->state[i], &blk->sph_state[state]);
 
 	return status;
 }
 
-static cl_int queue_x13modold_kernel(_clState *clState, dev_blk_ctx *blk, __maybe_unused cl_uint threads)
+/* The first stage of the hash buffer kernels takes the header and its
+ * precalc state, the last one writes the results */
+static cl_int queue_staged_kernel(_clState *clState, dev_blk_ctx *blk, __maybe_unused cl_uint threads)
 {
-	unsigned char *midstate = blk->work->midstate;
+	const struct algorithm *algo = clState->algorithm;
+	const unsigned int last = clState->nstages - 1;
 	cl_kernel *kernel;
-	unsigned int num = 0;
+	unsigned int num = 0, state, i;
 	cl_ulong le_target;
 	cl_int status = 0;
 
@@ -1321,38 +1250,28 @@ static cl_int queue_x13modold_kernel(_clState *clState, dev_blk_ctx *blk, __mayb
 	flip80(clState->cldata, blk->work->data);
 	status = clEnqueueWriteBuffer(clState->commandQueue, clState->CLbuffer0, true, 0, 80, clState->cldata, 0, NULL,NULL);
 
-//clbuffer, hashes
-	kernel = &clState->kernel_blake;
-	CL_SET_ARG_N(0,clState->CLbuffer0);
-	CL_SET_ARG_N(1,clState->hash_buffer);
-	kernel = &clState->kernel_bmw;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_groestl;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_skein;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_jh;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_keccak;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_luffa;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_cubehash;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_shavite;
-	CL_SET_ARG_N(0,clState->hash_buffer);
-	kernel = &clState->kernel_simd;
-	CL_SET_ARG_N(0,clState->hash_buffer);
+//clbuffer, hashes, first-block state from precalc_sph()
+	kernel = &clState->stage[0];
+	CL_SET_ARG(clState->CLbuffer0);
+	CL_SET_ARG(clState->hash_buffer);
+	for (i = 0, state = 0; algo->state[i]; state += algo->state[i++])
+		CL_SET_VARG(algo->state[i], &blk->sph_state[state]);
+//hashes
+	for (i = 1; i <= last; i++) {
+		kernel = &clState->stage[i];
+		CL_SET_ARG_N(0,clState->hash_buffer);
+	}
 //hashes, output, target
-	kernel = &clState->kernel_echo_hamsi_fugue;
-	CL_SET_ARG_N(0,clState->hash_buffer);
+	kernel = &clState->stage[last];
 	CL_SET_ARG_N(1,clState->outputBuffer);
 	CL_SET_ARG_N(2,le_target);
 
 	return status;
 }
 
-static void set_threads_hashes(unsigned int vectors, unsigned int compute_shaders, int64_t *hashes, size_t *globalThreads,
+/* Each work item hashes vectors * npt nonces, the intensity still sets the
+ * number of work items */
+static void set_threads_hashes(unsigned int vectors, unsigned int npt, unsigned int compute_shaders, int64_t *hashes, size_t *globalThreads,
 			       unsigned int minthreads, __maybe_unused int *intensity, __maybe_unused int *xintensity, __maybe_unused int *rawintensity)
 {
 	unsigned int threads = 0;
@@ -1373,7 +1292,7 @@ static void set_threads_hashes(unsigned int vectors, unsigned int compute_shader
 	}
 
 	*globalThreads = threads;
-	*hashes = threads * vectors;
+	*hashes = (int64_t)threads * vectors * npt;
 }
 
 /* We have only one thread that ever re-initialises GPUs, thus if any GPU
@@ -1496,6 +1415,8 @@ static void opencl_detect(bool hotplug)
 	if (!nDevs)
 		return;
 
+	mutex_init(&profile_lock);
+
 	/* If opt_g_threads is not set, use default 1 thread */
 	if (opt_g_threads == -1)
 		opt_g_threads = 1;
@@ -1564,9 +1485,48 @@ static void get_opencl_statline(char *buf, size_t bufsiz, struct cgpu_info *gpu)
 		tailsprintf(buf, bufsiz, " I:%2d", gpu->intensity);
 }
 
+/* Samples kept per step for the percentiles, and the weight of the newest
+ * sample in the rolling average */
+#define PROFILE_SAMPLES 256
+#define PROFILE_DECAY 0.05
+
+enum profile_host_step {
+	PROFILE_UPLOAD,
+	PROFILE_READBACK,
+	PROFILE_FINISH,
+	PROFILE_HOST_STEPS
+};
+
+static const char *profile_host_names[PROFILE_HOST_STEPS] = {
+	"Upload",
+	"Readback",
+	"Finish"
+};
+
+struct profile_step {
+	const char *name;
+	double avg;
+	double samples[PROFILE_SAMPLES];
+	unsigned int count;
+};
+
+/* Times in us of each kernel stage from its event timestamps and of the
+ * host side steps around them, only kept with --gpu-profile */
+struct kernel_profile {
+	unsigned int nstages;
+	struct profile_step stages[MAX_KERNEL_STAGES];
+	struct profile_step host[PROFILE_HOST_STEPS];
+};
+
 struct opencl_thread_data {
 	cl_int (*queue_kernel_parameters)(_clState *, dev_blk_ctx *, cl_uint);
 	uint32_t *res;
+	struct kernel_profile *profile;
+	/* A launch that overflowed the result slots is scanned again in
+	 * launches split ways smaller, up to split_end of work split_id */
+	unsigned int split;
+	int split_id;
+	uint32_t split_end;
 };
 
 static uint32_t *blank_res;
@@ -1580,7 +1540,8 @@ static bool opencl_thread_prepare(struct thr_info *thr)
 	int virtual_gpu = cgpu->virtual_gpu;
 	int i = thr->id;
 	static bool failmessage = false;
-	int buffersize = BUFFERSIZE;
+	/* Room for the largest outsize, with a hash after every slot */
+	int buffersize = (opt_result_slots + 1) * sizeof(uint32_t) + opt_result_slots * 32;
 
 	if (!blank_res)
 		blank_res = calloc(buffersize, 1);
@@ -1589,6 +1550,8 @@ static bool opencl_thread_prepare(struct thr_info *thr)
 		return false;
 	}
 
+	autotune_apply_profile(cgpu);
+
 	strcpy(name, "");
 	applog(LOG_INFO, "Init GPU thread %i GPU %i virtual GPU %i", i, gpu, virtual_gpu);
 	clStates[i] = initCl(virtual_gpu, name, sizeof(name));
@@ -1620,72 +1583,11 @@ static bool opencl_thread_prepare(struct thr_info *thr)
 	}
 	if (!cgpu->name)
 		cgpu->name = strdup(name);
-	if (!cgpu->kname)
-	{
-		switch (clStates[i]->chosen_kernel) {
-			case KL_ALEXKARNEW:
-				cgpu->kname = ALEXKARNEW_KERNNAME;
-				break;
-			case KL_ALEXKAROLD:
-				cgpu->kname = ALEXKAROLD_KERNNAME;
-				break;
-			case KL_CKOLIVAS:
-				cgpu->kname = CKOLIVAS_KERNNAME;
-				break;
-			case KL_ZUIKKIS:
-				cgpu->kname = ZUIKKIS_KERNNAME;
-				break;
-			case KL_PSW:
-				cgpu->kname = PSW_KERNNAME;
-				break;
-			case KL_DARKCOIN:
-				cgpu->kname = DARKCOIN_KERNNAME;
-				break;
-			case KL_QUBITCOIN:
-				cgpu->kname = QUBITCOIN_KERNNAME;
-				break;
-			case KL_FRESH:
-				cgpu->kname = FRESH_KERNNAME;
-				break;
-			case KL_QUARKCOIN:
-				cgpu->kname = QUARKCOIN_KERNNAME;
-				break;
-			case KL_MYRIADCOIN_GROESTL:
-				cgpu->kname = MYRIADCOIN_GROESTL_KERNNAME;
-				break;
-			case KL_FUGUECOIN:
-				cgpu->kname = FUGUECOIN_KERNNAME;
-				break;
-			case KL_INKCOIN:
-				cgpu->kname = INKCOIN_KERNNAME;
-				break;
-			case KL_ANIMECOIN:
-				cgpu->kname = ANIMECOIN_KERNNAME;
-				break;
-			case KL_GROESTLCOIN:
-				cgpu->kname = GROESTLCOIN_KERNNAME;
-				break;
-			case KL_SIFCOIN:
-				cgpu->kname = SIFCOIN_KERNNAME;
-				break;
-			case KL_TWECOIN:
-				cgpu->kname = TWECOIN_KERNNAME;
-				break;
-			case KL_MARUCOIN:
-				cgpu->kname = MARUCOIN_KERNNAME;
-				break;
-			case KL_X11MOD:
-				cgpu->kname = X11MOD_KERNNAME;
-				break;
-			case KL_X13MOD:
-				cgpu->kname = X13MOD_KERNNAME;
-				break;
-			case KL_X13MODOLD:
-				cgpu->kname = X13MOD_KERNNAME;
-				break;
-			default:
-				break;
-		}
+	if (!cgpu->kname) {
+		const struct algorithm *algo = clStates[i]->algorithm;
+
+		/* A generated kernel's file is only the head all of them share */
+		cgpu->kname = (algo->flags & ALGO_GENERATED) ? algo->name : algo->file;
 	}
 	applog(LOG_INFO, "initCl() finished. Found %s", name);
 	cgtime(&now);
@@ -1701,52 +1603,29 @@ static bool opencl_thread_init(struct thr_info *thr)
 	struct opencl_thread_data *thrdata;
 	_clState *clState = clStates[thr_id];
 	cl_int status = 0;
+	unsigned int i;
 	thrdata = calloc(1, sizeof(*thrdata));
 	thr->cgpu_data = thrdata;
-	int buffersize = BUFFERSIZE;
+	int buffersize = clState->outsize;
 
 	if (!thrdata) {
 		applog(LOG_ERR, "Failed to calloc in opencl_thread_init");
 		return false;
 	}
 
-	switch (clState->chosen_kernel) {
-	case KL_X11MOD:
-		thrdata->queue_kernel_parameters = &queue_x11mod_kernel;
-		break;
-	case KL_X13MOD:
-		thrdata->queue_kernel_parameters = &queue_x13mod_kernel;
-		break;
-	case KL_X13MODOLD:
-		thrdata->queue_kernel_parameters = &queue_x13modold_kernel;
-		break;
-	case KL_ALEXKARNEW:
-	case KL_ALEXKAROLD:
-	case KL_CKOLIVAS:
-	case KL_PSW:
-	case KL_ZUIKKIS:
+	if (clState->algorithm->flags & ALGO_SCRYPT)
 		thrdata->queue_kernel_parameters = &queue_scrypt_kernel;
-		break;
-	case KL_DARKCOIN:
-	case KL_QUBITCOIN:
-	case KL_FRESH:
-	case KL_QUARKCOIN:
-	case KL_MYRIADCOIN_GROESTL:
-	case KL_FUGUECOIN:
-	case KL_INKCOIN:
-	case KL_ANIMECOIN:
-	case KL_GROESTLCOIN:
-	case KL_SIFCOIN:
-	case KL_TWECOIN:
-	case KL_MARUCOIN:
+	else if (clState->nstages)
+		thrdata->queue_kernel_parameters = &queue_staged_kernel;
+	else
 		thrdata->queue_kernel_parameters = &queue_sph_kernel;
-		break;
-	default:
-		applog(LOG_ERR, "Failed to choose kernel in opencl_thread_init");
-		break;
-	}
 
-	thrdata->res = calloc(buffersize, 1);
+	/* Results land in the pinned mapping when there is one, one
+	 * outsize block per queue */
+	if (clState->outputMap)
+		thrdata->res = clState->outputMap;
+	else
+		thrdata->res = calloc(buffersize, clState->nqueues);
 
 	if (!thrdata->res) {
 		free(thrdata);
@@ -1754,8 +1633,19 @@ static bool opencl_thread_init(struct thr_info *thr)
 		return false;
 	}
 
-	status |= clEnqueueWriteBuffer(clState->commandQueue, clState->outputBuffer, CL_TRUE, 0,
-				       buffersize, blank_res, 0, NULL, NULL);
+	if (opt_gpu_profile) {
+		if (!clState->hasProfiling)
+			applog(LOG_WARNING, "GPU %d: no queue profiling, --gpu-profile disabled", gpu->device_id);
+		else {
+			thrdata->profile = calloc(1, sizeof(*thrdata->profile));
+			if (unlikely(!thrdata->profile))
+				applog(LOG_ERR, "Failed to calloc profile in opencl_thread_init");
+		}
+	}
+
+	for (i = 0; i < clState->nqueues; i++)
+		status |= clEnqueueWriteBuffer(clState->queue[i], clState->output[i], CL_TRUE, 0,
+					       buffersize, blank_res, 0, NULL, NULL);
 	if (unlikely(status != CL_SUCCESS)) {
 		applog(LOG_ERR, "Error: clEnqueueWriteBuffer failed.");
 		return false;
@@ -1769,20 +1659,209 @@ static bool opencl_thread_init(struct thr_info *thr)
 }
 
 
-static bool opencl_prepare_work(struct thr_info __maybe_unused *thr, struct work *work)
+static bool opencl_prepare_work(struct thr_info *thr, struct work *work)
 {
 	work->blk.work = work;
+	precalc_sph(clStates[thr->id]->algorithm, &work->blk);
 	return true;
 }
 
 extern int opt_dynamic_interval;
+extern int opt_dynamic_headless_interval;
+extern bool opt_dynamic_headless;
+
+/* Threads to launch in dynamic mode, a multiple of the worksize */
+static size_t dynamic_threads(struct cgpu_info *gpu, _clState *clState)
+{
+	double max_threads = clState->max_threads ? clState->max_threads : DYNAMIC_MAX_THREADS;
+	size_t threads;
+	int i;
 
-#define CL_ENQUEUE_KERNEL(KL, GWO) \
-	status = clEnqueueNDRangeKernel(clState->commandQueue, clState->kernel_##KL, 1, GWO, globalThreads, localThreads, 0, NULL, NULL); \
-	if (unlikely(status != CL_SUCCESS)) { \
-	    applog(LOG_ERR, "Error %d: Enqueueing kernel %s onto command queue. (clEnqueueNDRangeKernel)", status, #KL); \
-	    return -1; \
+	if (gpu->dyn_threads < clState->wsize) {
+		/* Start from one thread per shader */
+		gpu->dyn_threads = clState->compute_shaders;
+		if (gpu->dyn_threads < clState->wsize)
+			gpu->dyn_threads = clState->wsize;
+		gpu->dyn_error = 0;
 	}
+	if (gpu->dyn_threads > max_threads)
+		gpu->dyn_threads = max_threads;
+
+	threads = gpu->dyn_threads;
+	threads -= threads % clState->wsize;
+	if (threads < clState->wsize)
+		threads = clState->wsize;
+
+	/* Nearest intensity below, for display only */
+	for (i = MIN_INTENSITY; i < MAX_INTENSITY && (1UL << (i + 1)) <= threads; i++);
+	gpu->intensity = i;
+
+	return threads;
+}
+
+/* PI control of the threads per launch towards a target kernel time. The
+ * error is relative to the target so the gains work for any device and
+ * algorithm, and the velocity form has no integral sum to wind up. Desktop
+ * mode keeps kernels short and backs off twice as hard when over target so
+ * the display stays responsive, headless mode aims at longer kernels for
+ * throughput and steers symmetrically. */
+static void dynamic_intensity_update(struct cgpu_info *gpu, double kernel_us, bool headless)
+{
+	double target_us, error, kp, ki, scale;
+
+	if (kernel_us <= 0)
+		return;
+
+	if (headless) {
+		target_us = opt_dynamic_headless_interval * 1000;
+		kp = 0.5;
+		ki = 0.25;
+	} else {
+		target_us = opt_dynamic_interval * 1000;
+		kp = 0.3;
+		ki = 0.15;
+	}
+
+	error = (target_us - kernel_us) / target_us;
+	if (error < -1)
+		error = -1;
+	if (!headless && error < 0)
+		ki *= 2;
+
+	scale = 1 + kp * (error - gpu->dyn_error) + ki * error;
+	if (scale < 0.5)
+		scale = 0.5;
+	else if (scale > 2)
+		scale = 2;
+
+	gpu->dyn_threads *= scale;
+	gpu->dyn_error = error;
+}
+
+/* Total device execution time of finished kernels in us, releasing their
+ * events. Each kernel's own time goes in durations when it isn't NULL.
+ * Returns -1 if the timestamps can't be read. */
+static double kernel_events_us(cl_event *events, unsigned int nevents, double *durations)
+{
+	cl_ulong start, end;
+	double ns = 0;
+	bool ok = true;
+	unsigned int i;
+
+	for (i = 0; i < nevents; i++) {
+		if (ok && clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) == CL_SUCCESS &&
+		    clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) == CL_SUCCESS) {
+			ns += end - start;
+			if (durations)
+				durations[i] = (double)(end - start) / 1000;
+		} else
+			ok = false;
+		clReleaseEvent(events[i]);
+	}
+
+	return ok ? ns / 1000 : -1;
+}
+
+static void profile_sample(struct profile_step *step, const char *name, double us)
+{
+	if (us < 0)
+		return;
+
+	step->name = name;
+	if (step->count)
+		step->avg += (us - step->avg) * PROFILE_DECAY;
+	else
+		step->avg = us;
+	step->samples[step->count++ % PROFILE_SAMPLES] = us;
+}
+
+/* Record one scanhash worth of timings into the thread's profile */
+static void profile_record(struct kernel_profile *profile, const char **knames, double *kernel_us,
+			   unsigned int nstages, double *host_us)
+{
+	unsigned int i;
+
+	mutex_lock(&profile_lock);
+	for (i = 0; i < nstages; i++)
+		profile_sample(&profile->stages[i], knames[i], kernel_us[i]);
+	if (nstages > profile->nstages)
+		profile->nstages = nstages;
+	for (i = 0; i < PROFILE_HOST_STEPS; i++)
+		profile_sample(&profile->host[i], profile_host_names[i], host_us[i]);
+	mutex_unlock(&profile_lock);
+}
+
+static int profile_cmp(const void *a, const void *b)
+{
+	double da = *(const double *)a, db = *(const double *)b;
+
+	return (da > db) - (da < db);
+}
+
+static struct api_data *profile_api_step(struct api_data *root, struct profile_step *step)
+{
+	double sorted[PROFILE_SAMPLES];
+	unsigned int n = step->count < PROFILE_SAMPLES ? step->count : PROFILE_SAMPLES;
+	char buf[64];
+
+	if (!n || !step->name)
+		return root;
+
+	memcpy(sorted, step->samples, n * sizeof(double));
+	qsort(sorted, n, sizeof(double), profile_cmp);
+
+	snprintf(buf, sizeof(buf), "%s Avg", step->name);
+	root = api_add_double(root, buf, &step->avg, true);
+	snprintf(buf, sizeof(buf), "%s P50", step->name);
+	root = api_add_double(root, buf, &sorted[n / 2], true);
+	snprintf(buf, sizeof(buf), "%s P99", step->name);
+	root = api_add_double(root, buf, &sorted[(n * 99) / 100], true);
+
+	return root;
+}
+
+static struct api_data *opencl_api_profile(struct thr_info *thr, struct api_data *root)
+{
+	struct opencl_thread_data *thrdata;
+	struct kernel_profile *profile;
+	unsigned int i;
+
+	mutex_lock(&profile_lock);
+	thrdata = thr->cgpu_data;
+	profile = thrdata ? thrdata->profile : NULL;
+	if (profile) {
+		for (i = 0; i < profile->nstages; i++)
+			root = profile_api_step(root, &profile->stages[i]);
+		for (i = 0; i < PROFILE_HOST_STEPS; i++)
+			root = profile_api_step(root, &profile->host[i]);
+	}
+	mutex_unlock(&profile_lock);
+
+	return root;
+}
+
+/* Zero the result counter of a queue's output buffer on the device */
+static cl_int reset_found(_clState *clState, unsigned int q)
+{
+	static const uint32_t zero = 0;
+
+#ifdef CL_VERSION_1_2
+	if (clState->hasOpenCL12plus)
+		return clEnqueueFillBuffer(clState->queue[q], clState->output[q], &zero, sizeof(zero),
+					   clState->found * sizeof(uint32_t), sizeof(zero), 0, NULL, NULL);
+#endif
+	return clEnqueueWriteBuffer(clState->queue[q], clState->output[q], CL_FALSE,
+				    clState->found * sizeof(uint32_t), sizeof(zero), &zero, 0, NULL, NULL);
+}
+
+/* Profile stage names of the single kernel launched on each queue */
+static const char *queue_stage_names[MAX_GPU_QUEUES] = {
+	"search", "search1", "search2", "search3", "search4",
+	"search5", "search6", "search7", "search8", "search9"
+};
+
+#define KERNEL_EVENT(NAME) (record ? (knames[nkevents] = (NAME), &kevents[nkevents++]) : NULL)
+
 
 
 static int64_t opencl_scanhash(struct thr_info *thr, struct work *work,
@@ -1793,140 +1872,113 @@ static int64_t opencl_scanhash(struct thr_info *thr, struct work *work,
 	struct cgpu_info *gpu = thr->cgpu;
 	_clState *clState = clStates[thr_id];
 	const cl_kernel *kernel = &clState->kernel;
-	const int dynamic_us = opt_dynamic_interval * 1000;
+	const bool dynamic = gpu->dynamic;
+	/* No display hangs off a CPU device */
+	const bool headless = opt_dynamic_headless || clState->isCPU;
+	struct kernel_profile *profile = thrdata->profile;
+	const bool profiling = (dynamic || profile) && clState->hasProfiling;
+	/* Only the first block of nonces of the staged kernels is timed */
+	bool record = profiling;
 
 	cl_int status;
 	size_t globalThreads[1];
 	size_t localThreads[1] = { clState->wsize };
+	cl_event kevents[MAX_KERNEL_STAGES], read_event = NULL;
+	const char *knames[MAX_KERNEL_STAGES];
+	double kernel_us[MAX_KERNEL_STAGES], host_us[PROFILE_HOST_STEPS];
+	unsigned int nkevents = 0;
+	struct timeval tv_launch, tv_done, tv_start;
+	unsigned int nqueues = clState->nqueues, q;
 	int64_t hashes;
-	int found = FOUND;
-	int buffersize = BUFFERSIZE;
-
-	/* Windows' timer resolution is only 15ms so oversample 5x */
-	if (gpu->dynamic && (++gpu->intervals * dynamic_us) > 70000) {
-		struct timeval tv_gpuend;
-		double gpu_us;
-
-		cgtime(&tv_gpuend);
-		gpu_us = us_tdiff(&tv_gpuend, &gpu->tv_gpustart) / gpu->intervals;
-		if (gpu_us > dynamic_us) {
-			if (gpu->intensity > MIN_INTENSITY)
-				--gpu->intensity;
-		} else if (gpu_us < dynamic_us / 2) {
-			if (gpu->intensity < MAX_INTENSITY)
-				++gpu->intensity;
-		}
-		memcpy(&(gpu->tv_gpustart), &tv_gpuend, sizeof(struct timeval));
-		gpu->intervals = 0;
-	}
-
-	set_threads_hashes(clState->vwidth, clState->compute_shaders, &hashes, globalThreads, localThreads[0],
-			   &gpu->intensity, &gpu->xintensity, &gpu->rawintensity);
+	const unsigned int found = clState->found, stride = clState->outsize / sizeof(uint32_t);
+	const uint32_t first_nonce = work->blk.nonce;
+	unsigned int overflow = 0;
+	bool rescan = false;
+
+	if (dynamic) {
+		globalThreads[0] = dynamic_threads(gpu, clState);
+		hashes = (int64_t)globalThreads[0] * clState->vwidth * clState->npt;
+		cgtime(&tv_launch);
+	} else
+		set_threads_hashes(clState->vwidth, clState->npt, clState->compute_shaders, &hashes, globalThreads, localThreads[0],
+				   &gpu->intensity, &gpu->xintensity, &gpu->rawintensity);
 	if (hashes > gpu->max_hashes)
 		gpu->max_hashes = hashes;
+	if (thrdata->split > 1) {
+		if (work->id != thrdata->split_id || work->blk.nonce >= thrdata->split_end)
+			thrdata->split = 1;
+		else {
+			size_t threads = globalThreads[0] / thrdata->split;
+
+			threads -= threads % localThreads[0];
+			if (threads < localThreads[0])
+				threads = localThreads[0];
+			globalThreads[0] = threads;
+			hashes = (int64_t)threads * clState->vwidth * clState->npt;
+			rescan = true;
+		}
+	}
+	/* Every queue needs at least one workgroup */
+	if (nqueues > globalThreads[0] / localThreads[0])
+		nqueues = globalThreads[0] / localThreads[0];
+	if (nqueues < 1 || !clState->goffset)
+		nqueues = 1;
 
+	if (profile)
+		cgtime(&tv_start);
 	status = thrdata->queue_kernel_parameters(clState, &work->blk, globalThreads[0]);
 	if (unlikely(status != CL_SUCCESS)) {
 		applog(LOG_ERR, "Error: clSetKernelArg of all params failed.");
 		return -1;
 	}
+	if (profile) {
+		cgtime(&tv_done);
+		host_us[PROFILE_UPLOAD] = us_tdiff(&tv_done, &tv_start);
+	}
 
-	if (clState->chosen_kernel == KL_X11MOD) {
-	    if (clState->goffset) {
-		size_t global_work_offset[1];
-		global_work_offset[0] = work->blk.nonce;
-
-		CL_ENQUEUE_KERNEL(blake, global_work_offset);
-		CL_ENQUEUE_KERNEL(bmw, global_work_offset);
-		CL_ENQUEUE_KERNEL(groestl, global_work_offset);
-		CL_ENQUEUE_KERNEL(skein, global_work_offset);
-		CL_ENQUEUE_KERNEL(jh, global_work_offset);
-		CL_ENQUEUE_KERNEL(keccak, global_work_offset);
-		CL_ENQUEUE_KERNEL(luffa, global_work_offset);
-		CL_ENQUEUE_KERNEL(cubehash, global_work_offset);
-		CL_ENQUEUE_KERNEL(shavite, global_work_offset);
-		CL_ENQUEUE_KERNEL(simd, global_work_offset)
-		CL_ENQUEUE_KERNEL(echo, global_work_offset);
-	    }
-	    else {
-		CL_ENQUEUE_KERNEL(blake, NULL);
-		CL_ENQUEUE_KERNEL(bmw, NULL);
-		CL_ENQUEUE_KERNEL(groestl, NULL);
-		CL_ENQUEUE_KERNEL(skein, NULL);
-		CL_ENQUEUE_KERNEL(jh, NULL);
-		CL_ENQUEUE_KERNEL(keccak, NULL);
-		CL_ENQUEUE_KERNEL(luffa, NULL);
-		CL_ENQUEUE_KERNEL(cubehash, NULL);
-		CL_ENQUEUE_KERNEL(shavite, NULL);
-		CL_ENQUEUE_KERNEL(simd, NULL)
-		CL_ENQUEUE_KERNEL(echo, NULL);
-            }
-	}
-	else if (clState->chosen_kernel == KL_X13MOD) {
-	    if (clState->goffset) {
-		size_t global_work_offset[1];
-		global_work_offset[0] = work->blk.nonce;
-
-		CL_ENQUEUE_KERNEL(blake, global_work_offset);
-		CL_ENQUEUE_KERNEL(bmw, global_work_offset);
-		CL_ENQUEUE_KERNEL(groestl, global_work_offset);
-		CL_ENQUEUE_KERNEL(skein, global_work_offset);
-		CL_ENQUEUE_KERNEL(jh, global_work_offset);
-		CL_ENQUEUE_KERNEL(keccak, global_work_offset);
-		CL_ENQUEUE_KERNEL(luffa, global_work_offset);
-		CL_ENQUEUE_KERNEL(cubehash, global_work_offset);
-		CL_ENQUEUE_KERNEL(shavite, global_work_offset);
-		CL_ENQUEUE_KERNEL(simd, global_work_offset)
-		CL_ENQUEUE_KERNEL(echo, global_work_offset);
-		CL_ENQUEUE_KERNEL(hamsi, global_work_offset);
-		CL_ENQUEUE_KERNEL(fugue, global_work_offset);
-	    }
-	    else {
-		CL_ENQUEUE_KERNEL(blake, NULL);
-		CL_ENQUEUE_KERNEL(bmw, NULL);
-		CL_ENQUEUE_KERNEL(groestl, NULL);
-		CL_ENQUEUE_KERNEL(skein, NULL);
-		CL_ENQUEUE_KERNEL(jh, NULL);
-		CL_ENQUEUE_KERNEL(keccak, NULL);
-		CL_ENQUEUE_KERNEL(luffa, NULL);
-		CL_ENQUEUE_KERNEL(cubehash, NULL);
-		CL_ENQUEUE_KERNEL(shavite, NULL);
-		CL_ENQUEUE_KERNEL(simd, NULL)
-		CL_ENQUEUE_KERNEL(echo, NULL);
-		CL_ENQUEUE_KERNEL(hamsi, NULL);
-		CL_ENQUEUE_KERNEL(fugue, NULL);
-            }
-	}
-	else if (clState->chosen_kernel == KL_X13MODOLD) {
-	    if (clState->goffset) {
+	if (clState->nstages) {
 		size_t global_work_offset[1];
-		global_work_offset[0] = work->blk.nonce;
-
-		CL_ENQUEUE_KERNEL(blake, global_work_offset);
-		CL_ENQUEUE_KERNEL(bmw, global_work_offset);
-		CL_ENQUEUE_KERNEL(groestl, global_work_offset);
-		CL_ENQUEUE_KERNEL(skein, global_work_offset);
-		CL_ENQUEUE_KERNEL(jh, global_work_offset);
-		CL_ENQUEUE_KERNEL(keccak, global_work_offset);
-		CL_ENQUEUE_KERNEL(luffa, global_work_offset);
-		CL_ENQUEUE_KERNEL(cubehash, global_work_offset);
-		CL_ENQUEUE_KERNEL(shavite, global_work_offset);
-		CL_ENQUEUE_KERNEL(simd, global_work_offset)
-		CL_ENQUEUE_KERNEL(echo_hamsi_fugue, global_work_offset);
+		unsigned int b, i;
+
+		/* One pass of the stages per block of nonces, all through
+		 * the same hash buffer */
+		for (b = 0; b < clState->npt; b++) {
+			global_work_offset[0] = work->blk.nonce + b * globalThreads[0];
+			record = profiling && !b;
+
+			for (i = 0; i < clState->nstages; i++) {
+				const char *stage = clState->algorithm->stages[i];
+
+				status = clEnqueueNDRangeKernel(clState->commandQueue, clState->stage[i], 1,
+								clState->goffset ? global_work_offset : NULL,
+								globalThreads, localThreads, 0, NULL, KERNEL_EVENT(stage));
+				if (unlikely(status != CL_SUCCESS)) {
+					applog(LOG_ERR, "Error %d: Enqueueing kernel %s onto command queue. (clEnqueueNDRangeKernel)", status, stage);
+					return -1;
+				}
+			}
+		}
+	}
+	else if (nqueues > 1) {
+	    /* Interleave disjoint nonce ranges of the same work over the
+	     * queues, each writing to its own output buffer. Arguments are
+	     * captured at enqueue so the kernel object is shared. */
+	    size_t global_work_offset[1], subThreads[1];
+	    size_t sub = globalThreads[0] / nqueues;
+
+	    sub -= sub % localThreads[0];
+	    for (q = 0; q < nqueues; q++) {
+		global_work_offset[0] = work->blk.nonce + q * sub * clState->vwidth * clState->npt;
+		subThreads[0] = q < nqueues - 1 ? sub : globalThreads[0] - q * sub;
+		status = clSetKernelArg(*kernel, 1, sizeof(cl_mem), (void *)&clState->output[q]);
+		status |= clEnqueueNDRangeKernel(clState->queue[q], *kernel, 1, global_work_offset,
+						 subThreads, localThreads, 0, NULL, KERNEL_EVENT(queue_stage_names[q]));
+		if (unlikely(status != CL_SUCCESS)) {
+			applog(LOG_ERR, "Error %d: Enqueueing kernel onto command queue %u. (clEnqueueNDRangeKernel)", status, q);
+			return -1;
+		}
+		clFlush(clState->queue[q]);
 	    }
-	    else {
-		CL_ENQUEUE_KERNEL(blake, NULL);
-		CL_ENQUEUE_KERNEL(bmw, NULL);
-		CL_ENQUEUE_KERNEL(groestl, NULL);
-		CL_ENQUEUE_KERNEL(skein, NULL);
-		CL_ENQUEUE_KERNEL(jh, NULL);
-		CL_ENQUEUE_KERNEL(keccak, NULL);
-		CL_ENQUEUE_KERNEL(luffa, NULL);
-		CL_ENQUEUE_KERNEL(cubehash, NULL);
-		CL_ENQUEUE_KERNEL(shavite, NULL);
-		CL_ENQUEUE_KERNEL(simd, NULL)
-		CL_ENQUEUE_KERNEL(echo_hamsi_fugue, NULL);
-            }
 	}
 	else {
 	    if (clState->goffset) {
@@ -1934,45 +1986,145 @@ static int64_t opencl_scanhash(struct thr_info *thr, struct work *work,
 
 		global_work_offset[0] = work->blk.nonce;
 		status = clEnqueueNDRangeKernel(clState->commandQueue, *kernel, 1, global_work_offset,
-						globalThreads, localThreads, 0,  NULL, NULL);
+						globalThreads, localThreads, 0,  NULL, KERNEL_EVENT("search"));
 	    } else
 		status = clEnqueueNDRangeKernel(clState->commandQueue, *kernel, 1, NULL,
-						globalThreads, localThreads, 0,  NULL, NULL);
+						globalThreads, localThreads, 0,  NULL, KERNEL_EVENT("search"));
 	    if (unlikely(status != CL_SUCCESS)) {
 		applog(LOG_ERR, "Error %d: Enqueueing kernel onto command queue. (clEnqueueNDRangeKernel)", status);
 		return -1;
 	    }
 	}
 
-	status = clEnqueueReadBuffer(clState->commandQueue, clState->outputBuffer, CL_FALSE, 0,
-				     buffersize, thrdata->res, 0, NULL, NULL);
-	if (unlikely(status != CL_SUCCESS)) {
-		applog(LOG_ERR, "Error: clEnqueueReadBuffer failed error %d. (clEnqueueReadBuffer)", status);
-		return -1;
+	/* Only the result counters come back every scan */
+	for (q = 0; q < nqueues; q++) {
+		status = clEnqueueReadBuffer(clState->queue[q], clState->output[q], CL_FALSE, found * sizeof(uint32_t),
+					     sizeof(uint32_t), &thrdata->res[q * stride + found], 0, NULL,
+					     profile && !q ? &read_event : NULL);
+		if (unlikely(status != CL_SUCCESS)) {
+			applog(LOG_ERR, "Error: clEnqueueReadBuffer failed error %d. (clEnqueueReadBuffer)", status);
+			return -1;
+		}
+		clFlush(clState->queue[q]);
 	}
 
 	/* The amount of work scanned can fluctuate when intensity changes
 	 * and since we do this one cycle behind, we increment the work more
-	 * than enough to prevent repeating work */
-	work->blk.nonce += gpu->max_hashes;
+	 * than enough to prevent repeating work. A rescan has to cover its
+	 * range exactly. */
+	if (rescan)
+		work->blk.nonce += hashes;
+	else
+		work->blk.nonce += gpu->max_hashes;
 
 	/* This finish flushes the readbuffer set with CL_FALSE in clEnqueueReadBuffer */
-	clFinish(clState->commandQueue);
+	if (profile)
+		cgtime(&tv_start);
+	for (q = 0; q < nqueues; q++)
+		clFinish(clState->queue[q]);
+	if (profile) {
+		cgtime(&tv_done);
+		host_us[PROFILE_FINISH] = us_tdiff(&tv_done, &tv_start);
+	}
+
+	if (profiling) {
+		double total_us = kernel_events_us(kevents, nkevents, profile ? kernel_us : NULL);
+
+		if (profile && total_us >= 0) {
+			host_us[PROFILE_READBACK] = kernel_events_us(&read_event, 1, NULL);
+			read_event = NULL;
+			profile_record(profile, knames, kernel_us, nkevents, host_us);
+		}
+		/* Event timestamps are the kernels alone, wall time is the
+		 * fallback when they can't be read. Kernels on several queues
+		 * overlap so their sum isn't the launch time either, and only
+		 * the first of several blocks of staged kernels is timed. */
+		if (dynamic && (total_us < 0 || nqueues > 1 || (clState->npt > 1 && clState->hash_buffer))) {
+			cgtime(&tv_done);
+			total_us = us_tdiff(&tv_done, &tv_launch);
+		}
+		/* The cut down launches of a rescan say nothing of intensity */
+		if (dynamic && !rescan)
+			dynamic_intensity_update(gpu, total_us, headless);
+	} else if (dynamic && !rescan) {
+		cgtime(&tv_done);
+		dynamic_intensity_update(gpu, us_tdiff(&tv_done, &tv_launch), headless);
+	}
+	if (read_event)
+		clReleaseEvent(read_event);
+
+	/* The counter keeps counting past the last slot, so a count above
+	 * found means nonces were dropped. Throw the launch away and scan
+	 * its range again in launches small enough to report everything,
+	 * unless it can't be cut any further. */
+	for (q = 0; q < nqueues; q++) {
+		if (thrdata->res[q * stride + found] > overflow)
+			overflow = thrdata->res[q * stride + found];
+	}
+	if (overflow > found && globalThreads[0] > localThreads[0]) {
+		applog(LOG_INFO, "GPU %d: %u results overflowed %u slots, rescanning", gpu->device_id, overflow, found);
+		for (q = 0; q < nqueues; q++) {
+			status = reset_found(clState, q);
+			if (unlikely(status != CL_SUCCESS)) {
+				applog(LOG_ERR, "Error %d: Resetting the result counter.", status);
+				return -1;
+			}
+			thrdata->res[q * stride + found] = 0;
+			clFinish(clState->queue[q]);
+		}
+		if (!rescan) {
+			thrdata->split = 1;
+			thrdata->split_id = work->id;
+			thrdata->split_end = first_nonce + hashes;
+		}
+		thrdata->split *= 2 * (overflow / found + 1);
+		work->blk.nonce = first_nonce;
+		return 0;
+	}
+	if (overflow > found)
+		applog(LOG_WARNING, "GPU %d: %u results overflowed %u slots, increase --result-slots",
+		       gpu->device_id, overflow, found);
+
+	for (q = 0; q < nqueues; q++) {
+		uint32_t *res = thrdata->res + q * stride;
+		unsigned int entries;
+
+		/* The word after the slots counts how many nonces exist */
+		if (!res[found])
+			continue;
 
-	/* FOUND entry is used as a counter to say how many nonces exist */
-	if (thrdata->res[found]) {
-		/* Clear the buffer again */
-		status = clEnqueueWriteBuffer(clState->commandQueue, clState->outputBuffer, CL_FALSE, 0,
-					      buffersize, blank_res, 0, NULL, NULL);
+		/* Read just the filled entries */
+		entries = res[found] < found ? res[found] : found;
+		if (entries) {
+			status = clEnqueueReadBuffer(clState->queue[q], clState->output[q], CL_TRUE, 0,
+						     entries * sizeof(uint32_t), res, 0, NULL, NULL);
+			if (unlikely(status != CL_SUCCESS)) {
+				applog(LOG_ERR, "Error: clEnqueueReadBuffer failed error %d. (clEnqueueReadBuffer)", status);
+				return -1;
+			}
+			if (clState->hashout) {
+				status = clEnqueueReadBuffer(clState->queue[q], clState->output[q], CL_TRUE,
+							     (found + 1) * sizeof(uint32_t), entries * 32,
+							     res + found + 1, 0, NULL, NULL);
+				if (unlikely(status != CL_SUCCESS)) {
+					applog(LOG_ERR, "Error: clEnqueueReadBuffer failed error %d. (clEnqueueReadBuffer)", status);
+					return -1;
+				}
+			}
+		}
+
+		/* The kernels only ever append at the counter, so resetting it
+		 * clears the buffer */
+		status = reset_found(clState, q);
 		if (unlikely(status != CL_SUCCESS)) {
-			applog(LOG_ERR, "Error: clEnqueueWriteBuffer failed.");
+			applog(LOG_ERR, "Error %d: Resetting the result counter.", status);
 			return -1;
 		}
 		applog(LOG_DEBUG, "GPU %d found something?", gpu->device_id);
-		postcalc_hash_async(thr, work, thrdata->res);
-		memset(thrdata->res, 0, buffersize);
-		/* This finish flushes the writebuffer set with CL_FALSE in clEnqueueWriteBuffer */
-		clFinish(clState->commandQueue);
+		postcalc_hash_async(thr, work, res, entries, clState->hashout ? res + found + 1 : NULL);
+		res[found] = 0;
+		/* This finish flushes the reset set with CL_FALSE */
+		clFinish(clState->queue[q]);
 	}
 
 	return hashes;
@@ -1981,56 +2133,45 @@ static int64_t opencl_scanhash(struct thr_info *thr, struct work *work,
 static void opencl_thread_shutdown(struct thr_info *thr)
 {
 	const int thr_id = thr->id;
+	struct opencl_thread_data *thrdata = thr->cgpu_data;
 	_clState *clState = clStates[thr_id];
+	unsigned int i;
 
-	if (clState->chosen_kernel == KL_X11MOD) {
-	    clReleaseKernel(clState->kernel_blake);
-	    clReleaseKernel(clState->kernel_bmw);
-	    clReleaseKernel(clState->kernel_groestl);
-	    clReleaseKernel(clState->kernel_skein);
-	    clReleaseKernel(clState->kernel_jh);
-	    clReleaseKernel(clState->kernel_keccak);
-	    clReleaseKernel(clState->kernel_luffa);
-	    clReleaseKernel(clState->kernel_cubehash);
-	    clReleaseKernel(clState->kernel_shavite);
-	    clReleaseKernel(clState->kernel_simd);
-	    clReleaseKernel(clState->kernel_echo);
-	}
-	else if (clState->chosen_kernel == KL_X13MOD) {
-	    clReleaseKernel(clState->kernel_blake);
-	    clReleaseKernel(clState->kernel_bmw);
-	    clReleaseKernel(clState->kernel_groestl);
-	    clReleaseKernel(clState->kernel_skein);
-	    clReleaseKernel(clState->kernel_jh);
-	    clReleaseKernel(clState->kernel_keccak);
-	    clReleaseKernel(clState->kernel_luffa);
-	    clReleaseKernel(clState->kernel_cubehash);
-	    clReleaseKernel(clState->kernel_shavite);
-	    clReleaseKernel(clState->kernel_simd);
-	    clReleaseKernel(clState->kernel_echo);
-	    clReleaseKernel(clState->kernel_hamsi);
-	    clReleaseKernel(clState->kernel_fugue);
-	}
-	else if (clState->chosen_kernel == KL_X13MOD) {
-	    clReleaseKernel(clState->kernel_blake);
-	    clReleaseKernel(clState->kernel_bmw);
-	    clReleaseKernel(clState->kernel_groestl);
-	    clReleaseKernel(clState->kernel_skein);
-	    clReleaseKernel(clState->kernel_jh);
-	    clReleaseKernel(clState->kernel_keccak);
-	    clReleaseKernel(clState->kernel_luffa);
-	    clReleaseKernel(clState->kernel_cubehash);
-	    clReleaseKernel(clState->kernel_shavite);
-	    clReleaseKernel(clState->kernel_simd);
-	    clReleaseKernel(clState->kernel_echo_hamsi_fugue);
-	}
-	else {
-	    clReleaseKernel(clState->kernel);
+	if (clState->nstages) {
+		for (i = 0; i < clState->nstages; i++)
+			clReleaseKernel(clState->stage[i]);
+	} else
+		clReleaseKernel(clState->kernel);
+
+	/* Buffers hold a reference on the context, drop them first so the
+	 * device memory is actually freed when the context goes */
+	if (clState->padbuffer8)
+		clReleaseMemObject(clState->padbuffer8);
+	if (clState->hash_buffer)
+		clReleaseMemObject(clState->hash_buffer);
+	clReleaseMemObject(clState->CLbuffer0);
+	for (i = 0; i < clState->nqueues; i++)
+		clReleaseMemObject(clState->output[i]);
+	if (clState->outputPinned) {
+		clEnqueueUnmapMemObject(clState->commandQueue, clState->outputPinned, clState->outputMap, 0, NULL, NULL);
+		clFinish(clState->commandQueue);
+		clReleaseMemObject(clState->outputPinned);
 	}
 
 	clReleaseProgram(clState->program);
-	clReleaseCommandQueue(clState->commandQueue);
+	for (i = 0; i < clState->nqueues; i++)
+		clReleaseCommandQueue(clState->queue[i]);
 	clReleaseContext(clState->context);
+
+	if (thrdata) {
+		mutex_lock(&profile_lock);
+		thr->cgpu_data = NULL;
+		mutex_unlock(&profile_lock);
+		free(thrdata->profile);
+		if (thrdata->res != clState->outputMap)
+			free(thrdata->res);
+		free(thrdata);
+	}
 }
 
 struct device_drv opencl_drv = {
@@ -2048,4 +2189,5 @@ struct device_drv opencl_drv = {
 	.prepare_work = opencl_prepare_work,
 	.scanhash = opencl_scanhash,
 	.thread_shutdown = opencl_thread_shutdown,
+	.get_api_profile = opencl_api_profile,
 };
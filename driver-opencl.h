@@ -21,6 +21,7 @@ extern char *set_xintensity(char *arg);
 extern char *set_rawintensity(char *arg);
 extern char *set_vector(char *arg);
 extern char *set_worksize(char *arg);
+extern char *set_nonces_per_thread(char *arg);
 extern char *set_shaders(char *arg);
 extern char *set_lookup_gap(char *arg);
 extern char *set_thread_concurrency(char *arg);
@@ -30,6 +31,17 @@ extern void pause_dynamic_threads(int gpu);
 
 extern int opt_platform_id;
 
+/* OpenCL device types to mine on */
+enum cl_device_select {
+	CL_SELECT_GPU,
+	CL_SELECT_CPU,
+	CL_SELECT_ALL
+};
+
+extern enum cl_device_select opt_cl_device_type;
+extern const char *cl_device_select_names[];
+extern char *set_cl_device_type(char *arg);
+
 extern struct device_drv opencl_drv;
 
 #endif /* __DEVICE_GPU_H__ */
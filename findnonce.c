@@ -173,37 +173,21 @@ void precalc_hash(dev_blk_ctx *blk, uint32_t *state, uint32_t *data)
 struct pc_data {
 	struct thr_info *thr;
 	struct work *work;
-	uint32_t res[MAXBUFFERS];
 	pthread_t pth;
-	int found;
+	unsigned int entries;
+	bool hashes;
+	/* entries nonces, then their hashes if the kernel reported them */
+	uint32_t res[];
 };
 
 static void *postcalc_hash(void *userdata)
 {
 	struct pc_data *pcd = (struct pc_data *)userdata;
-	struct thr_info *thr = pcd->thr;
-	unsigned int entry = 0;
-
-	int found = FOUND;
 
 	pthread_detach(pthread_self());
 
-	/* To prevent corrupt values in FOUND from trying to read beyond the
-	 * end of the res[] array */
-	if (unlikely(pcd->res[found] & ~found)) {
-		applog(LOG_WARNING, "%s%d: invalid nonce count - HW error",
-				thr->cgpu->drv->name, thr->cgpu->device_id);
-		hw_errors++;
-		thr->cgpu->hw_errors++;
-		pcd->res[found] &= found;
-	}
-
-	for (entry = 0; entry < pcd->res[found]; entry++) {
-		uint32_t nonce = pcd->res[entry];
-
-		applog(LOG_DEBUG, "OCL NONCE %u found in slot %d", nonce, entry);
-		submit_nonce(thr, pcd->work, nonce);
-	}
+	submit_nonces(pcd->thr, pcd->work, pcd->res, pcd->entries,
+		      pcd->hashes ? (unsigned char *)(pcd->res + pcd->entries) : NULL);
 
 	discard_work(pcd->work);
 	free(pcd);
@@ -211,10 +195,13 @@ static void *postcalc_hash(void *userdata)
 	return NULL;
 }
 
-void postcalc_hash_async(struct thr_info *thr, struct work *work, uint32_t *res)
+/* Submit the first entries nonces of res from a thread of their own, with
+ * the 8 word hash of each from hashes when the kernel checked them */
+void postcalc_hash_async(struct thr_info *thr, struct work *work, uint32_t *res, unsigned int entries,
+			 uint32_t *hashes)
 {
-	struct pc_data *pcd = malloc(sizeof(struct pc_data));
-	int buffersize;
+	size_t words = hashes ? entries * 9 : entries;
+	struct pc_data *pcd = malloc(sizeof(struct pc_data) + words * sizeof(uint32_t));
 
 	if (unlikely(!pcd)) {
 		applog(LOG_ERR, "Failed to malloc pc_data in postcalc_hash_async");
@@ -223,9 +210,11 @@ void postcalc_hash_async(struct thr_info *thr, struct work *work, uint32_t *res)
 
 	pcd->thr = thr;
 	pcd->work = copy_work(work);
-	buffersize = BUFFERSIZE;
-
-	memcpy(&pcd->res, res, buffersize);
+	pcd->entries = entries;
+	pcd->hashes = !!hashes;
+	memcpy(pcd->res, res, entries * sizeof(uint32_t));
+	if (hashes)
+		memcpy(pcd->res + entries, hashes, entries * 32);
 
 	if (pthread_create(&pcd->pth, NULL, postcalc_hash, (void *)pcd)) {
 		applog(LOG_ERR, "Failed to create postcalc_hash thread");
@@ -5,12 +5,12 @@
 
 #define MAXTHREADS (0xFFFFFFFEULL)
 
-#define MAXBUFFERS (0x100)
-#define BUFFERSIZE (sizeof(uint32_t) * MAXBUFFERS)
+/* Default number of result slots, the word after them counts the hits */
 #define FOUND (0xFF)
 
 #define THASHBUFSIZE (8 * 16 * 4194304)
 
 extern void precalc_hash(dev_blk_ctx *blk, uint32_t *state, uint32_t *data);
-extern void postcalc_hash_async(struct thr_info *thr, struct work *work, uint32_t *res);
+extern void postcalc_hash_async(struct thr_info *thr, struct work *work, uint32_t *res, unsigned int entries,
+				uint32_t *hashes);
 #endif /*__FINDNONCE_H__*/
@@ -366,6 +366,60 @@ __constant static const sph_u64 BLAKE_IV512[8] = {
 		H7 ^= S3 ^ V7 ^ VF; \
 	} while (0)
 
+/*
+ * COMPRESS64 for an 80-byte block header, starting from "pre": V0-VF as the
+ * host left them after the column step of round 0 and the half of the next
+ * G that only uses M8. Everything up to there is the same for every nonce.
+ */
+#define COMPRESS64_PRE(pre)   do { \
+		V0 = (pre).s0; \
+		V1 = (pre).s1; \
+		V2 = (pre).s2; \
+		V3 = (pre).s3; \
+		V4 = (pre).s4; \
+		V5 = (pre).s5; \
+		V6 = (pre).s6; \
+		V7 = (pre).s7; \
+		V8 = (pre).s8; \
+		V9 = (pre).s9; \
+		VA = (pre).sa; \
+		VB = (pre).sb; \
+		VC = (pre).sc; \
+		VD = (pre).sd; \
+		VE = (pre).se; \
+		VF = (pre).sf; \
+		V0 = SPH_T64(V0 + V5 + (M9 ^ CB8)); \
+		VF = SPH_ROTR64(VF ^ V0, 16); \
+		VA = SPH_T64(VA + VF); \
+		V5 = SPH_ROTR64(V5 ^ VA, 11); \
+		GB(MA, MB, CBA, CBB, V1, V6, VB, VC); \
+		GB(MC, MD, CBC, CBD, V2, V7, V8, VD); \
+		GB(ME, MF, CBE, CBF, V3, V4, V9, VE); \
+		ROUND_B(1); \
+		ROUND_B(2); \
+		ROUND_B(3); \
+		ROUND_B(4); \
+		ROUND_B(5); \
+		ROUND_B(6); \
+		ROUND_B(7); \
+		ROUND_B(8); \
+		ROUND_B(9); \
+		ROUND_B(0); \
+		ROUND_B(1); \
+		ROUND_B(2); \
+		ROUND_B(3); \
+		ROUND_B(4); \
+		ROUND_B(5); \
+		H0 ^= S0 ^ V0 ^ V8; \
+		H1 ^= S1 ^ V1 ^ V9; \
+		H2 ^= S2 ^ V2 ^ VA; \
+		H3 ^= S3 ^ V3 ^ VB; \
+		H4 ^= S0 ^ V4 ^ VC; \
+		H5 ^= S1 ^ V5 ^ VD; \
+		H6 ^= S2 ^ V6 ^ VE; \
+		H7 ^= S3 ^ V7 ^ VF; \
+	} while (0)
+
 #endif
 
 __constant static const sph_u64 salt_zero_big[4] = { 0, 0, 0, 0 };
@@ -0,0 +1,7 @@
+/* Tail of the generated search kernels, the hash in memory order, see
+ * chain.cl. */
+    if (hash.h8[3] <= target)
+        SETFOUND_HASH(SWAP4(gid), hash.h8[0], hash.h8[1], hash.h8[2], hash.h8[3]);
+    }
+    }
+}
@@ -0,0 +1,187 @@
+/*
+ * Head of the search kernels chain_kernel_source() in chain.c generates
+ * from an algorithm chain. The generated source is
+ *
+ *   #include "chain.cl"
+ *   {
+ *   #include "chain-blake512-80.cl"
+ *   }
+ *   HASH_SWAP8
+ *   {
+ *   #include "chain-shavite512.cl"
+ *   }
+ *   ...
+ *   #include "chain-end.cl"
+ *
+ * with one chain-<hash>.cl block per hash of the chain, so this file leaves
+ * the kernel open inside its nonce loops and chain-end.cl closes it. Each
+ * block hashes the 64 bytes of the "hash" union in place, taking and leaving
+ * them in the byte order its header and chain_funcs name: memory order, where
+ * hash.h1 holds the bytes sph hashes, or every word of hash.h8 or hash.h4
+ * byte swapped. The generator puts the swaps between blocks, and a quark
+ * style branch tests bit 3 of hash.h1[0] in memory order.
+ *
+ * The blocks are marucoin.cl's, blake of the 64 byte hash quarkcoin.cl's,
+ * and the nonce loops darkcoin.cl's.
+ *
+ * ==========================(LICENSE BEGIN)============================
+ *
+ * Copyright (c) 2014  phm
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ===========================(LICENSE END)=============================
+ *
+ * @author   phm <phm@inbox.com>
+ */
+
+#if __ENDIAN_LITTLE__
+#define SPH_LITTLE_ENDIAN 1
+#else
+#define SPH_BIG_ENDIAN 1
+#endif
+
+#define SPH_UPTR sph_u64
+
+typedef unsigned int sph_u32;
+typedef int sph_s32;
+#ifndef __OPENCL_VERSION__
+typedef unsigned long long sph_u64;
+typedef long long sph_s64;
+#else
+typedef unsigned long sph_u64;
+typedef long sph_s64;
+#endif
+
+#define SPH_64 1
+#define SPH_64_TRUE 1
+
+#define SPH_C32(x)    ((sph_u32)(x ## U))
+#define SPH_T32(x)    ((x) & SPH_C32(0xFFFFFFFF))
+#define SPH_ROTL32(x, n)   SPH_T32(((x) << (n)) | ((x) >> (32 - (n))))
+#define SPH_ROTR32(x, n)   SPH_ROTL32(x, (32 - (n)))
+
+#define SPH_C64(x)    ((sph_u64)(x ## UL))
+#define SPH_T64(x)    ((x) & SPH_C64(0xFFFFFFFFFFFFFFFF))
+#define SPH_ROTL64(x, n)   SPH_T64(((x) << (n)) | ((x) >> (64 - (n))))
+#define SPH_ROTR64(x, n)   SPH_ROTL64(x, (64 - (n)))
+
+#define SPH_ECHO_64 1
+#define SPH_KECCAK_64 1
+#define SPH_JH_64 1
+#define SPH_SIMD_NOCOPY 0
+#define SPH_KECCAK_NOCOPY 0
+#define SPH_COMPACT_BLAKE_64 0
+#define SPH_LUFFA_PARALLEL 0
+#define SPH_SMALL_FOOTPRINT_GROESTL 0
+#define SPH_GROESTL_BIG_ENDIAN 0
+#define SPH_CUBEHASH_UNROLL 0
+#define SPH_KECCAK_UNROLL   0
+#define SPH_HAMSI_EXPAND_BIG 1
+
+#include "blake.cl"
+#include "bmw.cl"
+#include "groestl.cl"
+#include "jh.cl"
+#include "keccak.cl"
+#include "skein.cl"
+#include "luffa.cl"
+#include "cubehash.cl"
+#include "shavite.cl"
+#include "simd.cl"
+#include "echo.cl"
+#include "hamsi.cl"
+#include "fugue.cl"
+
+#ifndef NONCES_PER_THREAD
+#define NONCES_PER_THREAD 1
+#endif
+#ifndef VECTORS
+#define VECTORS 1
+#endif
+
+#define SWAP4(x) as_uint(as_uchar4(x).wzyx)
+#define SWAP8(x) as_ulong(as_uchar8(x).s76543210)
+
+/* Between two hashes, from or to memory order (see chain.c) */
+#define HASH_SWAP8 for (int i = 0; i < 8; i++) hash.h8[i] = SWAP8(hash.h8[i]);
+#define HASH_SWAP4 for (int i = 0; i < 16; i++) hash.h4[i] = SWAP4(hash.h4[i]);
+
+#ifndef FOUND
+#define FOUND (0xFF)
+#endif
+/* Slots past FOUND are dropped, the host sees the count above FOUND */
+#define SETFOUND(Xnonce) { uint slot = atomic_inc(output + FOUND); if (slot < FOUND) output[slot] = Xnonce; }
+#ifdef HASHOUT
+/* Exact check against the 256 bit target the host puts after the header,
+ * every slot gets its hash in 8 words after the count */
+#define SETFOUND_HASH(Xnonce, H0, H1, H2, H3) { \
+    __global const ulong *t = (__global const ulong *)(block + 80); \
+    ulong h0 = (H0), h1 = (H1), h2 = (H2), h3 = (H3); \
+    if (h3 < t[3] || (h3 == t[3] && (h2 < t[2] || (h2 == t[2] && (h1 < t[1] || (h1 == t[1] && h0 <= t[0])))))) { \
+        uint slot = atomic_inc(output + FOUND); \
+        if (slot < FOUND) { \
+            volatile __global uint *h = output + FOUND + 1 + slot * 8; \
+            output[slot] = Xnonce; \
+            h[0] = (uint)h0; h[1] = (uint)(h0 >> 32); h[2] = (uint)h1; h[3] = (uint)(h1 >> 32); \
+            h[4] = (uint)h2; h[5] = (uint)(h2 >> 32); h[6] = (uint)h3; h[7] = (uint)(h3 >> 32); \
+        } \
+    } \
+}
+#else
+#define SETFOUND_HASH(Xnonce, H0, H1, H2, H3) SETFOUND(Xnonce)
+#endif
+
+#if SPH_BIG_ENDIAN
+    #define DEC64E(x) (x)
+    #define DEC64BE(x) (*(const __global sph_u64 *) (x));
+#else
+    #define DEC64E(x) SWAP8(x)
+    #define DEC64BE(x) SWAP8(*(const __global sph_u64 *) (x));
+#endif
+
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
+__kernel void search(__global unsigned char* block, volatile __global uint* output, const ulong target)
+{
+    // each work item hashes NONCES_PER_THREAD * VECTORS consecutive nonces
+    uint first = get_global_offset(0) + (get_global_id(0) - get_global_offset(0)) * NONCES_PER_THREAD * VECTORS;
+    union {
+        unsigned char h1[64];
+        uint h4[16];
+        ulong h8[8];
+    } hash;
+
+    __local sph_u32 AES0[256], AES1[256], AES2[256], AES3[256];
+    int init = get_local_id(0);
+    int step = get_local_size(0);
+    for (int i = init; i < 256; i += step)
+    {
+        AES0[i] = AES0_C[i];
+        AES1[i] = AES1_C[i];
+        AES2[i] = AES2_C[i];
+        AES3[i] = AES3_C[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint n = 0; n < NONCES_PER_THREAD; n++) {
+    // unrolled so the compiler can pack independent nonces
+    #pragma unroll
+    for (uint v = 0; v < VECTORS; v++) {
+    uint gid = first + n * VECTORS + v;
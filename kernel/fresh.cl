@@ -70,9 +70,41 @@ typedef long sph_s64;
 #include "simd.cl"
 #include "echo.cl"
 
+#ifndef NONCES_PER_THREAD
+#define NONCES_PER_THREAD 1
+#endif
+#ifndef VECTORS
+#define VECTORS 1
+#endif
+
 #define SWAP4(x) as_uint(as_uchar4(x).wzyx)
 #define SWAP8(x) as_ulong(as_uchar8(x).s76543210)
 
+#ifndef FOUND
+#define FOUND (0xFF)
+#endif
+/* Slots past FOUND are dropped, the host sees the count above FOUND */
+#define SETFOUND(Xnonce) { uint slot = atomic_inc(output + FOUND); if (slot < FOUND) output[slot] = Xnonce; }
+#ifdef HASHOUT
+/* Exact check against the 256 bit target the host puts after the header,
+ * every slot gets its hash in 8 words after the count */
+#define SETFOUND_HASH(Xnonce, H0, H1, H2, H3) { \
+    __global const ulong *t = (__global const ulong *)(block + 80); \
+    ulong h0 = (H0), h1 = (H1), h2 = (H2), h3 = (H3); \
+    if (h3 < t[3] || (h3 == t[3] && (h2 < t[2] || (h2 == t[2] && (h1 < t[1] || (h1 == t[1] && h0 <= t[0])))))) { \
+        uint slot = atomic_inc(output + FOUND); \
+        if (slot < FOUND) { \
+            volatile __global uint *h = output + FOUND + 1 + slot * 8; \
+            output[slot] = Xnonce; \
+            h[0] = (uint)h0; h[1] = (uint)(h0 >> 32); h[2] = (uint)h1; h[3] = (uint)(h1 >> 32); \
+            h[4] = (uint)h2; h[5] = (uint)(h2 >> 32); h[6] = (uint)h3; h[7] = (uint)(h3 >> 32); \
+        } \
+    } \
+}
+#else
+#define SETFOUND_HASH(Xnonce, H0, H1, H2, H3) SETFOUND(Xnonce)
+#endif
+
 #if SPH_BIG_ENDIAN
 #define DEC64E(x) (x)
 #define DEC64BE(x) (*(const __global sph_u64 *) (x));
@@ -84,9 +116,10 @@ typedef long sph_s64;
 #endif
 
 __attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
-__kernel void search(__global unsigned char* block, volatile __global uint* output, const ulong target)
+__kernel void search(__global unsigned char* block, volatile __global uint* output, const ulong target, const uint16 shavite_rk, const uint8 shavite_p)
 {
-    uint gid = get_global_id(0);
+    // each work item hashes NONCES_PER_THREAD * VECTORS consecutive nonces
+    uint first = get_global_offset(0) + (get_global_id(0) - get_global_offset(0)) * NONCES_PER_THREAD * VECTORS;
     union {
         unsigned char h1[64];
         uint h4[16];
@@ -105,6 +138,12 @@ __kernel void search(__global unsigned char* block, volatile __global uint* outp
     }
     barrier(CLK_LOCAL_MEM_FENCE);
 
+    for (uint n = 0; n < NONCES_PER_THREAD; n++) {
+    // unrolled so the compiler can pack independent nonces
+    #pragma unroll
+    for (uint v = 0; v < VECTORS; v++) {
+    uint gid = first + n * VECTORS + v;
+
     // shavite
     {
         // IV
@@ -121,22 +160,23 @@ __kernel void search(__global unsigned char* block, volatile __global uint* outp
 
     sph_u32 sc_count0 = (80 << 3), sc_count1 = 0, sc_count2 = 0, sc_count3 = 0;
 
-    rk00 = DEC32LE(block + 0 * 4);;
-    rk01 = DEC32LE(block + 1 * 4);;
-    rk02 = DEC32LE(block + 2 * 4);;
-    rk03 = DEC32LE(block + 3 * 4);;
-    rk04 = DEC32LE(block + 4 * 4);;
-    rk05 = DEC32LE(block + 5 * 4);;
-    rk06 = DEC32LE(block + 6 * 4);;
-    rk07 = DEC32LE(block + 7 * 4);;
-    rk08 = DEC32LE(block + 8 * 4);;
-    rk09 = DEC32LE(block + 9 * 4);;
-    rk0A = DEC32LE(block + 10 * 4);;
-    rk0B = DEC32LE(block + 11 * 4);;
-    rk0C = DEC32LE(block + 12 * 4);;
-    rk0D = DEC32LE(block + 13 * 4);;
-    rk0E = DEC32LE(block + 14 * 4);;
-    rk0F = DEC32LE(block + 15 * 4);;
+    // rounds 0 and 1 start from host-computed state, see c512_pre()
+    rk00 = shavite_rk.s0;
+    rk01 = shavite_rk.s1;
+    rk02 = shavite_rk.s2;
+    rk03 = shavite_rk.s3;
+    rk04 = shavite_rk.s4;
+    rk05 = shavite_rk.s5;
+    rk06 = shavite_rk.s6;
+    rk07 = shavite_rk.s7;
+    rk08 = shavite_rk.s8;
+    rk09 = shavite_rk.s9;
+    rk0A = shavite_rk.sa;
+    rk0B = shavite_rk.sb;
+    rk0C = shavite_rk.sc;
+    rk0D = shavite_rk.sd;
+    rk0E = shavite_rk.se;
+    rk0F = shavite_rk.sf;
     rk10 = DEC32LE(block + 16 * 4);;
     rk11 = DEC32LE(block + 17 * 4);;
     rk12 = DEC32LE(block + 18 * 4);;
@@ -147,7 +187,7 @@ __kernel void search(__global unsigned char* block, volatile __global uint* outp
     rk1C = rk1D = rk1E = 0;
     rk1F = 0x2000000;
 
-    c512(buf);
+    c512_pre(shavite_p);
 
     hash.h4[0] = h0;
     hash.h4[1] = h1;
@@ -514,7 +554,9 @@ __kernel void search(__global unsigned char* block, volatile __global uint* outp
 	
     bool result = (Vb11 <= target);
     if (result)
-        output[output[0xFF]++] = SWAP4(gid);
+        SETFOUND_HASH(SWAP4(gid), Vb00, Vb01, Vb10, Vb11);
+    }
+    }
 }
 
 #endif // FRESH_CL
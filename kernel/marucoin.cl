@@ -93,6 +93,31 @@ typedef long sph_s64;
 #define SWAP4(x) as_uint(as_uchar4(x).wzyx)
 #define SWAP8(x) as_ulong(as_uchar8(x).s76543210)
 
+#ifndef FOUND
+#define FOUND (0xFF)
+#endif
+/* Slots past FOUND are dropped, the host sees the count above FOUND */
+#define SETFOUND(Xnonce) { uint slot = atomic_inc(output + FOUND); if (slot < FOUND) output[slot] = Xnonce; }
+#ifdef HASHOUT
+/* Exact check against the 256 bit target the host puts after the header,
+ * every slot gets its hash in 8 words after the count */
+#define SETFOUND_HASH(Xnonce, H0, H1, H2, H3) { \
+    __global const ulong *t = (__global const ulong *)(block + 80); \
+    ulong h0 = (H0), h1 = (H1), h2 = (H2), h3 = (H3); \
+    if (h3 < t[3] || (h3 == t[3] && (h2 < t[2] || (h2 == t[2] && (h1 < t[1] || (h1 == t[1] && h0 <= t[0])))))) { \
+        uint slot = atomic_inc(output + FOUND); \
+        if (slot < FOUND) { \
+            volatile __global uint *h = output + FOUND + 1 + slot * 8; \
+            output[slot] = Xnonce; \
+            h[0] = (uint)h0; h[1] = (uint)(h0 >> 32); h[2] = (uint)h1; h[3] = (uint)(h1 >> 32); \
+            h[4] = (uint)h2; h[5] = (uint)(h2 >> 32); h[6] = (uint)h3; h[7] = (uint)(h3 >> 32); \
+        } \
+    } \
+}
+#else
+#define SETFOUND_HASH(Xnonce, H0, H1, H2, H3) SETFOUND(Xnonce)
+#endif
+
 #if SPH_BIG_ENDIAN
     #define DEC64E(x) (x)
     #define DEC64BE(x) (*(const __global sph_u64 *) (x));
@@ -102,7 +127,7 @@ typedef long sph_s64;
 #endif
 
 __attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
-__kernel void search(__global unsigned char* block, volatile __global uint* output, const ulong target)
+__kernel void search(__global unsigned char* block, volatile __global uint* output, const ulong target, const ulong16 blake_v)
 {
     uint gid = get_global_id(0);
     union {
@@ -159,7 +184,7 @@ __kernel void search(__global unsigned char* block, volatile __global uint* outp
     ME = 0;
     MF = 0x280;
 
-    COMPRESS64;
+    COMPRESS64_PRE(blake_v);
 
     hash.h8[0] = H0;
     hash.h8[1] = H1;
@@ -838,7 +863,7 @@ __kernel void search(__global unsigned char* block, volatile __global uint* outp
 
     bool result = (hash.h8[3] <= target);
     if (result)
-        output[output[0xFF]++] = SWAP4(gid);
+        SETFOUND_HASH(SWAP4(gid), hash.h8[0], hash.h8[1], hash.h8[2], hash.h8[3]);
 }
 
 #endif // MARUCOIN_CL
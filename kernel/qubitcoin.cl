@@ -77,6 +77,31 @@ typedef long sph_s64;
 #define SWAP4(x) as_uint(as_uchar4(x).wzyx)
 #define SWAP8(x) as_ulong(as_uchar8(x).s76543210)
 
+#ifndef FOUND
+#define FOUND (0xFF)
+#endif
+/* Slots past FOUND are dropped, the host sees the count above FOUND */
+#define SETFOUND(Xnonce) { uint slot = atomic_inc(output + FOUND); if (slot < FOUND) output[slot] = Xnonce; }
+#ifdef HASHOUT
+/* Exact check against the 256 bit target the host puts after the header,
+ * every slot gets its hash in 8 words after the count */
+#define SETFOUND_HASH(Xnonce, H0, H1, H2, H3) { \
+    __global const ulong *t = (__global const ulong *)(block + 80); \
+    ulong h0 = (H0), h1 = (H1), h2 = (H2), h3 = (H3); \
+    if (h3 < t[3] || (h3 == t[3] && (h2 < t[2] || (h2 == t[2] && (h1 < t[1] || (h1 == t[1] && h0 <= t[0])))))) { \
+        uint slot = atomic_inc(output + FOUND); \
+        if (slot < FOUND) { \
+            volatile __global uint *h = output + FOUND + 1 + slot * 8; \
+            output[slot] = Xnonce; \
+            h[0] = (uint)h0; h[1] = (uint)(h0 >> 32); h[2] = (uint)h1; h[3] = (uint)(h1 >> 32); \
+            h[4] = (uint)h2; h[5] = (uint)(h2 >> 32); h[6] = (uint)h3; h[7] = (uint)(h3 >> 32); \
+        } \
+    } \
+}
+#else
+#define SETFOUND_HASH(Xnonce, H0, H1, H2, H3) SETFOUND(Xnonce)
+#endif
+
 #if SPH_BIG_ENDIAN
     #define DEC64E(x) (x)
     #define DEC32BE(x) (*(const __global sph_u32 *) (x));
@@ -86,7 +111,7 @@ typedef long sph_s64;
 #endif
 
 __attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
-__kernel void search(__global unsigned char* block, volatile __global uint* output, const ulong target)
+__kernel void search(__global unsigned char* block, volatile __global uint* output, const ulong target, const uint16 luffa_v0, const uint16 luffa_v1, const uint8 luffa_v2)
 {
     uint gid = get_global_id(0);
     union {
@@ -107,47 +132,29 @@ __kernel void search(__global unsigned char* block, volatile __global uint* outp
     }
     barrier(CLK_LOCAL_MEM_FENCE);
 
-    // luffa
+    // luffa, the first two message blocks were absorbed on the host
 
-    sph_u32 V00 = SPH_C32(0x6d251e69), V01 = SPH_C32(0x44b051e0), V02 = SPH_C32(0x4eaa6fb4), V03 = SPH_C32(0xdbf78465), V04 = SPH_C32(0x6e292011), V05 = SPH_C32(0x90152df4), V06 = SPH_C32(0xee058139), V07 = SPH_C32(0xdef610bb);
-    sph_u32 V10 = SPH_C32(0xc3b44b95), V11 = SPH_C32(0xd9d2f256), V12 = SPH_C32(0x70eee9a0), V13 = SPH_C32(0xde099fa3), V14 = SPH_C32(0x5d9b0557), V15 = SPH_C32(0x8fc944b3), V16 = SPH_C32(0xcf1ccf0e), V17 = SPH_C32(0x746cd581);
-    sph_u32 V20 = SPH_C32(0xf7efc89d), V21 = SPH_C32(0x5dba5781), V22 = SPH_C32(0x04016ce5), V23 = SPH_C32(0xad659c05), V24 = SPH_C32(0x0306194f), V25 = SPH_C32(0x666d1836), V26 = SPH_C32(0x24aa230a), V27 = SPH_C32(0x8b264ae7);
-    sph_u32 V30 = SPH_C32(0x858075d5), V31 = SPH_C32(0x36d79cce), V32 = SPH_C32(0xe571f7d7), V33 = SPH_C32(0x204b1f67), V34 = SPH_C32(0x35870c6a), V35 = SPH_C32(0x57e9e923), V36 = SPH_C32(0x14bcb808), V37 = SPH_C32(0x7cde72ce);
-    sph_u32 V40 = SPH_C32(0x6c68e9be), V41 = SPH_C32(0x5ec41e22), V42 = SPH_C32(0xc825b7c7), V43 = SPH_C32(0xaffb4363), V44 = SPH_C32(0xf5df3999), V45 = SPH_C32(0x0fc688f1), V46 = SPH_C32(0xb07224cc), V47 = SPH_C32(0x03e86cea);
+    sph_u32 V00 = luffa_v0.s0, V01 = luffa_v0.s1, V02 = luffa_v0.s2, V03 = luffa_v0.s3, V04 = luffa_v0.s4, V05 = luffa_v0.s5, V06 = luffa_v0.s6, V07 = luffa_v0.s7;
+    sph_u32 V10 = luffa_v0.s8, V11 = luffa_v0.s9, V12 = luffa_v0.sa, V13 = luffa_v0.sb, V14 = luffa_v0.sc, V15 = luffa_v0.sd, V16 = luffa_v0.se, V17 = luffa_v0.sf;
+    sph_u32 V20 = luffa_v1.s0, V21 = luffa_v1.s1, V22 = luffa_v1.s2, V23 = luffa_v1.s3, V24 = luffa_v1.s4, V25 = luffa_v1.s5, V26 = luffa_v1.s6, V27 = luffa_v1.s7;
+    sph_u32 V30 = luffa_v1.s8, V31 = luffa_v1.s9, V32 = luffa_v1.sa, V33 = luffa_v1.sb, V34 = luffa_v1.sc, V35 = luffa_v1.sd, V36 = luffa_v1.se, V37 = luffa_v1.sf;
+    sph_u32 V40 = luffa_v2.s0, V41 = luffa_v2.s1, V42 = luffa_v2.s2, V43 = luffa_v2.s3, V44 = luffa_v2.s4, V45 = luffa_v2.s5, V46 = luffa_v2.s6, V47 = luffa_v2.s7;
 
     DECL_TMP8(M);
 
-    M0 = DEC32BE(block + 0);
-    M1 = DEC32BE(block + 4);
-    M2 = DEC32BE(block + 8);
-    M3 = DEC32BE(block + 12);
-    M4 = DEC32BE(block + 16);
-    M5 = DEC32BE(block + 20);
-    M6 = DEC32BE(block + 24);
-    M7 = DEC32BE(block + 28);
+    M0 = DEC32BE(block + 64);
+    M1 = DEC32BE(block + 68);
+    M2 = DEC32BE(block + 72);
+    M3 = SWAP4(gid);
+    M4 = 0x80000000;
+    M5 = M6 = M7 = 0;
 
-    for(uint i = 0; i < 5; i++)
+    for(uint i = 2; i < 5; i++)
     {
         MI5;
         LUFFA_P5;
 
-        if(i == 0) {
-            M0 = DEC32BE(block + 32);
-            M1 = DEC32BE(block + 36);
-            M2 = DEC32BE(block + 40);
-            M3 = DEC32BE(block + 44);
-            M4 = DEC32BE(block + 48);
-            M5 = DEC32BE(block + 52);
-            M6 = DEC32BE(block + 56);
-            M7 = DEC32BE(block + 60);
-        } else if(i == 1) {
-            M0 = DEC32BE(block + 64);
-            M1 = DEC32BE(block + 68);
-            M2 = DEC32BE(block + 72);
-            M3 = SWAP4(gid);
-            M4 = 0x80000000;
-            M5 = M6 = M7 = 0;
-        } else if(i == 2) {
+        if(i == 2) {
             M0 = M1 = M2 = M3 = M4 = M5 = M6 = M7 = 0;
         } else if(i == 3) {
             hash.h4[1] = V00 ^ V10 ^ V20 ^ V30 ^ V40;
@@ -453,7 +460,7 @@ __kernel void search(__global unsigned char* block, volatile __global uint* outp
 
     bool result = (Vb11 <= target);
     if (result)
-        output[output[0xFF]++] = SWAP4(gid);
+        SETFOUND_HASH(SWAP4(gid), Vb00, Vb01, Vb10, Vb11);
 }
 
 #endif // QUBITCOIN_CL
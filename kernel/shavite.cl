@@ -66,7 +66,17 @@
 /*
  * This function assumes that "msg" is aligned for 32-bit access.
  */
-#define c512(msg)	do { \
+#define c512(msg)	C512(0, (uint8)(0))
+
+/*
+ * c512() for an 80-byte block header, whose first 64 bytes are the same for
+ * every nonce. The host runs the left halves of rounds 0 and 1 once per work
+ * and passes p0-p3 and pC-pF in "pre" (s0-s3, s4-s7), and the round 1 values
+ * of rk00-rk0F, which must be loaded instead of the first 16 message words.
+ */
+#define c512_pre(pre)	C512(1, pre)
+
+#define C512(precalc, pre)	do { \
 	sph_u32 p0, p1, p2, p3, p4, p5, p6, p7; \
 	sph_u32 p8, p9, pA, pB, pC, pD, pE, pF; \
 	sph_u32 x0, x1, x2, x3; \
@@ -89,30 +99,37 @@
 	pE = hE; \
 	pF = hF; \
 	/* round 0 */ \
-	x0 = p4 ^ rk00; \
-	x1 = p5 ^ rk01; \
-	x2 = p6 ^ rk02; \
-	x3 = p7 ^ rk03; \
-	AES_ROUND_NOKEY(x0, x1, x2, x3); \
-	x0 ^= rk04; \
-	x1 ^= rk05; \
-	x2 ^= rk06; \
-	x3 ^= rk07; \
-	AES_ROUND_NOKEY(x0, x1, x2, x3); \
-	x0 ^= rk08; \
-	x1 ^= rk09; \
-	x2 ^= rk0A; \
-	x3 ^= rk0B; \
-	AES_ROUND_NOKEY(x0, x1, x2, x3); \
-	x0 ^= rk0C; \
-	x1 ^= rk0D; \
-	x2 ^= rk0E; \
-	x3 ^= rk0F; \
-	AES_ROUND_NOKEY(x0, x1, x2, x3); \
-	p0 ^= x0; \
-	p1 ^= x1; \
-	p2 ^= x2; \
-	p3 ^= x3; \
+	if (precalc) { \
+		p0 = (pre).s0; \
+		p1 = (pre).s1; \
+		p2 = (pre).s2; \
+		p3 = (pre).s3; \
+	} else { \
+		x0 = p4 ^ rk00; \
+		x1 = p5 ^ rk01; \
+		x2 = p6 ^ rk02; \
+		x3 = p7 ^ rk03; \
+		AES_ROUND_NOKEY(x0, x1, x2, x3); \
+		x0 ^= rk04; \
+		x1 ^= rk05; \
+		x2 ^= rk06; \
+		x3 ^= rk07; \
+		AES_ROUND_NOKEY(x0, x1, x2, x3); \
+		x0 ^= rk08; \
+		x1 ^= rk09; \
+		x2 ^= rk0A; \
+		x3 ^= rk0B; \
+		AES_ROUND_NOKEY(x0, x1, x2, x3); \
+		x0 ^= rk0C; \
+		x1 ^= rk0D; \
+		x2 ^= rk0E; \
+		x3 ^= rk0F; \
+		AES_ROUND_NOKEY(x0, x1, x2, x3); \
+		p0 ^= x0; \
+		p1 ^= x1; \
+		p2 ^= x2; \
+		p3 ^= x3; \
+	} \
 	x0 = pC ^ rk10; \
 	x1 = pD ^ rk11; \
 	x2 = pE ^ rk12; \
@@ -140,62 +157,69 @@
  \
 	for (r = 0; r < 3; r ++) { \
 		/* round 1, 5, 9 */ \
-		KEY_EXPAND_ELT(rk00, rk01, rk02, rk03); \
-		rk00 ^= rk1C; \
-		rk01 ^= rk1D; \
-		rk02 ^= rk1E; \
-		rk03 ^= rk1F; \
-		if (r == 0) { \
-			rk00 ^= sc_count0; \
-			rk01 ^= sc_count1; \
-			rk02 ^= sc_count2; \
-			rk03 ^= SPH_T32(~sc_count3); \
+		if ((precalc) && r == 0) { \
+			pC = (pre).s4; \
+			pD = (pre).s5; \
+			pE = (pre).s6; \
+			pF = (pre).s7; \
+		} else { \
+			KEY_EXPAND_ELT(rk00, rk01, rk02, rk03); \
+			rk00 ^= rk1C; \
+			rk01 ^= rk1D; \
+			rk02 ^= rk1E; \
+			rk03 ^= rk1F; \
+			if (r == 0) { \
+				rk00 ^= sc_count0; \
+				rk01 ^= sc_count1; \
+				rk02 ^= sc_count2; \
+				rk03 ^= SPH_T32(~sc_count3); \
+			} \
+			x0 = p0 ^ rk00; \
+			x1 = p1 ^ rk01; \
+			x2 = p2 ^ rk02; \
+			x3 = p3 ^ rk03; \
+			AES_ROUND_NOKEY(x0, x1, x2, x3); \
+			KEY_EXPAND_ELT(rk04, rk05, rk06, rk07); \
+			rk04 ^= rk00; \
+			rk05 ^= rk01; \
+			rk06 ^= rk02; \
+			rk07 ^= rk03; \
+			if (r == 1) { \
+				rk04 ^= sc_count3; \
+				rk05 ^= sc_count2; \
+				rk06 ^= sc_count1; \
+				rk07 ^= SPH_T32(~sc_count0); \
+			} \
+			x0 ^= rk04; \
+			x1 ^= rk05; \
+			x2 ^= rk06; \
+			x3 ^= rk07; \
+			AES_ROUND_NOKEY(x0, x1, x2, x3); \
+			KEY_EXPAND_ELT(rk08, rk09, rk0A, rk0B); \
+			rk08 ^= rk04; \
+			rk09 ^= rk05; \
+			rk0A ^= rk06; \
+			rk0B ^= rk07; \
+			x0 ^= rk08; \
+			x1 ^= rk09; \
+			x2 ^= rk0A; \
+			x3 ^= rk0B; \
+			AES_ROUND_NOKEY(x0, x1, x2, x3); \
+			KEY_EXPAND_ELT(rk0C, rk0D, rk0E, rk0F); \
+			rk0C ^= rk08; \
+			rk0D ^= rk09; \
+			rk0E ^= rk0A; \
+			rk0F ^= rk0B; \
+			x0 ^= rk0C; \
+			x1 ^= rk0D; \
+			x2 ^= rk0E; \
+			x3 ^= rk0F; \
+			AES_ROUND_NOKEY(x0, x1, x2, x3); \
+			pC ^= x0; \
+			pD ^= x1; \
+			pE ^= x2; \
+			pF ^= x3; \
 		} \
-		x0 = p0 ^ rk00; \
-		x1 = p1 ^ rk01; \
-		x2 = p2 ^ rk02; \
-		x3 = p3 ^ rk03; \
-		AES_ROUND_NOKEY(x0, x1, x2, x3); \
-		KEY_EXPAND_ELT(rk04, rk05, rk06, rk07); \
-		rk04 ^= rk00; \
-		rk05 ^= rk01; \
-		rk06 ^= rk02; \
-		rk07 ^= rk03; \
-		if (r == 1) { \
-			rk04 ^= sc_count3; \
-			rk05 ^= sc_count2; \
-			rk06 ^= sc_count1; \
-			rk07 ^= SPH_T32(~sc_count0); \
-		} \
-		x0 ^= rk04; \
-		x1 ^= rk05; \
-		x2 ^= rk06; \
-		x3 ^= rk07; \
-		AES_ROUND_NOKEY(x0, x1, x2, x3); \
-		KEY_EXPAND_ELT(rk08, rk09, rk0A, rk0B); \
-		rk08 ^= rk04; \
-		rk09 ^= rk05; \
-		rk0A ^= rk06; \
-		rk0B ^= rk07; \
-		x0 ^= rk08; \
-		x1 ^= rk09; \
-		x2 ^= rk0A; \
-		x3 ^= rk0B; \
-		AES_ROUND_NOKEY(x0, x1, x2, x3); \
-		KEY_EXPAND_ELT(rk0C, rk0D, rk0E, rk0F); \
-		rk0C ^= rk08; \
-		rk0D ^= rk09; \
-		rk0E ^= rk0A; \
-		rk0F ^= rk0B; \
-		x0 ^= rk0C; \
-		x1 ^= rk0D; \
-		x2 ^= rk0E; \
-		x3 ^= rk0F; \
-		AES_ROUND_NOKEY(x0, x1, x2, x3); \
-		pC ^= x0; \
-		pD ^= x1; \
-		pE ^= x2; \
-		pF ^= x3; \
 		KEY_EXPAND_ELT(rk10, rk11, rk12, rk13); \
 		rk10 ^= rk0C; \
 		rk11 ^= rk0D; \
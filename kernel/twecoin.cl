@@ -39,6 +39,12 @@ typedef long sph_s64;
 #define SWAP4(x) as_uint(as_uchar4(x).wzyx)
 #define SWAP8(x) as_ulong(as_uchar8(x).s76543210)
 
+#ifndef FOUND
+#define FOUND (0xFF)
+#endif
+/* Slots past FOUND are dropped, the host sees the count above FOUND */
+#define SETFOUND(Xnonce) { uint slot = atomic_inc(output + FOUND); if (slot < FOUND) output[slot] = Xnonce; }
+
 #if SPH_BIG_ENDIAN
     #define DEC32BE(x) (*(const __global sph_u32 *) (x))
 #else
@@ -120,7 +126,7 @@ static sph_u32 sph_dec32le_aligned(const void *src)
 }
 
 
-__kernel void search(__global unsigned char* block, volatile __global uint* output, const ulong target)
+__kernel void search(__global unsigned char* block, volatile __global uint* output, const ulong target, const uint16 fugue_s0, const uint16 fugue_s1)
 {
     __local sph_u32 AES0[256], AES1[256], AES2[256], AES3[256];
     int init = get_local_id(0);
@@ -142,14 +148,10 @@ __kernel void search(__global unsigned char* block, volatile __global uint* outp
 
     // fugue
     {
-        sph_u32 S00 = 0, S01 = 0, S02 = 0, S03 = 0, S04 = 0, S05 = 0, S06 = 0, S07 = 0, S08 = 0, S09 = 0; \
-        sph_u32 S10 = 0, S11 = 0, S12 = 0, S13 = 0, S14 = 0, S15 = 0, S16 = 0, S17 = 0, S18 = 0, S19 = 0; \
-        sph_u32 S20 = 0, S21 = 0, S22 = IV256[0], S23 = IV256[1], S24 = IV256[2], S25 = IV256[3], S26 = IV256[4], S27 = IV256[5], S28 = IV256[6], S29 = IV256[7];
-    
-        FUGUE256_5(DEC32BE(block + 0x0), DEC32BE(block + 0x4), DEC32BE(block + 0x8), DEC32BE(block + 0xc), DEC32BE(block + 0x10));
-        FUGUE256_5(DEC32BE(block + 0x14), DEC32BE(block + 0x18), DEC32BE(block + 0x1c), DEC32BE(block + 0x20), DEC32BE(block + 0x24));
-        FUGUE256_5(DEC32BE(block + 0x28), DEC32BE(block + 0x2c), DEC32BE(block + 0x30), DEC32BE(block + 0x34), DEC32BE(block + 0x38));
-        FUGUE256_4(DEC32BE(block + 0x3c), DEC32BE(block + 0x40), DEC32BE(block + 0x44), DEC32BE(block + 0x48));
+        // the first 19 words were absorbed on the host
+        sph_u32 S00 = fugue_s0.s0, S01 = fugue_s0.s1, S02 = fugue_s0.s2, S03 = fugue_s0.s3, S04 = fugue_s0.s4, S05 = fugue_s0.s5, S06 = fugue_s0.s6, S07 = fugue_s0.s7, S08 = fugue_s0.s8, S09 = fugue_s0.s9;
+        sph_u32 S10 = fugue_s0.sa, S11 = fugue_s0.sb, S12 = fugue_s0.sc, S13 = fugue_s0.sd, S14 = fugue_s0.se, S15 = fugue_s0.sf, S16 = fugue_s1.s0, S17 = fugue_s1.s1, S18 = fugue_s1.s2, S19 = fugue_s1.s3;
+        sph_u32 S20 = fugue_s1.s4, S21 = fugue_s1.s5, S22 = fugue_s1.s6, S23 = fugue_s1.s7, S24 = fugue_s1.s8, S25 = fugue_s1.s9, S26 = fugue_s1.sa, S27 = fugue_s1.sb, S28 = fugue_s1.sc, S29 = fugue_s1.sd;
     
         TIX2(SWAP4(gid), S06, S07, S14, S16, S00);
         CMIX30(S03, S04, S05, S07, S08, S09, S18, S19, S20);
@@ -423,6 +425,6 @@ __kernel void search(__global unsigned char* block, volatile __global uint* outp
 
         bool result = ((((sph_u64) state[16] << 32) | state[15]) <= target);
         if (result)
-            output[output[0xFF]++] = SWAP4(gid);
+            SETFOUND(SWAP4(gid));
     }
 }
@@ -839,6 +839,60 @@ __constant const sph_u64 BLAKE_IV512[8] = {
 		H7 ^= S3 ^ V7 ^ VF; \
 	} while (0)
 
+/*
+ * COMPRESS64 for an 80-byte block header, starting from "pre": V0-VF as the
+ * host left them after the column step of round 0 and the half of the next
+ * G that only uses M8. Everything up to there is the same for every nonce.
+ */
+#define COMPRESS64_PRE(pre)   do { \
+		V0 = (pre).s0; \
+		V1 = (pre).s1; \
+		V2 = (pre).s2; \
+		V3 = (pre).s3; \
+		V4 = (pre).s4; \
+		V5 = (pre).s5; \
+		V6 = (pre).s6; \
+		V7 = (pre).s7; \
+		V8 = (pre).s8; \
+		V9 = (pre).s9; \
+		VA = (pre).sa; \
+		VB = (pre).sb; \
+		VC = (pre).sc; \
+		VD = (pre).sd; \
+		VE = (pre).se; \
+		VF = (pre).sf; \
+		V0 = SPH_T64(V0 + V5 + (M9 ^ CB8)); \
+		VF = SPH_ROTR64(VF ^ V0, 16); \
+		VA = SPH_T64(VA + VF); \
+		V5 = SPH_ROTR64(V5 ^ VA, 11); \
+		GB(MA, MB, CBA, CBB, V1, V6, VB, VC); \
+		GB(MC, MD, CBC, CBD, V2, V7, V8, VD); \
+		GB(ME, MF, CBE, CBF, V3, V4, V9, VE); \
+		ROUND_B(1); \
+		ROUND_B(2); \
+		ROUND_B(3); \
+		ROUND_B(4); \
+		ROUND_B(5); \
+		ROUND_B(6); \
+		ROUND_B(7); \
+		ROUND_B(8); \
+		ROUND_B(9); \
+		ROUND_B(0); \
+		ROUND_B(1); \
+		ROUND_B(2); \
+		ROUND_B(3); \
+		ROUND_B(4); \
+		ROUND_B(5); \
+		H0 ^= S0 ^ V0 ^ V8; \
+		H1 ^= S1 ^ V1 ^ V9; \
+		H2 ^= S2 ^ V2 ^ VA; \
+		H3 ^= S3 ^ V3 ^ VB; \
+		H4 ^= S0 ^ V4 ^ VC; \
+		H5 ^= S1 ^ V5 ^ VD; \
+		H6 ^= S2 ^ V6 ^ VE; \
+		H7 ^= S3 ^ V7 ^ VF; \
+	} while (0)
+
 #endif
 
 __constant const sph_u64 salt_zero_big[4] = { 0, 0, 0, 0 };
@@ -7690,6 +7744,12 @@ __constant const u32 SIMD_IV512[] = {
 #define SWAP4(x) as_uint(as_uchar4(x).wzyx)
 #define SWAP8(x) as_ulong(as_uchar8(x).s76543210)
 
+#ifndef FOUND
+#define FOUND (0xFF)
+#endif
+/* Slots past FOUND are dropped, the host sees the count above FOUND */
+#define SETFOUND(Xnonce) { uint slot = atomic_inc(output + FOUND); if (slot < FOUND) output[slot] = Xnonce; }
+
 #if SPH_BIG_ENDIAN
     #define DEC64E(x) (x)
     #define DEC64BE(x) (*(const __global sph_u64 *) (x));
@@ -7705,7 +7765,7 @@ typedef union {
 } hash_t;
 
 __attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
-__kernel void blake(__global unsigned char* block, __global hash_t* hashes)
+__kernel void blake(__global unsigned char* block, __global hash_t* hashes, const ulong16 blake_v)
 {
     uint gid = get_global_id(0);
     __global hash_t *hash = &(hashes[gid-get_global_offset(0)]);
@@ -7746,7 +7806,7 @@ __kernel void blake(__global unsigned char* block, __global hash_t* hashes)
 	 ME = 0;
 	 MF = 0x280;
 
-	 COMPRESS64;
+	 COMPRESS64_PRE(blake_v);
 
 	 hash->h8[0] = H0;
 	 hash->h8[1] = H1;
@@ -8436,7 +8496,7 @@ __kernel void echo(__global hash_t* hashes, __global uint* output, const ulong t
 
     bool result = (Vb11 <= target);
     if (result)
-        output[atomic_inc(output+0xFF)] = SWAP4(gid);
+        SETFOUND(SWAP4(gid));
 
     barrier(CLK_GLOBAL_MEM_FENCE);
 }
@@ -94,6 +94,12 @@ typedef long sph_s64;
 #define SWAP4(x) as_uint(as_uchar4(x).wzyx)
 #define SWAP8(x) as_ulong(as_uchar8(x).s76543210)
 
+#ifndef FOUND
+#define FOUND (0xFF)
+#endif
+/* Slots past FOUND are dropped, the host sees the count above FOUND */
+#define SETFOUND(Xnonce) { uint slot = atomic_inc(output + FOUND); if (slot < FOUND) output[slot] = Xnonce; }
+
 #if SPH_BIG_ENDIAN
     #define DEC64E(x) (x)
     #define DEC64BE(x) (*(const __global sph_u64 *) (x));
@@ -109,7 +115,7 @@ typedef union {
 } hash_t;
 
 __attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
-__kernel void blake(__global unsigned char* block, __global hash_t* hashes)
+__kernel void blake(__global unsigned char* block, __global hash_t* hashes, const ulong16 blake_v)
 {
     uint gid = get_global_id(0);
     __global hash_t *hash = &(hashes[gid-get_global_offset(0)]);
@@ -149,7 +155,7 @@ __kernel void blake(__global unsigned char* block, __global hash_t* hashes)
     ME = 0;
     MF = 0x280;
 
-    COMPRESS64;
+    COMPRESS64_PRE(blake_v);
 
     hash->h8[0] = H0;
     hash->h8[1] = H1;
@@ -994,7 +1000,7 @@ __kernel void fugue(__global hash_t* hashes, __global uint* output, const ulong
 
     bool result = (hash.h8[3] <= target);
     if (result)
-	output[atomic_inc(output+0xFF)] = SWAP4(gid);
+	SETFOUND(SWAP4(gid));
 
     barrier(CLK_GLOBAL_MEM_FENCE);
 }
@@ -1207,7 +1213,7 @@ __kernel void echo_hamsi_fugue(__global hash_t* hashes, __global uint* output, c
 
     bool result = (hash.h8[3] <= target);
     if (result)
-	output[atomic_inc(output+0xFF)] = SWAP4(gid);
+	SETFOUND(SWAP4(gid));
 
     barrier(CLK_GLOBAL_MEM_FENCE); 
 }
@@ -225,7 +225,8 @@ static inline int fsync (int fd)
  * the *_PARSE_COMMANDS macros for each listed driver.
  */
 #define DRIVER_PARSE_COMMANDS(DRIVER_ADD_COMMAND) \
-	DRIVER_ADD_COMMAND(opencl)
+	DRIVER_ADD_COMMAND(opencl) \
+	DRIVER_ADD_COMMAND(cpu)
 
 #define DRIVER_ENUM(X) DRIVER_##X,
 #define DRIVER_PROTOTYPE(X) struct device_drv X##_drv;
@@ -324,6 +325,7 @@ struct device_drv {
 	void (*get_statline_before)(char *, size_t, struct cgpu_info *);
 	void (*get_statline)(char *, size_t, struct cgpu_info *);
 	struct api_data *(*get_api_stats)(struct cgpu_info *);
+	struct api_data *(*get_api_profile)(struct thr_info *, struct api_data *);
 	bool (*get_stats)(struct cgpu_info *);
 	void (*identify_device)(struct cgpu_info *); // e.g. to flash a led
 	char *(*set_device)(struct cgpu_info *, char *option, char *setting, char *replybuf);
@@ -376,18 +378,19 @@ enum dev_enable {
 
 enum cl_kernels {
 	KL_NONE,
-	KL_ALEXKARNEW,	// kernels starting from this will have difficulty calculated by using litecoin algorithm
+	KL_ALEXKARNEW,
 	KL_ALEXKAROLD,
 	KL_CKOLIVAS,
 	KL_PSW,
 	KL_ZUIKKIS,
-	KL_QUARKCOIN,	// kernels starting from this will have difficulty calculated by using quarkcoin algorithm
+	KL_QUARKCOIN,
 	KL_QUBITCOIN,
 	KL_FRESH,
+	KL_FRESHMOD,
 	KL_INKCOIN,
 	KL_ANIMECOIN,
 	KL_SIFCOIN,
-	KL_DARKCOIN,	// kernels starting from this will have difficulty calculated by using bitcoin algorithm
+	KL_DARKCOIN,
 	KL_MYRIADCOIN_GROESTL,
 	KL_FUGUECOIN,
 	KL_GROESTLCOIN,
@@ -396,6 +399,9 @@ enum cl_kernels {
 	KL_X11MOD,
 	KL_X13MOD,
 	KL_X13MODOLD,
+	KL_QUARKCHAIN,
+	KL_X11CHAIN,
+	KL_X13CHAIN,
 };
 
 enum dev_reason {
@@ -433,6 +439,15 @@ struct sgminer_stats {
 	struct timeval getwork_wait_min;
 };
 
+/* Bucket i counts latencies under 2^i microseconds that did not fit in the
+ * bucket before it, the last one everything from 2^26us (67s) up */
+#define LATENCY_BUCKETS 28
+
+struct latency_histogram {
+	uint64_t count;
+	uint64_t bucket[LATENCY_BUCKETS];
+};
+
 // Just the actual network getworks to the pool
 struct sgminer_pool_stats {
 	uint32_t getwork_calls;
@@ -456,6 +471,12 @@ struct sgminer_pool_stats {
 	uint64_t times_received;
 	uint64_t bytes_received;
 	uint64_t net_bytes_received;
+	/* Stratum notify arriving to the first work from it being staged */
+	struct latency_histogram notify_work;
+	/* Nonce found to its share being written to the socket */
+	struct latency_histogram found_submit;
+	/* Share written to the pool answering it */
+	struct latency_histogram submit_ack;
 };
 
 struct cgpu_info {
@@ -470,6 +491,9 @@ struct cgpu_info {
 	int accepted;
 	int rejected;
 	int hw_errors;
+	/* Results hashed by the device, and whether they all get rehashed */
+	unsigned int verify_count;
+	bool verify_all;
 	double rolling;
 	double total_mhashes;
 	double utility;
@@ -493,14 +517,15 @@ struct cgpu_info {
 
 	cl_uint vwidth;
 	size_t work_size;
+	int nonces_per_thread;
 	enum cl_kernels kernel;
 	cl_ulong max_alloc;
 
 	int opt_lg, lookup_gap;
 	size_t opt_tc, thread_concurrency;
 	size_t shaders;
-	struct timeval tv_gpustart;
-	int intervals;
+	double dyn_threads;	/* dynamic intensity controller output */
+	double dyn_error;	/* and its last relative kernel time error */
 
 	bool new_work;
 
@@ -970,6 +995,7 @@ static inline void _cg_wunlock(cglock_t *lock, const char *file, const char *fun
 }
 
 struct pool;
+struct algorithm;
 
 #define API_MCAST_CODE "FTW"
 #define API_MCAST_ADDR "224.0.0.75"
@@ -983,6 +1009,10 @@ extern char *sgminer_path;
 extern bool opt_fail_only;
 extern bool opt_autofan;
 extern bool opt_autoengine;
+extern bool opt_gpu_profile;
+extern int opt_gpu_queues;
+extern int opt_result_slots;
+extern int opt_verify_sample;
 extern bool use_curses;
 extern char *opt_api_allow;
 extern bool opt_api_mcast;
@@ -1045,8 +1075,11 @@ extern pthread_mutex_t restart_lock;
 extern pthread_cond_t restart_cond;
 
 extern void clear_stratum_shares(struct pool *pool);
+#ifdef HAVE_SYS_EPOLL_H
+extern void stratum_loop_write(struct pool *pool, bool want);
+#endif
 extern void clear_pool_work(struct pool *pool);
-extern void set_target(unsigned char *dest_target, double diff);
+extern void set_target(unsigned char *dest_target, double diff, const struct algorithm *algo);
 extern int restart_wait(struct thr_info *thr, unsigned int mstime);
 
 extern void kill_work(void);
@@ -1089,6 +1122,8 @@ extern bool add_pool_details(struct pool *pool, bool live, char *url, char *user
 #define MIN_RAWINTENSITY_STR "1"
 #define MAX_RAWINTENSITY 2147483647
 #define MAX_RAWINTENSITY_STR "2147483647"
+/* Upper bound for threads per launch in dynamic mode */
+#define DYNAMIC_MAX_THREADS (1 << 22)
 
 extern bool hotplug_mode;
 extern int hotplug_time;
@@ -1130,6 +1165,8 @@ extern double best_diff;
 extern struct timeval block_timeval;
 extern char *workpadding;
 
+#define SPH_STATE_WORDS 40
+
 typedef struct {
 	cl_uint ctx_a; cl_uint ctx_b; cl_uint ctx_c; cl_uint ctx_d;
 	cl_uint ctx_e; cl_uint ctx_f; cl_uint ctx_g; cl_uint ctx_h;
@@ -1154,6 +1191,9 @@ typedef struct {
 	cl_uint zeroA, zeroB;
 	cl_uint oneA, twoA, threeA, fourA, fiveA, sixA, sevenA;
 
+	/* Nonce independent state the sph kernels start from, see precalc.c */
+	cl_uint sph_state[SPH_STATE_WORDS];
+
 	struct work *work;
 } dev_blk_ctx;
 
@@ -1171,10 +1211,24 @@ enum pool_state {
 	POOL_HIDDEN,
 };
 
+/* A stratum pool's connection as the stratum event loop sees it */
+enum stratum_state {
+	STRATUM_NONE,		/* Not added to the loop yet */
+	STRATUM_LIVE,		/* Connected, its socket is in the loop */
+	STRATUM_IDLE,		/* Suspended until the pool is needed */
+	STRATUM_CONNECTING,	/* A connect thread has it */
+	STRATUM_RETRY,		/* Connecting failed, waiting to try again */
+	STRATUM_GONE,		/* Removed and dropped from the loop */
+};
+
+/* Slots in a pool's set of submitted share fingerprints */
+#define SHARES_SEEN 4096
+
 struct stratum_work {
 	char *job_id;
 	char *prev_hash;
 	unsigned char **merkle_bin;
+	int merkle_alloc;
 	char *bbversion;
 	char *nbit;
 	char *ntime;
@@ -1194,6 +1248,8 @@ struct pool {
 	char *poolname;
 	bool haspoolname;
 	int prio;
+	/* Set by --pool-algorithm, NULL mines the first --kernel's */
+	const struct algorithm *algorithm;
 	int accepted, rejected;
 	int seq_rejects;
 	int seq_getfails;
@@ -1225,6 +1281,7 @@ struct pool {
 	unsigned int getwork_requested;
 	unsigned int stale_shares;
 	unsigned int discarded_work;
+	unsigned int duplicate_shares;
 	unsigned int getfail_occasions;
 	unsigned int remotefail_occasions;
 	struct timeval tv_idle;
@@ -1268,9 +1325,21 @@ struct pool {
 	char *stratum_url;
 	char *stratum_port;
 	struct addrinfo stratum_hints;
+	/* Resolved stratum addresses, reused until stale */
+	struct addrinfo *stratum_addrs;
+	char *stratum_addrs_host, *stratum_addrs_port;
+	time_t stratum_addrs_time;
+	/* When the newest notify arrived, cleared once work from it is staged */
+	struct timeval tv_notify;
+	/* Fingerprints of the shares submitted since the last clean job */
+	uint64_t *shares_seen;
+	unsigned int shares_seen_count;
 	SOCKETTYPE sock;
 	char *sockbuf;
 	size_t sockbuf_size;
+	/* Unread data is sockbuf[sockbuf_head, sockbuf_tail), already searched
+	 * for a newline up to sockbuf_scan */
+	size_t sockbuf_head, sockbuf_tail, sockbuf_scan;
 	char *sockaddr_url; /* stripped url used for sockaddr */
 	char *sockaddr_proxy_url;
 	char *sockaddr_proxy_port;
@@ -1285,10 +1354,23 @@ struct pool {
 	bool stratum_init;
 	bool stratum_notify;
 	struct stratum_work swork;
-	pthread_t stratum_sthread;
-	pthread_t stratum_rthread;
 	pthread_mutex_t stratum_lock;
-	struct thread_q *stratum_q;
+	/* Where the stratum event loop has the pool, see stratum_loop in
+	 * sgminer.c. Once added, the loop owns it and hands it to a connect
+	 * thread only while it is STRATUM_CONNECTING. */
+	enum stratum_state stratum_state;
+	/* The socket the loop reads, and the last time it got a line */
+	SOCKETTYPE stratum_watched;
+	time_t stratum_recvd;
+	/* When a STRATUM_RETRY pool is next connected */
+	time_t stratum_retry;
+	/* Set by client.reconnect, the loop connects to the new address */
+	bool stratum_reconnect;
+	/* Lines queued for the loop to send under stratum_lock, cut when the
+	 * first line is part sent */
+	char *stratum_out;
+	size_t stratum_out_len, stratum_out_size;
+	bool stratum_out_cut;
 	int sshares; /* stratum shares submitted waiting on response */
 
 	/* GBT variables */
@@ -1309,6 +1391,7 @@ struct pool {
 
 	/* Shared by both stratum & GBT */
 	unsigned char *coinbase;
+	size_t coinbase_alloc;
 	int nonce2_offset;
 	unsigned char header_bin[128];
 	int merkle_offset;
@@ -1399,10 +1482,13 @@ struct work {
 
 extern void get_datestamp(char *, size_t, struct timeval *);
 extern void inc_hw_errors(struct thr_info *thr);
+extern void rebuild_nonce(struct work *work, uint32_t nonce);
 extern bool test_nonce(struct work *work, uint32_t nonce);
 extern bool test_nonce_diff(struct work *work, uint32_t nonce, double diff);
 extern bool submit_tested_work(struct thr_info *thr, struct work *work);
 extern bool submit_nonce(struct thr_info *thr, struct work *work, uint32_t nonce);
+extern void submit_nonces(struct thr_info *thr, struct work *work, const uint32_t *nonces, unsigned int entries,
+			  const unsigned char *hashes);
 extern bool submit_noffset_nonce(struct thr_info *thr, struct work *work, uint32_t nonce,
 			  int noffset);
 extern struct work *get_work(struct thr_info *thr, const int thr_id);
@@ -1440,6 +1526,7 @@ extern struct thread_q *tq_new(void);
 extern void tq_free(struct thread_q *tq);
 extern bool tq_push(struct thread_q *tq, void *data);
 extern void *tq_pop(struct thread_q *tq, const struct timespec *abstime);
+extern void *tq_trypop(struct thread_q *tq);
 extern void tq_freeze(struct thread_q *tq);
 extern void tq_thaw(struct thread_q *tq);
 extern bool successful_connect;
@@ -1447,6 +1534,7 @@ extern void adl(void);
 extern void app_restart(void);
 extern void clean_work(struct work *work);
 extern void free_work(struct work *work);
+extern void get_benchmark_work(struct work *work);
 extern void set_work_ntime(struct work *work, int ntime);
 extern struct work *copy_work_noffset(struct work *base_work, int noffset);
 #define copy_work(work_in) copy_work_noffset(work_in, 0)
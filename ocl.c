@@ -10,6 +10,7 @@
 #include "config.h"
 
 #include <signal.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -32,8 +33,23 @@
 
 #include "findnonce.h"
 #include "ocl.h"
+#include "driver-opencl.h"
 
 int opt_platform_id = -1;
+enum cl_device_select opt_cl_device_type = CL_SELECT_GPU;
+
+/* Device types searched for on the platform, see --cl-device-type */
+static cl_device_type cl_device_mask(void)
+{
+	switch (opt_cl_device_type) {
+	case CL_SELECT_CPU:
+		return CL_DEVICE_TYPE_CPU;
+	case CL_SELECT_ALL:
+		return CL_DEVICE_TYPE_ALL;
+	default:
+		return CL_DEVICE_TYPE_GPU;
+	}
+}
 
 char *file_contents(const char *filename, int *length)
 {
@@ -126,7 +142,7 @@ int clDevicesNum(void) {
 		status = clGetPlatformInfo(platform, CL_PLATFORM_VERSION, sizeof(pbuff), pbuff, NULL);
 		if (status == CL_SUCCESS)
 			applog(LOG_INFO, "CL Platform %d version: %s", i, pbuff);
-		status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, NULL, &numDevices);
+		status = clGetDeviceIDs(platform, cl_device_mask(), 0, NULL, &numDevices);
 		if (status != CL_SUCCESS) {
 			applog(LOG_INFO, "Error %d: Getting Device IDs (num)", status);
 			continue;
@@ -140,7 +156,7 @@ int clDevicesNum(void) {
 			unsigned int j;
 			cl_device_id *devices = (cl_device_id *)malloc(numDevices*sizeof(cl_device_id));
 
-			clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, numDevices, devices, NULL);
+			clGetDeviceIDs(platform, cl_device_mask(), numDevices, devices, NULL);
 			for (j = 0; j < numDevices; j++) {
 				clGetDeviceInfo(devices[j], CL_DEVICE_NAME, sizeof(pbuff), pbuff, NULL);
 				applog(LOG_INFO, "\t%i\t%s", j, pbuff);
@@ -155,6 +171,67 @@ int clDevicesNum(void) {
 	return most_devices;
 }
 
+/* Look up a device's name and driver version without building anything, so
+ * settings saved for that device can be applied before initCl is called. */
+bool clDeviceInfo(unsigned int gpu, char *name, size_t nameSize, char *driver, size_t driverSize)
+{
+	cl_platform_id *platforms;
+	cl_device_id *devices;
+	cl_uint numPlatforms;
+	cl_uint numDevices;
+	cl_int status;
+
+	status = clGetPlatformIDs(0, NULL, &numPlatforms);
+	if (status != CL_SUCCESS) {
+		applog(LOG_ERR, "Error %d: Getting Platforms. (clGetPlatformsIDs)", status);
+		return false;
+	}
+
+	if (opt_platform_id < 0 || opt_platform_id >= (int)numPlatforms) {
+		applog(LOG_ERR, "Specified platform that does not exist");
+		return false;
+	}
+
+	platforms = (cl_platform_id *)alloca(numPlatforms*sizeof(cl_platform_id));
+	status = clGetPlatformIDs(numPlatforms, platforms, NULL);
+	if (status != CL_SUCCESS) {
+		applog(LOG_ERR, "Error %d: Getting Platform Ids. (clGetPlatformsIDs)", status);
+		return false;
+	}
+
+	status = clGetDeviceIDs(platforms[opt_platform_id], cl_device_mask(), 0, NULL, &numDevices);
+	if (status != CL_SUCCESS) {
+		applog(LOG_ERR, "Error %d: Getting Device IDs (num)", status);
+		return false;
+	}
+
+	if (gpu >= numDevices) {
+		applog(LOG_ERR, "Invalid GPU %i", gpu);
+		return false;
+	}
+
+	devices = (cl_device_id *)alloca(numDevices*sizeof(cl_device_id));
+	status = clGetDeviceIDs(platforms[opt_platform_id], cl_device_mask(), numDevices, devices, NULL);
+	if (status != CL_SUCCESS) {
+		applog(LOG_ERR, "Error %d: Getting Device IDs (list)", status);
+		return false;
+	}
+
+	status = clGetDeviceInfo(devices[gpu], CL_DEVICE_NAME, nameSize, name, NULL);
+	if (status != CL_SUCCESS) {
+		applog(LOG_ERR, "Error %d: Getting Device Info", status);
+		return false;
+	}
+
+	status = clGetDeviceInfo(devices[gpu], CL_DRIVER_VERSION, driverSize, driver, NULL);
+	if (status != CL_SUCCESS) {
+		applog(LOG_ERR, "Error %d: Failed to clGetDeviceInfo when trying to get CL_DRIVER_VERSION", status);
+		return false;
+	}
+
+	return true;
+}
+
 static int advance(char **area, unsigned *remaining, const char *marker)
 {
 	char *find = memmem(*area, *remaining, marker, strlen(marker));
@@ -212,19 +289,20 @@ void patch_opcodes(char *w, unsigned remaining)
 	applog(LOG_DEBUG, "Patched a total of %i BFI_INT instructions", patched);
 }
 
-#define CL_CREATE_KERNEL(name) \
-	clState->kernel_##name = clCreateKernel(clState->program, #name, &status); \
-	if (status != CL_SUCCESS) { \
-	    applog(LOG_ERR, "Error %d: Creating Kernel from program. (clCreateKernel #name)", status); \
-	    return NULL; \
-	}
-
 bool allocateHashBuffer(unsigned int gpu, _clState *clState) {
 	cl_int status;
 
 	struct cgpu_info *cgpu = &gpus[gpu];
 	unsigned int threads = 0;
 
+	/* Dynamic intensity can go anywhere, so allocate for the most it will use */
+	if (cgpu->dynamic) {
+		threads = DYNAMIC_MAX_THREADS;
+		if (threads > cgpu->max_alloc / 64)
+			threads = cgpu->max_alloc / 64;
+		threads -= threads % clState->wsize;
+	}
+
 	while (threads < clState->wsize) {
 		if (cgpu->rawintensity > 0) {
 			threads = cgpu->rawintensity;
@@ -250,6 +328,7 @@ bool allocateHashBuffer(unsigned int gpu, _clState *clState) {
 		return false;
 	}
 	applog(LOG_DEBUG, "Creating hash buffer sized %d", (int)bufsize);
+	clState->max_threads = threads;
 
 	clState->hash_buffer = NULL;
 	clState->hash_buffer = clCreateBuffer(clState->context, CL_MEM_READ_WRITE, bufsize, NULL, &status);
@@ -261,11 +340,45 @@ bool allocateHashBuffer(unsigned int gpu, _clState *clState) {
 	return true;
 }
 
+/* Multi stage kernels pass hashes between stages in one hash buffer and
+ * the scrypt kernels share one scratchpad, so their launches can't be
+ * split across concurrent queues */
+static bool queues_supported(const struct algorithm *algo)
+{
+	return !algo->stages[0] && !(algo->flags & ALGO_SCRYPT);
+}
+
+/* Kernels built with -D NONCES_PER_THREAD that loop over their nonces. The
+ * hash buffer kernels cover the same by enqueueing their stages once per
+ * block of nonces, so their buffer doesn't grow. */
+static bool nonce_loop_supported(const struct algorithm *algo)
+{
+	return algo->flags & ALGO_NONCE_LOOP;
+}
+
+static bool nonce_blocks_supported(const struct algorithm *algo)
+{
+	return algo->stages[0] || nonce_loop_supported(algo);
+}
+
+/* Append to the size byte compiler options, which are sized so they never
+ * need to be cut short */
+static void add_compiler_option(char *options, size_t size, const char *fmt, ...)
+{
+	size_t len = strlen(options);
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(options + len, size - len, fmt, ap);
+	va_end(ap);
+}
+
 _clState *initCl(unsigned int gpu, char *name, size_t nameSize)
 {
 	_clState *clState = calloc(1, sizeof(_clState));
 	bool patchbfi = false, prog_built = false;
 	struct cgpu_info *cgpu = &gpus[gpu];
+	const struct algorithm *algo = kernel_algorithm(cgpu->kernel);
 	cl_platform_id platform = NULL;
 	char pbuff[256], vbuff[255];
 	cl_platform_id* platforms;
@@ -273,6 +386,8 @@ _clState *initCl(unsigned int gpu, char *name, size_t nameSize)
 	cl_device_id *devices;
 	cl_uint numPlatforms;
 	cl_uint numDevices;
+	cl_device_type devtype;
+	unsigned int i;
 	cl_int status;
 
 	status = clGetPlatformIDs(0, NULL, &numPlatforms);
@@ -313,7 +428,7 @@ _clState *initCl(unsigned int gpu, char *name, size_t nameSize)
 	if (status == CL_SUCCESS)
 		applog(LOG_INFO, "CL Platform version: %s", vbuff);
 
-	status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, NULL, &numDevices);
+	status = clGetDeviceIDs(platform, cl_device_mask(), 0, NULL, &numDevices);
 	if (status != CL_SUCCESS) {
 		applog(LOG_ERR, "Error %d: Getting Device IDs (num)", status);
 		return NULL;
@@ -324,7 +439,7 @@ _clState *initCl(unsigned int gpu, char *name, size_t nameSize)
 
 		/* Now, get the device list data */
 
-		status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, numDevices, devices, NULL);
+		status = clGetDeviceIDs(platform, cl_device_mask(), numDevices, devices, NULL);
 		if (status != CL_SUCCESS) {
 			applog(LOG_ERR, "Error %d: Getting Device IDs (list)", status);
 			return NULL;
@@ -361,28 +476,65 @@ _clState *initCl(unsigned int gpu, char *name, size_t nameSize)
 
 	cl_context_properties cps[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
 
-	clState->context = clCreateContextFromType(cps, CL_DEVICE_TYPE_GPU, NULL, NULL, &status);
+	/* A context of just this device, --cl-device-type all may have listed
+	 * devices of other types on the same platform */
+	clState->context = clCreateContext(cps, 1, &devices[gpu], NULL, NULL, &status);
 	if (status != CL_SUCCESS) {
-		applog(LOG_ERR, "Error %d: Creating Context. (clCreateContextFromType)", status);
+		applog(LOG_ERR, "Error %d: Creating Context. (clCreateContext)", status);
 		return NULL;
 	}
 
+	status = clGetDeviceInfo(devices[gpu], CL_DEVICE_TYPE, sizeof(devtype), (void *)&devtype, NULL);
+	if (status != CL_SUCCESS) {
+		applog(LOG_ERR, "Error %d: Failed to clGetDeviceInfo when trying to get CL_DEVICE_TYPE", status);
+		return NULL;
+	}
+	clState->isCPU = !!(devtype & CL_DEVICE_TYPE_CPU);
+	if (clState->isCPU)
+		applog(LOG_INFO, "Device %d is a CPU", gpu);
+
 	/////////////////////////////////////////////////////////////////
 	// Create an OpenCL command queue
 	/////////////////////////////////////////////////////////////////
-	if ((cgpu->kernel == KL_X11MOD) || (cgpu->kernel == KL_X13MOD) || (cgpu->kernel == KL_X13MODOLD))
+	/* Profiling gives the dynamic intensity code and --gpu-profile the real
+	 * kernel run times */
+	cl_command_queue_properties cqp = (cgpu->dynamic || opt_gpu_profile) ? CL_QUEUE_PROFILING_ENABLE : 0;
+
+	if (algo->stages[0])
 		clState->commandQueue = clCreateCommandQueue(clState->context, devices[gpu],
-							     0, &status);
+							     cqp, &status);
 	else
 		clState->commandQueue = clCreateCommandQueue(clState->context, devices[gpu],
-							     CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &status);
+							     cqp | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &status);
 
 	if (status != CL_SUCCESS) /* Try again without OOE enable */
-		clState->commandQueue = clCreateCommandQueue(clState->context, devices[gpu], 0 , &status);
+		clState->commandQueue = clCreateCommandQueue(clState->context, devices[gpu], cqp, &status);
+	if (status != CL_SUCCESS && cqp) { /* Then without profiling */
+		cqp = 0;
+		clState->commandQueue = clCreateCommandQueue(clState->context, devices[gpu], 0, &status);
+	}
 	if (status != CL_SUCCESS) {
 		applog(LOG_ERR, "Error %d: Creating Command Queue. (clCreateCommandQueue)", status);
 		return NULL;
 	}
+	clState->hasProfiling = !!cqp;
+
+	clState->nqueues = 1;
+	clState->queue[0] = clState->commandQueue;
+	if (opt_gpu_queues > 1 && !queues_supported(algo))
+		applog(LOG_INFO, "GPU %d: kernel %s can't split launches, using one queue", gpu, cgpu->kname);
+	else if (opt_gpu_queues > 1) {
+		while (clState->nqueues < (unsigned int)opt_gpu_queues && clState->nqueues < MAX_GPU_QUEUES) {
+			cl_command_queue queue = clCreateCommandQueue(clState->context, devices[gpu], cqp, &status);
+
+			if (status != CL_SUCCESS) {
+				applog(LOG_WARNING, "Error %d: Creating Command Queue %u, using %u", status,
+				       clState->nqueues, clState->nqueues);
+				break;
+			}
+			clState->queue[clState->nqueues++] = queue;
+		}
+	}
 
 	/* Check for BFI INT support. Hopefully people don't mix devices with
 	 * and without it! */
@@ -439,6 +591,8 @@ _clState *initCl(unsigned int gpu, char *name, size_t nameSize)
 	}
 	// AMD architechture got 64 compute shaders per compute unit.
 	// Source: http://www.amd.com/us/Documents/GCN_Architecture_whitepaper.pdf
+	// CPU compute units are hardware threads, 64 work items each still
+	// gives every one enough to chew on per launch.
 	clState->compute_shaders = compute_units * 64;
 	applog(LOG_DEBUG, "Max shaders calculated %d", (int)(clState->compute_shaders));
 
@@ -467,139 +621,59 @@ _clState *initCl(unsigned int gpu, char *name, size_t nameSize)
 	} else {
 		clState->chosen_kernel = cgpu->kernel;
 	}
-
-	/* For some reason 2 vectors is still better even if the card says
-	 * otherwise, and many cards lie about their max so use 256 as max
-	 * unless explicitly set on the command line. Tahiti prefers 1 */
-	if (strstr(name, "Tahiti"))
-		preferred_vwidth = 1;
-	else if (preferred_vwidth > 2)
-		preferred_vwidth = 2;
-
-	/* All available kernels only support vector 1 */
-	cgpu->vwidth = 1;
-
-	switch (clState->chosen_kernel) {
-		case KL_ALEXKARNEW:
-			applog(LOG_WARNING, "Kernel alexkarnew is experimental.");
-			strcpy(filename, ALEXKARNEW_KERNNAME".cl");
-			strcpy(binaryfilename, ALEXKARNEW_KERNNAME);
-			break;
-		case KL_ALEXKAROLD:
-			applog(LOG_WARNING, "Kernel alexkarold is experimental.");
-			strcpy(filename, ALEXKAROLD_KERNNAME".cl");
-			strcpy(binaryfilename, ALEXKAROLD_KERNNAME);
-			break;
-		case KL_CKOLIVAS:
-			strcpy(filename, CKOLIVAS_KERNNAME".cl");
-			strcpy(binaryfilename, CKOLIVAS_KERNNAME);
-			break;
-		case KL_PSW:
-			applog(LOG_WARNING, "Kernel psw is experimental.");
-			strcpy(filename, PSW_KERNNAME".cl");
-			strcpy(binaryfilename, PSW_KERNNAME);
-			break;
-		case KL_ZUIKKIS:
-			applog(LOG_WARNING, "Kernel zuikkis is experimental.");
-			strcpy(filename, ZUIKKIS_KERNNAME".cl");
-			strcpy(binaryfilename, ZUIKKIS_KERNNAME);
-			/* Kernel only supports lookup-gap 2 */
-			cgpu->lookup_gap = 2;
-			/* Kernel only supports worksize 256 */
-			cgpu->work_size = 256;
-			break;
-		case KL_DARKCOIN:
-			applog(LOG_WARNING, "Kernel darkcoin is experimental.");
-			strcpy(filename, DARKCOIN_KERNNAME".cl");
-			strcpy(binaryfilename, DARKCOIN_KERNNAME);
-			break;
-		case KL_QUBITCOIN:
-			applog(LOG_WARNING, "Kernel qubitcoin is experimental.");
-			strcpy(filename, QUBITCOIN_KERNNAME".cl");
-			strcpy(binaryfilename, QUBITCOIN_KERNNAME);
-			break;
-		case KL_FRESH:
-			applog(LOG_WARNING, "Kernel FRESH is experimental.");
-			strcpy(filename, FRESH_KERNNAME".cl");
-			strcpy(binaryfilename, FRESH_KERNNAME);
-			break;
-		case KL_QUARKCOIN:
-			applog(LOG_WARNING, "Kernel quarkcoin is experimental.");
-			strcpy(filename, QUARKCOIN_KERNNAME".cl");
-			strcpy(binaryfilename, QUARKCOIN_KERNNAME);
-			break;
-		case KL_MYRIADCOIN_GROESTL:
-			applog(LOG_WARNING, "Kernel myriadcoin-groestl is experimental.");
-			strcpy(filename, MYRIADCOIN_GROESTL_KERNNAME".cl");
-			strcpy(binaryfilename, MYRIADCOIN_GROESTL_KERNNAME);
-			break;
-		case KL_FUGUECOIN:
-			applog(LOG_WARNING, "Kernel fuguecoin is experimental.");
-			strcpy(filename, FUGUECOIN_KERNNAME".cl");
-			strcpy(binaryfilename, FUGUECOIN_KERNNAME);
-			break;
-		case KL_INKCOIN:
-			applog(LOG_WARNING, "Kernel inkcoin is experimental.");
-			strcpy(filename, INKCOIN_KERNNAME".cl");
-			strcpy(binaryfilename, INKCOIN_KERNNAME);
-			break;
-		case KL_ANIMECOIN:
-			applog(LOG_WARNING, "Kernel animecoin is experimental.");
-			strcpy(filename, ANIMECOIN_KERNNAME".cl");
-			strcpy(binaryfilename, ANIMECOIN_KERNNAME);
-			break;
-		case KL_GROESTLCOIN:
-			applog(LOG_WARNING, "Kernel groestlcoin is experimental.");
-			strcpy(filename, GROESTLCOIN_KERNNAME".cl");
-			strcpy(binaryfilename, GROESTLCOIN_KERNNAME);
-			break;
-		case KL_SIFCOIN:
-			applog(LOG_WARNING, "Kernel sifcoin is experimental.");
-			strcpy(filename, SIFCOIN_KERNNAME".cl");
-			strcpy(binaryfilename, SIFCOIN_KERNNAME);
-			break;
-		case KL_TWECOIN:
-			applog(LOG_WARNING, "Kernel twecoin is experimental.");
-			strcpy(filename, TWECOIN_KERNNAME".cl");
-			strcpy(binaryfilename, TWECOIN_KERNNAME);
-			break;
-		case KL_MARUCOIN:
-			applog(LOG_WARNING, "Kernel marucoin is experimental.");
-			strcpy(filename, MARUCOIN_KERNNAME".cl");
-			strcpy(binaryfilename, MARUCOIN_KERNNAME);
-			break;
-		case KL_X11MOD:
-			applog(LOG_WARNING, "Kernel x11mod is experimental.");
-			strcpy(filename, X11MOD_KERNNAME".cl");
-			strcpy(binaryfilename, X11MOD_KERNNAME);
-			break;
-		case KL_X13MOD:
-			applog(LOG_WARNING, "Kernel x13mod is experimental.");
-			strcpy(filename, X13MOD_KERNNAME".cl");
-			strcpy(binaryfilename, X13MOD_KERNNAME);
-			break;
-		case KL_X13MODOLD:
-			applog(LOG_WARNING, "Kernel x13mod (AMD HD 5xxx/6xxx) is experimental.");
-			strcpy(filename, X13MOD_KERNNAME".cl");
-			strcpy(binaryfilename, X13MODOLD_KERNNAME);
-			break;
-		case KL_NONE: /* Shouldn't happen */
-			break;
+	clState->algorithm = algo;
+
+	/* Only the kernels with a nonce loop hash several nonces per work
+	 * item, and only with --vectors: VLIW parts report a preferred
+	 * width of 4 as GCN does, which gains nothing from it */
+	if (!nonce_loop_supported(algo)) {
+		if (cgpu->vwidth > 1)
+			applog(LOG_WARNING, "GPU %d: kernel only supports 1 vector, ignoring --vectors", gpu);
+		cgpu->vwidth = 1;
+	} else if (!cgpu->vwidth)
+		cgpu->vwidth = 1;
+
+	if (algo->flags & ALGO_EXPERIMENTAL)
+		applog(LOG_WARNING, "Kernel %s is experimental.", algo->name);
+	sprintf(filename, "%s.cl", algo->file);
+	strcpy(binaryfilename, algo->name);
+	if (clState->chosen_kernel == KL_ZUIKKIS) {
+		/* Kernel only supports lookup-gap 2 */
+		cgpu->lookup_gap = 2;
+		/* Kernel only supports worksize 256 */
+		cgpu->work_size = 256;
 	}
 
-	if (cgpu->vwidth)
-		clState->vwidth = cgpu->vwidth;
-	else {
-		clState->vwidth = preferred_vwidth;
-		cgpu->vwidth = preferred_vwidth;
-	}
+	clState->vwidth = cgpu->vwidth;
 
 	clState->goffset = true;
 
+	clState->found = opt_result_slots;
+	/* The hash of each result follows the count, unless every result
+	 * gets rehashed anyway */
+	clState->hashout = opt_verify_sample > 1 && (algo->flags & ALGO_HASH_OUT);
+	clState->outsize = (clState->found + 1) * sizeof(uint32_t);
+	if (clState->hashout)
+		clState->outsize += clState->found * 32;
+
+	clState->npt = 1;
+	if (cgpu->nonces_per_thread > 1) {
+		if (nonce_blocks_supported(algo))
+			clState->npt = cgpu->nonces_per_thread;
+		else
+			applogsiz(LOG_WARNING, LOGBUFSIZ + sizeof(filename),
+				  "GPU %d: kernel %s hashes one nonce per thread, ignoring --nonces-per-thread",
+				  gpu, filename);
+	}
+
 	if (cgpu->work_size && cgpu->work_size <= clState->max_work_size)
 		clState->wsize = cgpu->work_size;
+	else if (clState->isCPU)
+		/* A CPU runs each work group as a loop on one core, small
+		 * groups spread a launch over all of them */
+		clState->wsize = clState->max_work_size < 64 ? clState->max_work_size : 64;
 	else
-		clState->wsize = 256;
+		clState->wsize = clState->max_work_size < 256 ? clState->max_work_size : 256;
 
 	if (!cgpu->opt_lg) {
 		applog(LOG_DEBUG, "GPU %d: selecting lookup gap of 2", gpu);
@@ -617,6 +691,13 @@ _clState *initCl(unsigned int gpu, char *name, size_t nameSize)
 			if (cgpu->thread_concurrency > cgpu->shaders * 5)
 				cgpu->thread_concurrency = cgpu->shaders * 5;
 		}
+		/* Cap at 64 scratchpads per compute unit (hardware thread)
+		 * rather than one: CPU runtimes vectorise several work items
+		 * per thread, and the scrypt kernels index their scratchpad
+		 * by gid % thread concurrency, so fewer would collide. More
+		 * only thrash the caches. */
+		if (clState->isCPU && cgpu->thread_concurrency > clState->compute_shaders)
+			cgpu->thread_concurrency = clState->compute_shaders;
 		applog(LOG_DEBUG, "GPU %d: selecting thread concurrency of %d", gpu, (int)(cgpu->thread_concurrency));
 	} else
 		cgpu->thread_concurrency = cgpu->opt_tc;
@@ -625,8 +706,17 @@ _clState *initCl(unsigned int gpu, char *name, size_t nameSize)
 	FILE *binaryfile;
 	size_t *binary_sizes;
 	char **binaries;
-	int pl;
-	char *source = file_contents(filename, &pl);
+	int pl = 0;
+	char *source;
+
+	/* filename is then only the head the generated source includes */
+	if (algo->flags & ALGO_GENERATED) {
+		source = chain_kernel_source(algorithm_chain(algo));
+		if (source)
+			pl = strlen(source);
+	} else
+		source = file_contents(filename, &pl);
+
 	size_t sourceSize[] = {(size_t)pl};
 	cl_uint slot, cpnd;
 
@@ -657,6 +747,20 @@ _clState *initCl(unsigned int gpu, char *name, size_t nameSize)
 	strcat(binaryfilename, numbuf);
 	sprintf(numbuf, "l%d", (int)sizeof(long));
 	strcat(binaryfilename, numbuf);
+	if (clState->npt > 1 && nonce_loop_supported(algo)) {
+		sprintf(numbuf, "n%u", clState->npt);
+		strcat(binaryfilename, numbuf);
+	}
+	if (clState->vwidth > 1) {
+		sprintf(numbuf, "v%u", clState->vwidth);
+		strcat(binaryfilename, numbuf);
+	}
+	if (clState->found != FOUND) {
+		sprintf(numbuf, "r%u", clState->found);
+		strcat(binaryfilename, numbuf);
+	}
+	if (clState->hashout)
+		strcat(binaryfilename, "h");
 	strcat(binaryfilename, ".bin");
 
 	binaryfile = fopen(binaryfilename, "rb");
@@ -714,23 +818,36 @@ build:
 	}
 
 	/* create a cl program executable for all the devices specified */
-	char *CompilerOptions = calloc(1, 256);
-
-	if (clState->chosen_kernel == KL_X13MODOLD)
-		sprintf(CompilerOptions, "-I \"%s\" -I \"%s\" -I \"%skernel\" -I \".\" -D LOOKUP_GAP=%d -D CONCURRENT_THREADS=%d -D WORKSIZE=%d -D X13MODOLD",
-			opt_kernel_path, sgminer_path, sgminer_path,
-			cgpu->lookup_gap, (unsigned int)cgpu->thread_concurrency, (int)clState->wsize);
-	else
-		sprintf(CompilerOptions, "-I \"%s\" -I \"%s\" -I \"%skernel\" -I \".\" -D LOOKUP_GAP=%d -D CONCURRENT_THREADS=%d -D WORKSIZE=%d",
-			opt_kernel_path, sgminer_path, sgminer_path,
-			cgpu->lookup_gap, (unsigned int)cgpu->thread_concurrency, (int)clState->wsize);
+	size_t optsize = strlen(opt_kernel_path) + strlen(sgminer_path) * 2 +
+			 (algo->options ? strlen(algo->options) : 0) + 256;
+	char *CompilerOptions = calloc(1, optsize);
+
+	if (unlikely(!CompilerOptions))
+		quit(1, "Failed to calloc CompilerOptions in initCl");
+	snprintf(CompilerOptions, optsize, "-I \"%s\" -I \"%s\" -I \"%skernel\" -I \".\" -D LOOKUP_GAP=%d -D CONCURRENT_THREADS=%d -D WORKSIZE=%d",
+		opt_kernel_path, sgminer_path, sgminer_path,
+		cgpu->lookup_gap, (unsigned int)cgpu->thread_concurrency, (int)clState->wsize);
+	if (algo->options)
+		add_compiler_option(CompilerOptions, optsize, "%s", algo->options);
 
 	applog(LOG_DEBUG, "Setting worksize to %d", (int)(clState->wsize));
-	if (clState->vwidth > 1)
-		applog(LOG_DEBUG, "Patched source to suit %d vectors", clState->vwidth);
+	if (clState->npt > 1 && nonce_loop_supported(algo)) {
+		add_compiler_option(CompilerOptions, optsize, " -D NONCES_PER_THREAD=%u", clState->npt);
+		applog(LOG_DEBUG, "Setting nonces per thread to %u", clState->npt);
+	}
+	if (clState->vwidth > 1) {
+		add_compiler_option(CompilerOptions, optsize, " -D VECTORS=%u", clState->vwidth);
+		applog(LOG_DEBUG, "Setting vectors to %u", clState->vwidth);
+	}
+	if (clState->found != FOUND) {
+		add_compiler_option(CompilerOptions, optsize, " -D FOUND=%u", clState->found);
+		applog(LOG_DEBUG, "Setting result slots to %u", clState->found);
+	}
+	if (clState->hashout)
+		add_compiler_option(CompilerOptions, optsize, " -D HASHOUT");
 
 	if (clState->hasBitAlign) {
-		strcat(CompilerOptions, " -D BITALIGN");
+		add_compiler_option(CompilerOptions, optsize, " -D BITALIGN");
 		applog(LOG_DEBUG, "cl_amd_media_ops found, setting BITALIGN");
 		if (!clState->hasOpenCL12plus &&
 		    (strstr(name, "Cedar") ||
@@ -751,16 +868,16 @@ build:
 		applog(LOG_DEBUG, "cl_amd_media_ops not found, will not set BITALIGN");
 
 	if (patchbfi) {
-		strcat(CompilerOptions, " -D BFI_INT");
+		add_compiler_option(CompilerOptions, optsize, " -D BFI_INT");
 		applog(LOG_DEBUG, "BFI_INT patch requiring device found, patched source with BFI_INT");
 	} else
 		applog(LOG_DEBUG, "BFI_INT patch requiring device not found, will not BFI_INT patch");
 
 	if (clState->goffset)
-		strcat(CompilerOptions, " -D GOFFSET");
+		add_compiler_option(CompilerOptions, optsize, " -D GOFFSET");
 
 	if (!clState->hasOpenCL11plus)
-		strcat(CompilerOptions, " -D OCL1");
+		add_compiler_option(CompilerOptions, optsize, " -D OCL1");
 
 	applog(LOG_DEBUG, "CompilerOptions: %s", CompilerOptions);
 	status = clBuildProgram(clState->program, 1, &devices[gpu], CompilerOptions , NULL, NULL);
@@ -887,8 +1004,8 @@ built:
 	free(binaries);
 	free(binary_sizes);
 
-	applog(LOG_INFO, "Initialising kernel %s with%s bitalign, %d vectors and worksize %d",
-	       filename, clState->hasBitAlign ? "" : "out", clState->vwidth, (int)(clState->wsize));
+	applogsiz(LOG_INFO, LOGBUFSIZ + sizeof(filename), "Initialising kernel %s with%s bitalign, %d vectors and worksize %d",
+		  filename, clState->hasBitAlign ? "" : "out", clState->vwidth, (int)(clState->wsize));
 
 	if (!prog_built) {
 		/* create a cl program executable for all the devices specified */
@@ -906,46 +1023,15 @@ built:
 	}
 
 	/* get a kernel object handle for a kernel with the given name */
-	if (clState->chosen_kernel == KL_X11MOD) {
-	    CL_CREATE_KERNEL(blake);
-	    CL_CREATE_KERNEL(bmw);
-	    CL_CREATE_KERNEL(groestl);
-	    CL_CREATE_KERNEL(skein);
-	    CL_CREATE_KERNEL(jh);
-	    CL_CREATE_KERNEL(keccak);
-	    CL_CREATE_KERNEL(luffa);
-	    CL_CREATE_KERNEL(cubehash);
-	    CL_CREATE_KERNEL(shavite);
-	    CL_CREATE_KERNEL(simd);
-	    CL_CREATE_KERNEL(echo);
-	}
-	else if (clState->chosen_kernel == KL_X13MOD) {
-	    CL_CREATE_KERNEL(blake);
-	    CL_CREATE_KERNEL(bmw);
-	    CL_CREATE_KERNEL(groestl);
-	    CL_CREATE_KERNEL(skein);
-	    CL_CREATE_KERNEL(jh);
-	    CL_CREATE_KERNEL(keccak);
-	    CL_CREATE_KERNEL(luffa);
-	    CL_CREATE_KERNEL(cubehash);
-	    CL_CREATE_KERNEL(shavite);
-	    CL_CREATE_KERNEL(simd);
-	    CL_CREATE_KERNEL(echo);
-	    CL_CREATE_KERNEL(hamsi);
-	    CL_CREATE_KERNEL(fugue);
-	}
-	else if (clState->chosen_kernel == KL_X13MODOLD) {
-	    CL_CREATE_KERNEL(blake);
-	    CL_CREATE_KERNEL(bmw);
-	    CL_CREATE_KERNEL(groestl);
-	    CL_CREATE_KERNEL(skein);
-	    CL_CREATE_KERNEL(jh);
-	    CL_CREATE_KERNEL(keccak);
-	    CL_CREATE_KERNEL(luffa);
-	    CL_CREATE_KERNEL(cubehash);
-	    CL_CREATE_KERNEL(shavite);
-	    CL_CREATE_KERNEL(simd);
-	    CL_CREATE_KERNEL(echo_hamsi_fugue);
+	if (algo->stages[0]) {
+	    clState->nstages = algorithm_stages(algo);
+	    for (i = 0; i < clState->nstages; i++) {
+		clState->stage[i] = clCreateKernel(clState->program, algo->stages[i], &status);
+		if (status != CL_SUCCESS) {
+		    applog(LOG_ERR, "Error %d: Creating Kernel %s from program. (clCreateKernel)", status, algo->stages[i]);
+		    return NULL;
+		}
+	    }
 	}
 	else {
 	    clState->kernel = clCreateKernel(clState->program, "search", &status);
@@ -955,7 +1041,7 @@ built:
 	    }
 	}
 
-	if ((cgpu->kernel == KL_X11MOD) || (cgpu->kernel == KL_X13MOD) || (cgpu->kernel == KL_X13MODOLD)) {
+	if (algo->stages[0]) {
 		if (!allocateHashBuffer(gpu, clState))
 			return NULL;
 	}
@@ -990,11 +1076,33 @@ built:
 		return NULL;
 	}
 
-	clState->outputBuffer = clCreateBuffer(clState->context, CL_MEM_WRITE_ONLY, BUFFERSIZE, NULL, &status);
-	if (status != CL_SUCCESS) {
-		applog(LOG_ERR, "Error %d: clCreateBuffer (outputBuffer)", status);
-		return NULL;
+	for (i = 0; i < clState->nqueues; i++) {
+		clState->output[i] = clCreateBuffer(clState->context, CL_MEM_READ_WRITE, clState->outsize, NULL, &status);
+		if (status != CL_SUCCESS) {
+			applog(LOG_ERR, "Error %d: clCreateBuffer (outputBuffer)", status);
+			return NULL;
+		}
 	}
+	clState->outputBuffer = clState->output[0];
+
+	/* Pinned host memory for the results, mapped for the life of the
+	 * device so reads of outputBuffer DMA straight into it. Without it
+	 * the driver stages every read through its own pinned copy. */
+	clState->outputPinned = clCreateBuffer(clState->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+					       clState->outsize * clState->nqueues, NULL, &status);
+	if (status == CL_SUCCESS) {
+		clState->outputMap = clEnqueueMapBuffer(clState->commandQueue, clState->outputPinned, CL_TRUE,
+							CL_MAP_READ | CL_MAP_WRITE, 0, clState->outsize * clState->nqueues,
+							0, NULL, NULL, &status);
+		if (status != CL_SUCCESS) {
+			clReleaseMemObject(clState->outputPinned);
+			clState->outputPinned = NULL;
+			clState->outputMap = NULL;
+		}
+	} else
+		clState->outputPinned = NULL;
+	if (!clState->outputMap)
+		applog(LOG_INFO, "Error %d: Mapping pinned result buffer, using pageable memory", status);
 
 
 
@@ -11,45 +11,59 @@
 #endif
 
 #include "miner.h"
+#include "algorithm.h"
+
+/* Most command queues per GPU thread with --gpu-queues */
+#define MAX_GPU_QUEUES 10
+
+/* Most nonces per work item with --nonces-per-thread */
+#define MAX_NONCES_PER_THREAD 64
 
 typedef struct {
 	cl_context context;
 	cl_kernel kernel;
-	cl_kernel kernel_blake;
-	cl_kernel kernel_bmw;
-	cl_kernel kernel_groestl;
-	cl_kernel kernel_skein;
-	cl_kernel kernel_jh;
-	cl_kernel kernel_keccak;
-	cl_kernel kernel_luffa;
-	cl_kernel kernel_cubehash;
-	cl_kernel kernel_shavite;
-	cl_kernel kernel_simd;
-	cl_kernel kernel_echo;
-	cl_kernel kernel_hamsi;
-	cl_kernel kernel_fugue;
-	cl_kernel kernel_echo_hamsi_fugue;
+	/* Kernels of algorithm->stages, in place of kernel */
+	cl_kernel stage[MAX_KERNEL_STAGES];
+	unsigned int nstages;
 	cl_command_queue commandQueue;
+	/* Queues splitting each launch, queue[0] is commandQueue and
+	 * output[0] is outputBuffer */
+	unsigned int nqueues;
+	cl_command_queue queue[MAX_GPU_QUEUES];
+	cl_mem output[MAX_GPU_QUEUES];
 	cl_program program;
 	cl_mem outputBuffer;
+	cl_mem outputPinned;
+	uint32_t *outputMap;
+	/* Result slots of each output buffer, the counter follows them */
+	cl_uint found;
+	size_t outsize;
+	bool hashout;
 	cl_mem CLbuffer0;
         cl_mem hash_buffer;
 	cl_mem padbuffer8;
 	size_t padbufsize;
-	unsigned char cldata[80];
+	unsigned char cldata[112];
 	bool hasBitAlign;
 	bool hasOpenCL11plus;
 	bool hasOpenCL12plus;
 	bool goffset;
+	bool hasProfiling;
+	bool isCPU;
 	cl_uint vwidth;
+	/* Nonces each work item covers per launch */
+	cl_uint npt;
 	size_t max_work_size;
 	size_t wsize;
 	size_t compute_shaders;
+	size_t max_threads;
 	enum cl_kernels chosen_kernel;
+	const struct algorithm *algorithm;
 } _clState;
 
 extern char *file_contents(const char *filename, int *length);
 extern int clDevicesNum(void);
+extern bool clDeviceInfo(unsigned int gpu, char *name, size_t nameSize, char *driver, size_t driverSize);
 extern _clState *initCl(unsigned int gpu, char *name, size_t nameSize);
 extern bool allocateHashBuffer(unsigned int gpu, _clState *clState);
 #endif /* __OCL_H__ */
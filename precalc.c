@@ -0,0 +1,212 @@
+/*
+ * Copyright 2014 sgminer developers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+/*
+ * The sph kernels hash an 80-byte block header in which only the last word,
+ * the nonce, differs between work items. Whatever the first hash function
+ * does before it reads that word is done here, once per work, and handed to
+ * the kernel in blk->sph_state:
+ *
+ * Blake-512:   V0-VF after the column step of round 0 and the first half of
+ *              the next G, which only reads M8 (16 ulongs)
+ * SHAvite-512: rk00-rk0F of round 1 (16 uints), then p0-p3 and pC-pF after
+ *              the left halves of rounds 0 and 1 (8 uints)
+ * Luffa-512:   V00-V47 after the first two 32-byte message blocks (40 uints)
+ * Fugue-256:   S00-S29 after the first 19 words (30 uints)
+ *
+ * Groestl-512 and BMW-512 take the header as a single block that includes
+ * the nonce, so the kernels starting with them get nothing.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "miner.h"
+#include "precalc.h"
+#include "algorithm.h"
+
+#include "sph/sph_luffa.h"
+#include "sph/sph_fugue.h"
+
+#define AES_BIG_ENDIAN 0
+#include "sph/aes_helper.c"
+
+static const sph_u64 blake512_iv[8] = {
+	SPH_C64(0x6A09E667F3BCC908), SPH_C64(0xBB67AE8584CAA73B),
+	SPH_C64(0x3C6EF372FE94F82B), SPH_C64(0xA54FF53A5F1D36F1),
+	SPH_C64(0x510E527FADE682D1), SPH_C64(0x9B05688C2B3E6C1F),
+	SPH_C64(0x1F83D9ABFB41BD6B), SPH_C64(0x5BE0CD19137E2179)
+};
+
+static const sph_u64 blake512_cb[16] = {
+	SPH_C64(0x243F6A8885A308D3), SPH_C64(0x13198A2E03707344),
+	SPH_C64(0xA4093822299F31D0), SPH_C64(0x082EFA98EC4E6C89),
+	SPH_C64(0x452821E638D01377), SPH_C64(0xBE5466CF34E90C6C),
+	SPH_C64(0xC0AC29B7C97C50DD), SPH_C64(0x3F84D5B5B5470917),
+	SPH_C64(0x9216D5D98979FB1B), SPH_C64(0xD1310BA698DFB5AC),
+	SPH_C64(0x2FFD72DBD01ADFB7), SPH_C64(0xB8E1AFED6A267E96),
+	SPH_C64(0xBA7C9045F12C7F99), SPH_C64(0x24A19947B3916CF7),
+	SPH_C64(0x0801F2E2858EFC16), SPH_C64(0x636920D871574E69)
+};
+
+static const sph_u32 shavite512_iv[16] = {
+	SPH_C32(0x72FCCDD8), SPH_C32(0x79CA4727), SPH_C32(0x128A077B), SPH_C32(0x40D55AEC),
+	SPH_C32(0xD1901A06), SPH_C32(0x430AE307), SPH_C32(0xB29F5CD1), SPH_C32(0xDF07FBFC),
+	SPH_C32(0x8E45D73D), SPH_C32(0x681AB538), SPH_C32(0xBDE86578), SPH_C32(0xDD577E47),
+	SPH_C32(0xE275EADE), SPH_C32(0x502D9FCD), SPH_C32(0xB9357178), SPH_C32(0x022A4B9A)
+};
+
+static void blake512_g(sph_u64 *v, int a, int b, int c, int d,
+		       sph_u64 m0, sph_u64 m1, sph_u64 c0, sph_u64 c1)
+{
+	v[a] = SPH_T64(v[a] + v[b] + (m0 ^ c1));
+	v[d] = SPH_ROTR64(v[d] ^ v[a], 32);
+	v[c] = SPH_T64(v[c] + v[d]);
+	v[b] = SPH_ROTR64(v[b] ^ v[c], 25);
+	v[a] = SPH_T64(v[a] + v[b] + (m1 ^ c0));
+	v[d] = SPH_ROTR64(v[d] ^ v[a], 16);
+	v[c] = SPH_T64(v[c] + v[d]);
+	v[b] = SPH_ROTR64(v[b] ^ v[c], 11);
+}
+
+void precalc_blake512(dev_blk_ctx *blk, const unsigned char *data)
+{
+	const sph_u64 *cb = blake512_cb;
+	const sph_u64 t0 = 80 << 3;
+	sph_u64 m[9], v[16];
+	int i;
+
+	for (i = 0; i < 9; i++)
+		m[i] = sph_dec64be(data + i * 8);
+
+	/* Salt is zero and the 640 bit counter fits in T0 */
+	for (i = 0; i < 8; i++)
+		v[i] = blake512_iv[i];
+	for (i = 8; i < 12; i++)
+		v[i] = cb[i - 8];
+	v[12] = t0 ^ cb[4];
+	v[13] = t0 ^ cb[5];
+	v[14] = cb[6];
+	v[15] = cb[7];
+
+	blake512_g(v, 0, 4,  8, 12, m[0], m[1], cb[0], cb[1]);
+	blake512_g(v, 1, 5,  9, 13, m[2], m[3], cb[2], cb[3]);
+	blake512_g(v, 2, 6, 10, 14, m[4], m[5], cb[4], cb[5]);
+	blake512_g(v, 3, 7, 11, 15, m[6], m[7], cb[6], cb[7]);
+
+	v[0] = SPH_T64(v[0] + v[5] + (m[8] ^ cb[9]));
+	v[15] = SPH_ROTR64(v[15] ^ v[0], 32);
+	v[10] = SPH_T64(v[10] + v[15]);
+	v[5] = SPH_ROTR64(v[5] ^ v[10], 25);
+
+	memcpy(blk->sph_state, v, sizeof(v));
+}
+
+static void shavite512_aes(sph_u32 *x)
+{
+	sph_u32 t0 = x[0], t1 = x[1], t2 = x[2], t3 = x[3];
+
+	AES_ROUND_NOKEY_LE(t0, t1, t2, t3, x[0], x[1], x[2], x[3]);
+}
+
+/* KEY_EXPAND_ELT of sph's shavite.c */
+static void shavite512_key_expand(sph_u32 *k)
+{
+	sph_u32 x[4] = { k[1], k[2], k[3], k[0] };
+
+	shavite512_aes(x);
+	memcpy(k, x, sizeof(x));
+}
+
+/* The left half of a round: x = F(in ^ rk[0..15]), out ^= x */
+static void shavite512_half(const sph_u32 *in, const sph_u32 *rk, sph_u32 *out)
+{
+	sph_u32 x[4];
+	int i, j;
+
+	for (j = 0; j < 4; j++)
+		x[j] = in[j] ^ rk[j];
+	shavite512_aes(x);
+	for (i = 4; i < 16; i += 4) {
+		for (j = 0; j < 4; j++)
+			x[j] ^= rk[i + j];
+		shavite512_aes(x);
+	}
+	for (j = 0; j < 4; j++)
+		out[j] ^= x[j];
+}
+
+void precalc_shavite512(dev_blk_ctx *blk, const unsigned char *data)
+{
+	/* Message words 28-31 are the bit count and digest size */
+	const sph_u32 rk1c[4] = { 0, 0, 0, 0x2000000 };
+	const sph_u32 count[4] = { 80 << 3, 0, 0, 0 };
+	sph_u32 p[16], rk[16];
+	int i, j;
+
+	memcpy(p, shavite512_iv, sizeof(p));
+	for (i = 0; i < 16; i++)
+		rk[i] = sph_dec32le(data + i * 4);
+
+	/* round 0, p0-p3 ^= F(p4-p7) */
+	shavite512_half(p + 4, rk, p);
+
+	/* round 1, expanding rk00-rk0F on the way, pC-pF ^= F(p0-p3) */
+	shavite512_key_expand(rk);
+	for (j = 0; j < 4; j++)
+		rk[j] ^= rk1c[j];
+	rk[0] ^= count[0];
+	rk[1] ^= count[1];
+	rk[2] ^= count[2];
+	rk[3] ^= SPH_T32(~count[3]);
+	for (i = 4; i < 16; i += 4) {
+		shavite512_key_expand(rk + i);
+		for (j = 0; j < 4; j++)
+			rk[i + j] ^= rk[i + j - 4];
+	}
+	shavite512_half(p, rk, p + 12);
+
+	memcpy(blk->sph_state, rk, sizeof(rk));
+	memcpy(blk->sph_state + 16, p, sizeof(sph_u32) * 4);
+	memcpy(blk->sph_state + 20, p + 12, sizeof(sph_u32) * 4);
+}
+
+void precalc_luffa512(dev_blk_ctx *blk, const unsigned char *data)
+{
+	sph_luffa512_context ctx;
+
+	sph_luffa512_init(&ctx);
+	sph_luffa512(&ctx, data, 64);
+	memcpy(blk->sph_state, ctx.V, sizeof(ctx.V));
+}
+
+void precalc_fugue256(dev_blk_ctx *blk, const unsigned char *data)
+{
+	sph_fugue256_context ctx;
+
+	/* sph holds back the last full word until more data arrives, so
+	 * passing the whole header absorbs exactly the first 19 words */
+	sph_fugue256_init(&ctx);
+	sph_fugue256(&ctx, data, 80);
+	memcpy(blk->sph_state, ctx.S, sizeof(sph_u32) * 30);
+}
+
+/* Fill in blk->sph_state for the kernels that take it, from the header the
+ * kernels see in CLbuffer0 */
+void precalc_sph(const struct algorithm *algo, dev_blk_ctx *blk)
+{
+	unsigned char data[80];
+
+	if (!algo->precalc)
+		return;
+	flip80(data, blk->work->data);
+	algo->precalc(blk, data);
+}
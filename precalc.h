@@ -0,0 +1,14 @@
+#ifndef __PRECALC_H__
+#define __PRECALC_H__
+
+#include "miner.h"
+
+struct algorithm;
+
+extern void precalc_blake512(dev_blk_ctx *blk, const unsigned char *data);
+extern void precalc_shavite512(dev_blk_ctx *blk, const unsigned char *data);
+extern void precalc_luffa512(dev_blk_ctx *blk, const unsigned char *data);
+extern void precalc_fugue256(dev_blk_ctx *blk, const unsigned char *data);
+extern void precalc_sph(const struct algorithm *algo, dev_blk_ctx *blk);
+
+#endif /* __PRECALC_H__ */
@@ -0,0 +1,781 @@
+/*
+ * Copyright 2014 sgminer developers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+/*
+ * With --stratum-proxy PORT sgminer serves stratum to other miners, relaying
+ * the jobs of the current pool and forwarding their shares over its own
+ * connection to it. Each client is given the pool's nonce1 followed by a
+ * prefix of the pool's nonce2 as its extranonce1, the rest of nonce2 being
+ * its extranonce2. Prefix 0 belongs to the local devices, whose nonce2 steps
+ * over the prefix bytes in gen_stratum_work.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#ifndef WIN32
+#include <fcntl.h>
+#endif
+
+#include "compat.h"
+#include "miner.h"
+#include "util.h"
+#include "uthash.h"
+#include "proxy.h"
+
+#define PROXY_LINE 4096
+#define PROXY_MAX_CLIENTS 256
+
+struct proxy_client {
+	struct proxy_client *next;
+	SOCKETTYPE sock;
+	unsigned int cid;
+	int prefix;
+	bool subscribed;
+	/* Set by any thread failing to send to it, closed by the proxy thread */
+	bool dead;
+	char buf[PROXY_LINE];
+	size_t len;
+};
+
+/* A share forwarded upstream and the client waiting for its answer */
+struct proxy_share {
+	UT_hash_handle hh;
+	int id;
+	unsigned int cid;
+	char *client_id;
+};
+
+extern double opt_diff_mult;
+
+int opt_stratum_proxy;
+char *opt_stratum_proxy_allow;
+
+/* Parsed --stratum-proxy-allow, only used by the proxy thread */
+struct proxy_allow {
+	in_addr_t ip;
+	in_addr_t mask;
+};
+
+static struct proxy_allow *proxy_allows;
+static int proxy_allow_count;
+
+/* Protects everything below. Only the proxy thread adds or removes clients. */
+static pthread_mutex_t proxy_lock;
+static struct proxy_client *clients;
+static struct proxy_share *proxy_shares;
+static unsigned int next_cid;
+static int next_prefix;
+/* Forwarded shares count down so they never collide with our own */
+static int next_share_id = -1;
+/* The pool and session clients hold extranonces for, with its latest
+ * difficulty and job lines to start new clients on */
+static struct pool *proxy_pool;
+static char *proxy_nonce1;
+static char *proxy_diff, *proxy_notify;
+
+/* Bytes of nonce2 handed out as client prefixes, 0 when not proxying. Two
+ * bytes leave 65535 clients at least two bytes of their own. */
+int stratum_proxy_prefix_len(const struct pool *pool)
+{
+	if (!opt_stratum_proxy)
+		return 0;
+	if (pool->n2size >= 4)
+		return 2;
+	if (pool->n2size >= 2)
+		return 1;
+	return 0;
+}
+
+/* Must be called with proxy_lock held. Client sockets are non-blocking so a
+ * client that stops reading is dropped instead of stalling the pool's reader
+ * relaying to it. */
+static void client_send(struct proxy_client *client, const char *s, size_t len)
+{
+	if (client->dead)
+		return;
+	while (len) {
+		ssize_t sent;
+
+#ifdef __APPLE__
+		sent = send(client->sock, s, len, SO_NOSIGPIPE);
+#elif WIN32
+		sent = send(client->sock, s, len, 0);
+#else
+		sent = send(client->sock, s, len, MSG_NOSIGNAL);
+#endif
+		if (sent <= 0) {
+			if (sent < 0 && sock_blocks())
+				applog(LOG_INFO, "Stratum proxy client %u not keeping up, dropping", client->cid);
+			else
+				applog(LOG_INFO, "Stratum proxy client %u send failed, dropping", client->cid);
+			client->dead = true;
+			return;
+		}
+		s += sent;
+		len -= sent;
+	}
+}
+
+static struct proxy_client *find_client(unsigned int cid)
+{
+	struct proxy_client *client;
+
+	for (client = clients; client; client = client->next) {
+		if (client->cid == cid)
+			return client;
+	}
+	return NULL;
+}
+
+/* Answers request id of client cid, if it is still connected */
+static void proxy_reply(unsigned int cid, const char *id, const char *result,
+			const char *error)
+{
+	struct proxy_client *client;
+	char s[PROXY_LINE];
+	int len;
+
+	len = snprintf(s, sizeof(s), "{\"id\": %s, \"result\": %s, \"error\": %s}\n",
+		       id ? id : "null", result, error);
+	if (len >= (int)sizeof(s))
+		return;
+	mutex_lock(&proxy_lock);
+	client = find_client(cid);
+	if (client)
+		client_send(client, s, len);
+	mutex_unlock(&proxy_lock);
+}
+
+static void client_reply(struct proxy_client *client, const char *id, const char *result,
+			 const char *error)
+{
+	proxy_reply(client->cid, id, result, error);
+}
+
+/* Copies line with a newline onto *cache */
+static void proxy_cache(char **cache, const char *line)
+{
+	size_t len = strlen(line);
+
+	free(*cache);
+	*cache = malloc(len + 2);
+	if (unlikely(!*cache))
+		quit(1, "Failed to malloc stratum proxy cache");
+	memcpy(*cache, line, len);
+	strcpy(*cache + len, "\n");
+}
+
+/* Passes the current pool's jobs and difficulty changes on to the clients */
+void stratum_proxy_relay(struct pool *pool, const char *s)
+{
+	struct proxy_client *client;
+	struct stratum_msg msg;
+	char **cache;
+
+	if (pool != proxy_pool || !stratum_fast_parse(s, &msg))
+		return;
+	if (span_is(&msg.method, "mining.notify"))
+		cache = &proxy_notify;
+	else if (span_is(&msg.method, "mining.set_difficulty"))
+		cache = &proxy_diff;
+	else
+		return;
+
+	mutex_lock(&proxy_lock);
+	if (pool == proxy_pool) {
+		proxy_cache(cache, s);
+		for (client = clients; client; client = client->next) {
+			if (client->subscribed)
+				client_send(client, *cache, strlen(*cache));
+		}
+	}
+	mutex_unlock(&proxy_lock);
+}
+
+/* Answers the client a forwarded share came from, returning false if id is
+ * not one of ours */
+bool stratum_proxy_response(int id, json_t *res_val, json_t *err_val)
+{
+	struct proxy_share *pshare;
+	char *res, *err;
+
+	mutex_lock(&proxy_lock);
+	HASH_FIND_INT(proxy_shares, &id, pshare);
+	if (pshare)
+		HASH_DEL(proxy_shares, pshare);
+	mutex_unlock(&proxy_lock);
+	if (!pshare)
+		return false;
+
+	res = res_val ? json_dumps(res_val, JSON_COMPACT | JSON_ENCODE_ANY) : NULL;
+	err = err_val ? json_dumps(err_val, JSON_COMPACT | JSON_ENCODE_ANY) : NULL;
+	applog(LOG_INFO, "Stratum proxy client %u share %s", pshare->cid,
+	       json_is_true(res_val) ? "accepted" : "rejected");
+
+	proxy_reply(pshare->cid, pshare->client_id, res ? res : "null", err ? err : "null");
+
+	free(res);
+	free(err);
+	free(pshare->client_id);
+	free(pshare);
+	return true;
+}
+
+static void prefix_hex(char *hex, int prefix, int prefix_len)
+{
+	int i;
+
+	/* nonce2 goes into the coinbase little endian */
+	for (i = 0; i < prefix_len; i++)
+		sprintf(hex + i * 2, "%02x", (prefix >> (i * 8)) & 0xff);
+}
+
+/* A prefix no other client has, 0 if they have all been given out. Must be
+ * called with proxy_lock held. */
+static int new_prefix(int prefix_len)
+{
+	int max = 1 << (prefix_len * 8), i;
+
+	for (i = 1; i < max; i++) {
+		struct proxy_client *client;
+
+		if (++next_prefix >= max)
+			next_prefix = 1;
+		for (client = clients; client; client = client->next) {
+			if (client->prefix == next_prefix)
+				break;
+		}
+		if (!client)
+			return next_prefix;
+	}
+	return 0;
+}
+
+static void client_subscribe(struct proxy_client *client, const char *id)
+{
+	char s[PROXY_LINE], prefix[5];
+	int prefix_len, n2size, len;
+	struct pool *pool;
+
+	mutex_lock(&proxy_lock);
+	pool = proxy_pool;
+	if (!pool || !proxy_nonce1) {
+		mutex_unlock(&proxy_lock);
+		client_reply(client, id, "null", "[20, \"No upstream pool\", null]");
+		return;
+	}
+	cg_rlock(&pool->data_lock);
+	n2size = pool->n2size;
+	cg_runlock(&pool->data_lock);
+	prefix_len = stratum_proxy_prefix_len(pool);
+	if (!client->prefix)
+		client->prefix = new_prefix(prefix_len);
+	if (!client->prefix) {
+		mutex_unlock(&proxy_lock);
+		client_reply(client, id, "null", "[20, \"No extranonce left\", null]");
+		return;
+	}
+	prefix_hex(prefix, client->prefix, prefix_len);
+	len = snprintf(s, sizeof(s),
+		       "{\"id\": %s, \"result\": [[[\"mining.notify\", \"%x\"]], \"%s%s\", %d], \"error\": null}\n",
+		       id ? id : "null", client->cid, proxy_nonce1, prefix, n2size - prefix_len);
+	client_send(client, s, len);
+	client->subscribed = true;
+	if (proxy_diff)
+		client_send(client, proxy_diff, strlen(proxy_diff));
+	if (proxy_notify)
+		client_send(client, proxy_notify, strlen(proxy_notify));
+	mutex_unlock(&proxy_lock);
+
+	applog(LOG_INFO, "Stratum proxy client %u subscribed with extranonce %s%s",
+	       client->cid, proxy_nonce1, prefix);
+}
+
+/* Share fields are copied into upstream JSON so must not be able to end
+ * their string */
+static bool proxy_safe(const char *s)
+{
+	if (!s || strlen(s) > 128)
+		return false;
+	for (; *s; s++) {
+		if (*s < ' ' || *s == '"' || *s == '\\')
+			return false;
+	}
+	return true;
+}
+
+static void client_submit(struct proxy_client *client, const char *id, json_t *params)
+{
+	const char *job_id, *nonce2, *ntime, *nonce;
+	char s[PROXY_LINE], prefix[5];
+	struct proxy_share *pshare;
+	int prefix_len, n2size, len, share_id;
+	struct pool *pool;
+
+	job_id = json_string_value(json_array_get(params, 1));
+	nonce2 = json_string_value(json_array_get(params, 2));
+	ntime = json_string_value(json_array_get(params, 3));
+	nonce = json_string_value(json_array_get(params, 4));
+	if (!client->subscribed || !proxy_safe(job_id) || !proxy_safe(nonce2) ||
+	    !proxy_safe(ntime) || !proxy_safe(nonce)) {
+		client_reply(client, id, "null", "[20, \"Invalid share\", null]");
+		return;
+	}
+
+	pshare = calloc(sizeof(struct proxy_share), 1);
+	if (unlikely(!pshare))
+		quit(1, "Failed to calloc proxy share");
+	pshare->cid = client->cid;
+	pshare->client_id = strdup(id ? id : "null");
+
+	mutex_lock(&proxy_lock);
+	pool = proxy_pool;
+	if (!pool || !proxy_nonce1) {
+		mutex_unlock(&proxy_lock);
+		free(pshare->client_id);
+		free(pshare);
+		client_reply(client, id, "null", "[20, \"No upstream pool\", null]");
+		return;
+	}
+	cg_rlock(&pool->data_lock);
+	n2size = pool->n2size;
+	cg_runlock(&pool->data_lock);
+	prefix_len = stratum_proxy_prefix_len(pool);
+	if ((int)strlen(nonce2) != (n2size - prefix_len) * 2) {
+		mutex_unlock(&proxy_lock);
+		free(pshare->client_id);
+		free(pshare);
+		client_reply(client, id, "null", "[20, \"Invalid extranonce2 size\", null]");
+		return;
+	}
+	prefix_hex(prefix, client->prefix, prefix_len);
+	share_id = pshare->id = next_share_id--;
+	if (next_share_id == INT_MIN)
+		next_share_id = -1;
+	HASH_ADD_INT(proxy_shares, id, pshare);
+	mutex_unlock(&proxy_lock);
+
+	len = snprintf(s, sizeof(s),
+		       "{\"params\": [\"%s\", \"%s\", \"%s%s\", \"%s\", \"%s\"], \"id\": %d, \"method\": \"mining.submit\"}\n",
+		       pool->rpc_user, job_id, prefix, nonce2, ntime, nonce, share_id);
+	applog(LOG_INFO, "Stratum proxy forwarding share from client %u to %s",
+	       client->cid, pool->poolname);
+	if (len < (int)sizeof(s) && stratum_send_lines(pool, s, len))
+		return;
+
+	/* pshare is only freed by whoever takes it out of the table */
+	mutex_lock(&proxy_lock);
+	HASH_FIND_INT(proxy_shares, &share_id, pshare);
+	if (pshare)
+		HASH_DEL(proxy_shares, pshare);
+	mutex_unlock(&proxy_lock);
+	if (pshare) {
+		free(pshare->client_id);
+		free(pshare);
+	}
+	client_reply(client, id, "null", "[20, \"Upstream pool unavailable\", null]");
+}
+
+static void client_message(struct proxy_client *client, const char *line)
+{
+	json_t *val, *id_val;
+	const char *method;
+	json_error_t err;
+	char *id = NULL;
+
+	val = JSON_LOADS(line, &err);
+	if (!val) {
+		applog(LOG_INFO, "Stratum proxy client %u JSON decode failed(%d): %s",
+		       client->cid, err.line, err.text);
+		return;
+	}
+	id_val = json_object_get(val, "id");
+	if (id_val)
+		id = json_dumps(id_val, JSON_COMPACT | JSON_ENCODE_ANY);
+	method = json_string_value(json_object_get(val, "method"));
+
+	if (!method)
+		applog(LOG_DEBUG, "Stratum proxy client %u sent no method", client->cid);
+	else if (!strcmp(method, "mining.subscribe"))
+		client_subscribe(client, id);
+	else if (!strcmp(method, "mining.authorize"))
+		client_reply(client, id, "true", "null");
+	else if (!strcmp(method, "mining.submit"))
+		client_submit(client, id, json_object_get(val, "params"));
+	else
+		client_reply(client, id, "null", "[20, \"Not supported\", null]");
+
+	free(id);
+	json_decref(val);
+}
+
+/* Reads what the client has sent, handling each complete line */
+static void client_read(struct proxy_client *client)
+{
+	char *eol, *line;
+	ssize_t n;
+
+	n = recv(client->sock, client->buf + client->len, sizeof(client->buf) - 1 - client->len, 0);
+	if (n < 0 && sock_blocks())
+		return;
+	if (n <= 0) {
+		applog(LOG_INFO, "Stratum proxy client %u disconnected", client->cid);
+		client->dead = true;
+		return;
+	}
+	client->len += n;
+	client->buf[client->len] = '\0';
+
+	line = client->buf;
+	while ((eol = strchr(line, '\n'))) {
+		*eol = '\0';
+		if (eol > line)
+			client_message(client, line);
+		line = eol + 1;
+	}
+	client->len -= line - client->buf;
+	memmove(client->buf, line, client->len);
+	if (client->len == sizeof(client->buf) - 1) {
+		applog(LOG_INFO, "Stratum proxy client %u line too long, dropping", client->cid);
+		client->dead = true;
+	}
+}
+
+/* The current pool's job as a notify line, so clients starting on a new pool
+ * need not wait for it to send one. Must be called with data_lock held. */
+static char *proxy_swork_notify(struct pool *pool)
+{
+	int cb1_len = pool->nonce2_offset - pool->n1_len;
+	int cb2_start = pool->nonce2_offset + pool->n2size;
+	char *cb1, *cb2, *s, *merkles;
+	size_t len;
+	int i;
+
+	if (!pool->coinbase || !pool->swork.job_id)
+		return NULL;
+	merkles = calloc(pool->swork.merkles * 68 + 1, 1);
+	if (unlikely(!merkles))
+		quit(1, "Failed to calloc merkles in proxy_swork_notify");
+	for (i = 0; i < pool->swork.merkles; i++) {
+		char *merkle = bin2hex(pool->swork.merkle_bin[i], 32);
+
+		sprintf(merkles + strlen(merkles), "%s\"%s\"", i ? ", " : "", merkle);
+		free(merkle);
+	}
+	cb1 = bin2hex(pool->coinbase, cb1_len);
+	cb2 = bin2hex(pool->coinbase + cb2_start, pool->swork.cb_len - cb2_start);
+	len = strlen(cb1) + strlen(cb2) + strlen(merkles) + strlen(pool->swork.job_id) + 256;
+	s = malloc(len);
+	if (unlikely(!s))
+		quit(1, "Failed to malloc s in proxy_swork_notify");
+	snprintf(s, len, "{\"params\": [\"%s\", \"%s\", \"%s\", \"%s\", [%s], \"%s\", \"%s\", \"%s\", true], \"id\": null, \"method\": \"mining.notify\"}",
+		 pool->swork.job_id, pool->swork.prev_hash, cb1, cb2, merkles,
+		 pool->swork.bbversion, pool->swork.nbit, pool->swork.ntime);
+	free(cb1);
+	free(cb2);
+	free(merkles);
+	return s;
+}
+
+/* Follows the current pool. Clients hold extranonces for the old pool or
+ * session so they are dropped to subscribe again. */
+static void proxy_upstream(void)
+{
+	struct pool *pool = current_pool();
+	struct proxy_share *pshare, *tmp;
+	struct proxy_client *client;
+	char *nonce1 = NULL, *notify = NULL, diff[128];
+	bool ready;
+
+	/* proxy_pool and proxy_nonce1 only change in this thread */
+	cg_rlock(&pool->data_lock);
+	ready = pool->has_stratum && pool->stratum_active && pool->stratum_notify &&
+		pool->nonce1 && stratum_proxy_prefix_len(pool);
+	if (pool == proxy_pool && (ready ? proxy_nonce1 && !strcmp(pool->nonce1, proxy_nonce1) :
+				   !proxy_nonce1)) {
+		cg_runlock(&pool->data_lock);
+		return;
+	}
+	if (ready) {
+		nonce1 = strdup(pool->nonce1);
+		notify = proxy_swork_notify(pool);
+		snprintf(diff, sizeof(diff), "{\"params\": [%f], \"id\": null, \"method\": \"mining.set_difficulty\"}",
+			 pool->swork.diff / opt_diff_mult);
+	}
+	cg_runlock(&pool->data_lock);
+
+	mutex_lock(&proxy_lock);
+	for (client = clients; client; client = client->next)
+		client->dead = true;
+	HASH_ITER(hh, proxy_shares, pshare, tmp) {
+		HASH_DEL(proxy_shares, pshare);
+		free(pshare->client_id);
+		free(pshare);
+	}
+	free(proxy_nonce1);
+	proxy_nonce1 = nonce1;
+	proxy_pool = pool;
+	free(proxy_diff);
+	free(proxy_notify);
+	proxy_diff = proxy_notify = NULL;
+	if (nonce1)
+		proxy_cache(&proxy_diff, diff);
+	if (notify)
+		proxy_cache(&proxy_notify, notify);
+	mutex_unlock(&proxy_lock);
+	free(notify);
+
+	if (nonce1)
+		applog(LOG_NOTICE, "Stratum proxy relaying %s", pool->poolname);
+	else
+		applog(LOG_NOTICE, "Stratum proxy waiting for a stratum pool");
+}
+
+static void reap_clients(void)
+{
+	struct proxy_client **prev = &clients, *client;
+
+	mutex_lock(&proxy_lock);
+	while ((client = *prev)) {
+		if (client->dead) {
+			*prev = client->next;
+			CLOSESOCKET(client->sock);
+			free(client);
+		} else
+			prev = &client->next;
+	}
+	mutex_unlock(&proxy_lock);
+}
+
+/*
+ * Interpret IP[/Prefix][,IP2[/Prefix2][,...]] --stratum-proxy-allow option
+ *	the same way as --api-allow, 0/0 allowing all IP addresses
+ */
+static void setup_proxy_allow(void)
+{
+	char *buf, *ptr, *comma, *slash, *dot;
+	int count, mask, octet, i;
+
+	buf = strdup(opt_stratum_proxy_allow);
+	if (unlikely(!buf))
+		quit(1, "Failed to strdup stratum proxy allow buf");
+
+	count = 1;
+	for (ptr = buf; *ptr; ptr++) {
+		if (*ptr == ',')
+			count++;
+	}
+
+	proxy_allows = calloc(count, sizeof(struct proxy_allow));
+	if (unlikely(!proxy_allows))
+		quit(1, "Failed to calloc stratum proxy allows");
+
+	proxy_allow_count = 0;
+	ptr = buf;
+	while (ptr && *ptr) {
+		struct proxy_allow *allow = &proxy_allows[proxy_allow_count];
+
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+		comma = strchr(ptr, ',');
+		if (comma)
+			*(comma++) = '\0';
+		if (!*ptr)
+			goto next;
+
+		if (strcmp(ptr, "0/0") == 0)
+			allow->ip = allow->mask = 0;
+		else {
+			slash = strchr(ptr, '/');
+			if (!slash)
+				allow->mask = 0xffffffff;
+			else {
+				*(slash++) = '\0';
+				mask = atoi(slash);
+				if (mask < 1 || mask > 32)
+					goto next; // skip invalid/zero
+				allow->mask = 0xffffffff << (32 - mask);
+			}
+
+			allow->ip = 0; // missing default to '.0'
+			for (i = 0; ptr && i < 4; i++) {
+				dot = strchr(ptr, '.');
+				if (dot)
+					*(dot++) = '\0';
+				octet = atoi(ptr);
+				if (octet < 0 || octet > 0xff)
+					goto next; // skip invalid
+				allow->ip |= (octet << (24 - (i * 8)));
+				ptr = dot;
+			}
+			allow->ip &= allow->mask;
+		}
+		proxy_allow_count++;
+next:
+		ptr = comma;
+	}
+
+	free(buf);
+}
+
+/* Without --stratum-proxy-allow the listener is only bound to localhost */
+static bool proxy_allowed(struct sockaddr_in *cli)
+{
+	in_addr_t client_ip = ntohl(cli->sin_addr.s_addr);
+	int i;
+
+	if (!opt_stratum_proxy_allow)
+		return true;
+	for (i = 0; i < proxy_allow_count; i++) {
+		if ((client_ip & proxy_allows[i].mask) == proxy_allows[i].ip)
+			return true;
+	}
+	return false;
+}
+
+static void new_client(SOCKETTYPE listener)
+{
+	struct proxy_client *client, *last;
+	struct sockaddr_in cli;
+	socklen_t clisiz = sizeof(cli);
+	SOCKETTYPE sock;
+	int count = 0;
+#ifndef WIN32
+	int flags;
+#else
+	u_long flags = 1;
+#endif
+
+	sock = accept(listener, (struct sockaddr *)&cli, &clisiz);
+	if (SOCKETFAIL(sock))
+		return;
+	if (!proxy_allowed(&cli)) {
+		applog(LOG_WARNING, "Stratum proxy refusing %s, not in --stratum-proxy-allow",
+		       inet_ntoa(cli.sin_addr));
+		CLOSESOCKET(sock);
+		return;
+	}
+	for (last = clients; last && last->next; last = last->next)
+		count++;
+	if (count + 1 >= PROXY_MAX_CLIENTS) {
+		applog(LOG_WARNING, "Stratum proxy refusing %s, already has %d clients",
+		       inet_ntoa(cli.sin_addr), PROXY_MAX_CLIENTS);
+		CLOSESOCKET(sock);
+		return;
+	}
+#ifndef WIN32
+	flags = fcntl(sock, F_GETFL, 0);
+	fcntl(sock, F_SETFL, O_NONBLOCK | flags);
+#else
+	ioctlsocket(sock, FIONBIO, &flags);
+#endif
+
+	client = calloc(sizeof(struct proxy_client), 1);
+	if (unlikely(!client))
+		quit(1, "Failed to calloc proxy client");
+	client->sock = sock;
+
+	mutex_lock(&proxy_lock);
+	client->cid = next_cid++;
+	if (last)
+		last->next = client;
+	else
+		clients = client;
+	mutex_unlock(&proxy_lock);
+
+	applog(LOG_INFO, "Stratum proxy client %u connected from %s", client->cid,
+	       inet_ntoa(cli.sin_addr));
+}
+
+static void *stratum_proxy_thread(void __maybe_unused *userdata)
+{
+	struct sockaddr_in serv;
+	SOCKETTYPE listener;
+
+	pthread_detach(pthread_self());
+	RenameThread("StratumProxy");
+
+	if (opt_stratum_proxy_allow) {
+		setup_proxy_allow();
+		if (!proxy_allow_count) {
+			applog(LOG_ERR, "Stratum proxy not running (no valid IPs specified)");
+			return NULL;
+		}
+	}
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener == INVSOCK) {
+		applog(LOG_ERR, "Stratum proxy socket failed (%s)", SOCKERRMSG);
+		return NULL;
+	}
+#ifndef WIN32
+	int optval = 1;
+
+	if (SOCKETFAIL(setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (void *)(&optval), sizeof(optval))))
+		applog(LOG_DEBUG, "Stratum proxy setsockopt SO_REUSEADDR failed (ignored): %s", SOCKERRMSG);
+#endif
+	memset(&serv, 0, sizeof(serv));
+	serv.sin_family = AF_INET;
+	serv.sin_addr.s_addr = htonl(opt_stratum_proxy_allow ? INADDR_ANY : INADDR_LOOPBACK);
+	serv.sin_port = htons(opt_stratum_proxy);
+	if (SOCKETFAIL(bind(listener, (struct sockaddr *)(&serv), sizeof(serv))) ||
+	    SOCKETFAIL(listen(listener, 16))) {
+		applog(LOG_ERR, "Stratum proxy failed to listen on port %d (%s)",
+		       opt_stratum_proxy, SOCKERRMSG);
+		CLOSESOCKET(listener);
+		return NULL;
+	}
+	if (opt_stratum_proxy_allow)
+		applog(LOG_WARNING, "Stratum proxy listening in IP access mode on port %d", opt_stratum_proxy);
+	else
+		applog(LOG_WARNING, "Stratum proxy listening on localhost port %d", opt_stratum_proxy);
+
+	while (42) {
+		struct timeval timeout = {1, 0};
+		struct proxy_client *client;
+		SOCKETTYPE maxfd = listener;
+		fd_set rd;
+
+		proxy_upstream();
+		reap_clients();
+
+		FD_ZERO(&rd);
+		FD_SET(listener, &rd);
+		for (client = clients; client; client = client->next) {
+			FD_SET(client->sock, &rd);
+			if (client->sock > maxfd)
+				maxfd = client->sock;
+		}
+		if (select(maxfd + 1, &rd, NULL, NULL, &timeout) < 1)
+			continue;
+		for (client = clients; client; client = client->next) {
+			if (!client->dead && FD_ISSET(client->sock, &rd))
+				client_read(client);
+		}
+		if (FD_ISSET(listener, &rd))
+			new_client(listener);
+	}
+
+	return NULL;
+}
+
+void stratum_proxy_start(void)
+{
+	pthread_t pth;
+
+	mutex_init(&proxy_lock);
+	if (unlikely(pthread_create(&pth, NULL, stratum_proxy_thread, NULL)))
+		quit(1, "Failed to create stratum proxy thread");
+}
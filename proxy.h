@@ -0,0 +1,16 @@
+#ifndef __PROXY_H__
+#define __PROXY_H__
+
+#include <jansson.h>
+
+#include "miner.h"
+
+extern int opt_stratum_proxy;
+extern char *opt_stratum_proxy_allow;
+
+extern void stratum_proxy_start(void);
+extern int stratum_proxy_prefix_len(const struct pool *pool);
+extern void stratum_proxy_relay(struct pool *pool, const char *s);
+extern bool stratum_proxy_response(int id, json_t *res_val, json_t *err_val);
+
+#endif /* __PROXY_H__ */
@@ -32,6 +32,9 @@
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #ifndef WIN32
 #include <sys/resource.h>
@@ -54,9 +57,12 @@ char *curly = ":D";
 #include "findnonce.h"
 #include "adl.h"
 #include "driver-opencl.h"
+#include "driver-cpu.h"
+#include "autotune.h"
 #include "bench_block.h"
 #include "scrypt.h"
-#include "darkcoin.h"
+#include "algorithm.h"
+#include "proxy.h"
 
 #if defined(unix) || defined(__APPLE__)
 	#include <errno.h>
@@ -102,6 +108,12 @@ time_t last_getwork;
 
 int nDevs;
 int opt_dynamic_interval = 7;
+int opt_dynamic_headless_interval = 50;
+bool opt_dynamic_headless;
+bool opt_gpu_profile;
+int opt_gpu_queues = 1;
+int opt_result_slots = FOUND;
+int opt_verify_sample = 1;
 int opt_g_threads = -1;
 int gpu_threads;
 bool opt_restart = true;
@@ -125,6 +137,7 @@ bool use_curses;
 
 static bool opt_submit_stale = true;
 static int opt_shares;
+static int opt_standby_pools;
 bool opt_fail_only;
 int opt_fail_switch_delay = 60;
 static bool opt_fix_protocol;
@@ -146,6 +159,8 @@ bool opt_api_network;
 bool opt_delaynet;
 bool opt_disable_pool;
 static bool no_work;
+/* A device is waiting for work its kernel can mine, under stgd_lock */
+static const struct algorithm *algo_starved;
 bool opt_worktime;
 #if defined(HAVE_LIBCURL) && defined(CURL_HAS_KEEPALIVE)
 int opt_tcp_keepalive = 30;
@@ -212,7 +227,6 @@ int total_getworks, total_stale, total_discarded;
 double total_diff_accepted, total_diff_rejected, total_diff_stale;
 static int staged_rollable;
 unsigned int new_blocks;
-static unsigned int work_block;
 unsigned int found_blocks;
 
 unsigned int local_work;
@@ -233,15 +247,15 @@ const
 #endif
 bool curses_active;
 
-/* Protected by ch_lock */
+/* The last new block of any family, protected by ch_lock */
 char current_hash[68];
 static char prev_block[12];
-static char current_block[32];
 
 static char datestamp[40];
 static char blocktime[32];
 struct timeval block_timeval;
 static char best_share[8] = "0";
+/* The network diff last set for any family */
 double current_diff = 0xFFFFFFFFFFFFFFFFULL;
 static char block_diff[8];
 double best_diff = 0;
@@ -252,7 +266,21 @@ struct block {
 	int block_no;
 };
 
-static struct block *blocks = NULL;
+/* The blocks of the coin one algorithm family mines. Pools of different
+ * families are on different chains, so each keeps its own current block,
+ * network diff and work_block. Protected by blk_lock, never freed. */
+struct block_family {
+	const char *family;
+	struct block *blocks;
+	unsigned int new_blocks;
+	unsigned int work_block;
+	unsigned char current_block[32];
+	double diff;
+	struct block_family *next;
+};
+
+static struct block_family *block_families;
+static struct block_family *block_family(const struct work *work);
 
 
 int swork_id;
@@ -266,6 +294,7 @@ struct stratum_share {
 	int id;
 	time_t sshare_time;
 	time_t sshare_sent;
+	struct timeval tv_sent;
 };
 
 static struct stratum_share *stratum_shares = NULL;
@@ -303,9 +332,7 @@ struct schedtime schedstart;
 struct schedtime schedstop;
 bool sched_paused;
 
-#define DM_SELECT(x, y, z) (dm_mode == DM_BITCOIN ? x : (dm_mode == DM_QUARKCOIN ? y : z))
-
-enum diff_calc_mode dm_mode = DM_LITECOIN;
+#define DM_SELECT(algo, x, y, z) ((algo)->dm == DM_BITCOIN ? x : ((algo)->dm == DM_QUARKCOIN ? y : z))
 
 static bool time_before(struct tm *tm1, struct tm *tm2)
 {
@@ -693,6 +720,18 @@ static char *set_devices(char *arg)
 	return NULL;
 }
 
+static char *set_dynamic_mode(const char *arg)
+{
+	if (!strcasecmp(arg, "desktop"))
+		opt_dynamic_headless = false;
+	else if (!strcasecmp(arg, "headless"))
+		opt_dynamic_headless = true;
+	else
+		return "Invalid value passed to gpu-dynmode, use desktop or headless";
+
+	return NULL;
+}
+
 static char *set_balance(enum pool_strategy *strategy)
 {
 	*strategy = POOL_BALANCE;
@@ -858,6 +897,24 @@ static char *set_pool_state(char *arg)
 	return NULL;
 }
 
+static char *set_pool_algorithm(char *arg)
+{
+	const struct algorithm *algo = find_algorithm(arg);
+	struct pool *pool;
+
+	if (!algo)
+		return "Invalid parameter to set_pool_algorithm";
+
+	while ((json_array_index + 1) > total_pools)
+		add_pool();
+	pool = pools[json_array_index];
+
+	applog(LOG_DEBUG, "Setting pool %i algorithm to %s", pool->pool_no, algo->name);
+	pool->algorithm = algo;
+
+	return NULL;
+}
+
 static char *set_quota(char *arg)
 {
 	char *semicolon = strchr(arg, ';'), *url;
@@ -1041,6 +1098,13 @@ static char *set_api_allow(const char *arg)
 	return NULL;
 }
 
+static char *set_stratum_proxy_allow(const char *arg)
+{
+	opt_set_charp(arg, &opt_stratum_proxy_allow);
+
+	return NULL;
+}
+
 static char *set_api_groups(const char *arg)
 {
 	opt_set_charp(arg, &opt_api_groups);
@@ -1136,17 +1200,35 @@ static struct opt_table opt_config_table[] = {
 			opt_set_bool, &opt_autoengine,
 			"Automatically adjust all GPU engine clock speeds to maintain a target temperature"),
 #endif
+	OPT_WITHOUT_ARG("--autotune",
+			opt_set_bool, &opt_autotune,
+			"Benchmark kernel, intensity and worksize combinations on each GPU, save the fastest and exit"),
+	OPT_WITH_ARG("--autotune-profile",
+		     opt_set_charp, NULL, &opt_autotune_profile,
+		     "Autotune profile file, loaded on startup (default: ~/.sgminer/autotune.json)"),
+	OPT_WITH_ARG("--autotune-time",
+		     set_int_1_to_65535, opt_show_intval, &opt_autotune_time,
+		     "Seconds to benchmark each autotune combination"),
 	OPT_WITHOUT_ARG("--balance",
 		     set_balance, &pool_strategy,
 		     "Change multipool strategy from failover to even share balance"),
 	OPT_WITHOUT_ARG("--benchmark",
 			opt_set_bool, &opt_benchmark,
 			"Run sgminer in benchmark mode - produces no shares"),
+	OPT_WITH_ARG("--cl-device-type",
+		     set_cl_device_type, NULL, NULL,
+		     "OpenCL device types to mine on: gpu, cpu or all (default: gpu)"),
 #ifdef HAVE_CURSES
 	OPT_WITHOUT_ARG("--compact",
 			opt_set_bool, &opt_compact,
 			"Use compact display without per device statistics"),
 #endif
+	OPT_WITH_ARG("--cpu-kernel",
+		     set_cpu_kernel, NULL, NULL,
+		     "Kernel name of the algorithm CPU mining threads hash (default: first --kernel)"),
+	OPT_WITH_ARG("--cpu-threads|-t",
+		     set_int_0_to_9999, opt_show_intval, &opt_cpu_threads,
+		     "Number of CPU mining threads, 0 disables CPU mining (default: 0)"),
 	OPT_WITHOUT_ARG("--debug|-D",
 		     enable_debug, &opt_debug,
 		     "Enable debug output"),
@@ -1170,10 +1252,22 @@ static struct opt_table opt_config_table[] = {
 			"Do not redirect to a different getwork protocol (eg. stratum)"),
 	OPT_WITH_ARG("--gpu-dyninterval",
 		     set_int_1_to_65535, opt_show_intval, &opt_dynamic_interval,
-		     "Set the refresh interval in ms for GPUs using dynamic intensity"),
+		     "Set the target kernel time in ms for GPUs using dynamic intensity in desktop mode"),
+	OPT_WITH_ARG("--gpu-dyninterval-headless",
+		     set_int_1_to_65535, opt_show_intval, &opt_dynamic_headless_interval,
+		     "Set the target kernel time in ms for GPUs using dynamic intensity in headless mode"),
+	OPT_WITH_ARG("--gpu-dynmode",
+		     set_dynamic_mode, NULL, NULL,
+		     "Dynamic intensity mode: desktop keeps the display responsive, headless favours hashrate (default: desktop)"),
 	OPT_WITH_ARG("--gpu-platform",
 		     set_int_0_to_9999, opt_show_intval, &opt_platform_id,
 		     "Select OpenCL platform ID to use for GPU mining"),
+	OPT_WITHOUT_ARG("--gpu-profile",
+			opt_set_bool, &opt_gpu_profile,
+			"Keep per kernel stage timings for the API gpuprofile command"),
+	OPT_WITH_ARG("--gpu-queues",
+		     set_int_1_to_10, opt_show_intval, &opt_gpu_queues,
+		     "Number of command queues splitting each launch per GPU thread (1 - 10)"),
 #ifndef HAVE_ADL
 	OPT_WITH_ARG("--gpu-threads|-g", // FIXME: why is this in a conditional?
 		     set_int_1_to_10, opt_show_intval, &opt_g_threads,
@@ -1266,12 +1360,18 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITHOUT_ARG("--no-submit-stale",
 			opt_set_invbool, &opt_submit_stale,
 		        "Don't submit shares if they are detected as stale"),
+	OPT_WITH_ARG("--nonces-per-thread",
+		     set_nonces_per_thread, NULL, NULL,
+		     "Nonces each GPU work item hashes per launch - one value or comma separated list"),
 	OPT_WITH_ARG("--pass|-p",
 		     set_pass, NULL, NULL,
 		     "Password for bitcoin JSON-RPC server"),
 	OPT_WITHOUT_ARG("--per-device-stats",
 			opt_set_bool, &want_per_device_stats,
 			"Force verbose mode and output per-device statistics"),
+	OPT_WITH_ARG("--pool-algorithm",
+		     set_pool_algorithm, NULL, NULL,
+		     "Kernel name of the pool's algorithm in a config pool entry (default: first --kernel)"),
 	OPT_WITH_ARG("--poolname",
 		     set_poolname, NULL, NULL,
 		     "Name of pool."),
@@ -1293,6 +1393,9 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITHOUT_ARG("--remove-disabled",
 		     opt_set_bool, &opt_removedisabled,
 	         "Remove disabled devices entirely, as if they didn't exist"),
+	OPT_WITH_ARG("--result-slots",
+		     set_int_1_to_65535, opt_show_intval, &opt_result_slots,
+		     "Nonces each GPU launch can report before it is rescanned in smaller launches"),
 	OPT_WITH_ARG("--retries",
 		     set_null, NULL, NULL,
 		     opt_hidden),
@@ -1329,6 +1432,15 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITHOUT_ARG("--show-coindiff",
 			opt_set_bool, &opt_show_coindiff,
 			"Show coin difficulty rather than hash value of a share"),
+	OPT_WITH_ARG("--standby-pools",
+		     set_int_0_to_9999, opt_show_intval, &opt_standby_pools,
+		     "Number of backup stratum pools to keep connected with their latest job for failover"),
+	OPT_WITH_ARG("--stratum-proxy",
+		     set_int_1_to_65535, opt_show_intval, &opt_stratum_proxy,
+		     "Serve stratum on this port, relaying the current pool to other miners"),
+	OPT_WITH_ARG("--stratum-proxy-allow",
+		     set_stratum_proxy_allow, NULL, NULL,
+		     "Allow stratum proxy clients only from the given list of IP[/Prefix] addresses[/subnets] (default: localhost)"),
 	OPT_WITH_ARG("--state",
 		     set_pool_state, NULL, NULL,
 		     "Specify pool state at startup (default: enabled)"),
@@ -1378,12 +1490,13 @@ static struct opt_table opt_config_table[] = {
 		     "Username for bitcoin JSON-RPC server"),
 	OPT_WITH_ARG("--vectors",
 		     set_vector, NULL, NULL,
-		     opt_hidden),
-		     /* All current kernels only support vectors=1 */
-		     /* "Override detected optimal vector (1, 2 or 4) - one value or comma separated list"), */
+		     "Nonces (1, 2 or 4) each work item hashes together, fresh/darkcoin/quarkcoin and the chain kernels only - one value or comma separated list"),
 	OPT_WITHOUT_ARG("--verbose|-v",
 			opt_set_bool, &opt_log_output,
 			"Log verbose output to stderr as well as status output"),
+	OPT_WITH_ARG("--verify-sample",
+		     set_int_1_to_65535, opt_show_intval, &opt_verify_sample,
+		     "Rehash one in N of the GPU results that come with their hash, 1 rehashes all and doesn't ask for it"),
 	OPT_WITH_ARG("--worksize|-w",
 		     set_worksize, NULL, NULL,
 		     "Override detected optimal worksize - one value or comma separated list"),
@@ -1841,7 +1954,7 @@ static void gen_gbt_work(struct pool *pool, struct work *work)
 	work->id = total_work++;
 	work->longpoll = false;
 	work->getwork_mode = GETWORK_MODE_GBT;
-	work->work_block = work_block;
+	work->work_block = block_family(work)->work_block;
 	/* Nominally allow a driver to ntime roll 60 seconds */
 	work->drv_rolllimit = 60;
 	calc_diff(work, 0);
@@ -1907,6 +2020,7 @@ static bool gbt_decode(struct pool *pool, json_t *res_val)
 	pool->coinbase = calloc(cal_len, 1);
 	if (unlikely(!pool->coinbase))
 		quit(1, "Failed to calloc pool coinbase in gbt_decode");
+	pool->coinbase_alloc = cal_len;
 	hex2bin(pool->coinbase, pool->coinbasetxn, 42);
 	extra_len = (uint8_t *)(pool->coinbase + 41);
 	orig_len = *extra_len;
@@ -2482,7 +2596,7 @@ void logwin_update(void)
 }
 #endif
 
-static void restart_threads(void);
+static void restart_family_threads(const char *family);
 
 /* Theoretically threads could race when modifying accepted and
  * rejected values but the chance of two submits completing at the
@@ -2540,7 +2654,7 @@ share_result(json_t *val, json_t *res, json_t *err, const struct work *work,
 		/* If we know we found the block we know better than anyone
 		 * that new work is needed. */
 		if (unlikely(work->block))
-			restart_threads();
+			restart_family_threads(pool_algorithm(pool)->family);
 	} else {
 		mutex_lock(&stats_lock);
 		cgpu->rejected++;
@@ -3044,7 +3158,7 @@ static void calc_diff(struct work *work, double known)
 	else {
 		double d64, dcut64;
 
-		d64 = (double) DM_SELECT(1, 256, 65536) * truediffone;
+		d64 = (double) DM_SELECT(pool_algorithm(work->pool), 1, 256, 65536) * truediffone;
 
 		dcut64 = le256todouble(work->target);
 		if (unlikely(!dcut64))
@@ -3071,7 +3185,7 @@ static void calc_diff(struct work *work, double known)
 	}
 }
 
-static void get_benchmark_work(struct work *work)
+void get_benchmark_work(struct work *work)
 {
 	// Use a random work block pulled from a pool
 	static uint8_t bench_block[] = { SGMINER_BENCHMARK_BLOCK };
@@ -3597,7 +3711,7 @@ static bool stale_work(struct work *work, bool share)
 	if (opt_benchmark)
 		return false;
 
-	if (work->work_block != work_block) {
+	if (work->work_block != block_family(work)->work_block) {
 		applog(LOG_DEBUG, "Work stale due to block mismatch");
 		return true;
 	}
@@ -3647,7 +3761,8 @@ static bool stale_work(struct work *work, bool share)
 	}
 
 	if (opt_fail_only && !share && pool != current_pool() && !work->mandatory &&
-	    pool_strategy != POOL_LOADBALANCE && pool_strategy != POOL_BALANCE) {
+	    pool_strategy != POOL_LOADBALANCE && pool_strategy != POOL_BALANCE &&
+	    algorithm_compatible(pool_algorithm(pool), pool_algorithm(current_pool()))) {
 		applog(LOG_DEBUG, "Work stale due to fail only pool mismatch");
 		return true;
 	}
@@ -3661,7 +3776,7 @@ static double share_diff(const struct work *work)
 	double d64, s64;
 	double ret;
 
-	d64 = (double) DM_SELECT(1, 256, 65536) * truediffone;
+	d64 = (double) DM_SELECT(pool_algorithm(work->pool), 1, 256, 65536) * truediffone;
 	s64 = le256todouble(work->hash);
 	if (unlikely(!s64))
 		s64 = 0;
@@ -3718,6 +3833,31 @@ static bool pool_unusable(struct pool *pool)
 	return false;
 }
 
+/* The highest priority usable pool whose work algo's kernel can mine */
+static struct pool *select_algorithm_pool(const struct algorithm *algo)
+{
+	int i;
+
+	for (i = 0; i < total_pools; i++) {
+		struct pool *pool = priority_pool(i);
+
+		if (!pool_unusable(pool) && algorithm_compatible(pool_algorithm(pool), algo))
+			return pool;
+	}
+	return NULL;
+}
+
+/* The pool the getwork scheduler makes work from: select_pool's, unless a
+ * starved kernel can't mine its work, then the best one it can, or NULL */
+static struct pool *select_work_pool(bool lagging, const struct algorithm *starved)
+{
+	struct pool *pool = select_pool(lagging);
+
+	if (starved && !algorithm_compatible(pool_algorithm(pool), starved))
+		pool = select_algorithm_pool(starved);
+	return pool;
+}
+
 void switch_pools(struct pool *selected)
 {
 	struct pool *pool, *last_pool;
@@ -3868,8 +4008,10 @@ int restart_wait(struct thr_info *thr, unsigned int mstime)
 	return rc;
 }
 
-static void *restart_thread(void __maybe_unused *arg)
+/* arg is the family whose devices restart, NULL for all of them */
+static void *restart_thread(void *arg)
 {
+	const char *family = arg;
 	struct pool *cp = current_pool();
 	struct cgpu_info *cgpu;
 	int i, mt;
@@ -3893,6 +4035,8 @@ static void *restart_thread(void __maybe_unused *arg)
 			continue;
 		if (cgpu->deven != DEV_ENABLED)
 			continue;
+		if (family && strcmp(kernel_algorithm(cgpu->kernel)->family, family))
+			continue;
 		mining_thr[i]->work_restart = true;
 		flush_queue(cgpu);
 		cgpu->drv->flush_work(cgpu);
@@ -3915,6 +4059,15 @@ static void restart_threads(void)
 		quit(1, "Failed to create restart thread");
 }
 
+/* Only the devices mining family's coin, after a new block of it */
+static void restart_family_threads(const char *family)
+{
+	pthread_t rthread;
+
+	if (unlikely(pthread_create(&rthread, NULL, restart_thread, (void *)family)))
+		quit(1, "Failed to create restart thread");
+}
+
 static void signal_work_update(void)
 {
 	int i;
@@ -3927,14 +4080,13 @@ static void signal_work_update(void)
 	rd_unlock(&mining_thr_lock);
 }
 
-static void set_curblock(char *hexstr, unsigned char *bedata)
+static void set_curblock(char *hexstr)
 {
 	int ofs;
 
 	cg_wlock(&ch_lock);
 	cgtime(&block_timeval);
 	strcpy(current_hash, hexstr);
-	memcpy(current_block, bedata, 32);
 	get_timestamp(blocktime, sizeof(blocktime), &block_timeval);
 	cg_wunlock(&ch_lock);
 
@@ -3948,13 +4100,46 @@ static void set_curblock(char *hexstr, unsigned char *bedata)
 	applog(LOG_INFO, "New block: %s... diff %s", current_hash, block_diff);
 }
 
+/* The blocks of the family of work's pool, added on first sight */
+static struct block_family *block_family(const struct work *work)
+{
+	const char *family = pool_algorithm(work->pool)->family;
+	struct block_family *bf;
+
+	rd_lock(&blk_lock);
+	for (bf = block_families; bf; bf = bf->next) {
+		if (!strcmp(bf->family, family))
+			break;
+	}
+	rd_unlock(&blk_lock);
+	if (likely(bf))
+		return bf;
+
+	wr_lock(&blk_lock);
+	for (bf = block_families; bf; bf = bf->next) {
+		if (!strcmp(bf->family, family))
+			break;
+	}
+	if (!bf) {
+		bf = calloc(sizeof(struct block_family), 1);
+		if (unlikely(!bf))
+			quit(1, "block_family OOM");
+		bf->family = family;
+		bf->diff = 0xFFFFFFFFFFFFFFFFULL;
+		bf->next = block_families;
+		block_families = bf;
+	}
+	wr_unlock(&blk_lock);
+	return bf;
+}
+
 /* Search to see if this string is from a block that has been seen before */
-static bool block_exists(char *hexstr)
+static bool block_exists(struct block_family *bf, char *hexstr)
 {
 	struct block *s;
 
 	rd_lock(&blk_lock);
-	HASH_FIND_STR(blocks, hexstr, s);
+	HASH_FIND_STR(bf->blocks, hexstr, s);
 	rd_unlock(&blk_lock);
 
 	if (s)
@@ -3968,7 +4153,7 @@ static inline bool from_existing_block(struct work *work)
 	char *hexstr = bin2hex(work->data + 8, 18);
 	bool ret;
 
-	ret = block_exists(hexstr);
+	ret = block_exists(block_family(work), hexstr);
 	free(hexstr);
 	return ret;
 }
@@ -3978,24 +4163,27 @@ static int block_sort(struct block *blocka, struct block *blockb)
 	return blocka->block_no - blockb->block_no;
 }
 
-/* Decode the current block difficulty which is in packed form */
-static void set_blockdiff(const struct work *work)
+/* Decode the current block difficulty of bf which is in packed form,
+ * blk_lock held */
+static void set_blockdiff(struct block_family *bf, const struct work *work)
 {
 	uint8_t pow = work->data[72];
 	int powdiff = (8 * (0x1d - 3)) - (8 * (pow - 3));
 	uint32_t diff32 = be32toh(*((uint32_t *)(work->data + 72))) & 0x00FFFFFF;
-	double numerator = DM_SELECT(0xFFFFULL, 0xFFFFFFULL, 0xFFFFFFFFULL) << powdiff;
+	double numerator = DM_SELECT(pool_algorithm(work->pool), 0xFFFFULL, 0xFFFFFFULL, 0xFFFFFFFFULL) << powdiff;
 	double ddiff = numerator / (double)diff32;
 
-	if (unlikely(current_diff != ddiff)) {
+	if (unlikely(bf->diff != ddiff)) {
+		bf->diff = ddiff;
 		suffix_string(ddiff, block_diff, sizeof(block_diff), 0);
 		current_diff = ddiff;
-		applog(LOG_NOTICE, "Network diff set to %s", block_diff);
+		applog(LOG_NOTICE, "%s network diff set to %s", bf->family, block_diff);
 	}
 }
 
 static bool test_work_current(struct work *work)
 {
+	struct block_family *bf = block_family(work);
 	struct pool *pool = work->pool;
 	unsigned char bedata[32];
 	char hexstr[68];
@@ -4009,44 +4197,48 @@ static bool test_work_current(struct work *work)
 
 	/* Search to see if this block exists yet and if not, consider it a
 	 * new block and set the current block details to this one */
-	if (!block_exists(hexstr)) {
+	if (!block_exists(bf, hexstr)) {
 		struct block *s = calloc(sizeof(struct block), 1);
 		int deleted_block = 0;
+		bool first;
 
 		if (unlikely(!s))
 			quit (1, "test_work_current OOM");
 		strcpy(s->hash, hexstr);
-		s->block_no = new_blocks++;
+		new_blocks++;
 
 		wr_lock(&blk_lock);
+		s->block_no = bf->new_blocks++;
+		first = !s->block_no;
 		/* Only keep the last hour's worth of blocks in memory since
 		 * work from blocks before this is virtually impossible and we
 		 * want to prevent memory usage from continually rising */
-		if (HASH_COUNT(blocks) > 6) {
+		if (HASH_COUNT(bf->blocks) > 6) {
 			struct block *oldblock;
 
-			HASH_SORT(blocks, block_sort);
-			oldblock = blocks;
+			HASH_SORT(bf->blocks, block_sort);
+			oldblock = bf->blocks;
 			deleted_block = oldblock->block_no;
-			HASH_DEL(blocks, oldblock);
+			HASH_DEL(bf->blocks, oldblock);
 			free(oldblock);
 		}
-		HASH_ADD_STR(blocks, hash, s);
-		set_blockdiff(work);
+		HASH_ADD_STR(bf->blocks, hash, s);
+		memcpy(bf->current_block, bedata, 32);
+		set_blockdiff(bf, work);
 		wr_unlock(&blk_lock);
 
 		if (deleted_block)
-			applog(LOG_DEBUG, "Deleted block %d from database", deleted_block);
-		set_curblock(hexstr, bedata);
+			applog(LOG_DEBUG, "Deleted %s block %d from database", bf->family, deleted_block);
+		set_curblock(hexstr);
 		/* Copy the information to this pool's prev_block since it
 		 * knows the new block exists. */
 		memcpy(pool->prev_block, bedata, 32);
-		if (unlikely(new_blocks == 1)) {
+		if (unlikely(first)) {
 			ret = false;
 			goto out;
 		}
 
-		work->work_block = ++work_block;
+		work->work_block = ++bf->work_block;
 		if (work->longpoll) {
 			if (work->stratum) {
 				applog(LOG_NOTICE, "Stratum from %s detected new block", pool->poolname);
@@ -4058,14 +4250,14 @@ static bool test_work_current(struct work *work)
 			applog(LOG_NOTICE, "New block detected on network before pool notification");
 		else
 			applog(LOG_NOTICE, "New block detected on network");
-		restart_threads();
+		restart_family_threads(bf->family);
 	} else {
 		if (memcmp(pool->prev_block, bedata, 32)) {
 			/* Work doesn't match what this pool has stored as
 			 * prev_block. Let's see if the work is from an old
 			 * block or the pool is just learning about a new
 			 * block. */
-			if (memcmp(bedata, current_block, 32)) {
+			if (memcmp(bedata, bf->current_block, 32)) {
 				/* Doesn't match current block. It's stale */
 				applog(LOG_DEBUG, "Stale data from %s", pool->poolname);
 				ret = false;
@@ -4080,18 +4272,18 @@ static bool test_work_current(struct work *work)
 		/* This isn't ideal, this pool is still on an old block but
 		 * accepting shares from it. To maintain fair work distribution
 		 * we work on it anyway. */
-		if (memcmp(bedata, current_block, 32))
+		if (memcmp(bedata, bf->current_block, 32))
 			applog(LOG_DEBUG, "%s still on old block", pool->poolname);
 #endif
 		if (work->longpoll) {
-			work->work_block = ++work_block;
+			work->work_block = ++bf->work_block;
 			if (shared_strategy() || work->pool == current_pool()) {
 				if (work->stratum) {
 					applog(LOG_NOTICE, "Stratum from %s requested work restart", pool->poolname);
 				} else {
 					applog(LOG_NOTICE, "%sLONGPOLL from %s requested work restart", work->gbt ? "GBT " : "", work->pool->poolname);
 				}
-				restart_threads();
+				restart_family_threads(bf->family);
 			}
 		}
 	}
@@ -4132,7 +4324,7 @@ static bool hash_push(struct work *work)
 static void stage_work(struct work *work)
 {
 	applog(LOG_DEBUG, "Pushing work from %s to hash queue", work->pool->poolname);
-	work->work_block = work_block;
+	work->work_block = block_family(work)->work_block;
 	test_work_current(work);
 	work->pool->works++;
 	hash_push(work);
@@ -4258,6 +4450,8 @@ void write_config(FILE *fcfg)
 				pool->rpc_proxy ? "|" : "",
 				json_escape(pool->rpc_url));
 		}
+		if (pool->algorithm)
+			fprintf(fcfg, "\n\t\t\"pool-algorithm\" : \"%s\",", pool->algorithm->name);
 		fprintf(fcfg, "\n\t\t\"user\" : \"%s\",", json_escape(pool->rpc_user));
 		fprintf(fcfg, "\n\t\t\"pass\" : \"%s\"\n\t}", json_escape(pool->rpc_pass));
 		}
@@ -4277,84 +4471,25 @@ void write_config(FILE *fcfg)
 		for(i = 0; i < nDevs; i++)
 			fprintf(fcfg, "%s%d", i > 0 ? "," : "", gpus[i].rawintensity);
 
-		/* All current kernels only support vector=1 */
-		/* fputs("\",\n\"vectors\" : \"", fcfg); */
-		/* for(i = 0; i < nDevs; i++) */
-		/* 	fprintf(fcfg, "%s%d", i > 0 ? "," : "", */
-		/* 		gpus[i].vwidth); */
+		fputs("\",\n\"vectors\" : \"", fcfg);
+		for(i = 0; i < nDevs; i++)
+			fprintf(fcfg, "%s%d", i > 0 ? "," : "",
+				gpus[i].vwidth ? (int)gpus[i].vwidth : 1);
 
 		fputs("\",\n\"worksize\" : \"", fcfg);
 		for(i = 0; i < nDevs; i++)
 			fprintf(fcfg, "%s%d", i > 0 ? "," : "",
 				(int)gpus[i].work_size);
 
+		fputs("\",\n\"nonces-per-thread\" : \"", fcfg);
+		for(i = 0; i < nDevs; i++)
+			fprintf(fcfg, "%s%d", i > 0 ? "," : "",
+				gpus[i].nonces_per_thread ? gpus[i].nonces_per_thread : 1);
+
 		fputs("\",\n\"kernel\" : \"", fcfg);
 		for(i = 0; i < nDevs; i++) {
 			fprintf(fcfg, "%s", i > 0 ? "," : "");
-			switch (gpus[i].kernel) {
-				case KL_NONE: // Shouldn't happen
-					break;
-				case KL_ALEXKARNEW:
-					fprintf(fcfg, ALEXKARNEW_KERNNAME);
-					break;
-				case KL_ALEXKAROLD:
-					fprintf(fcfg, ALEXKAROLD_KERNNAME);
-					break;
-				case KL_CKOLIVAS:
-					fprintf(fcfg, CKOLIVAS_KERNNAME);
-					break;
-				case KL_PSW:
-					fprintf(fcfg, PSW_KERNNAME);
-					break;
-				case KL_ZUIKKIS:
-					fprintf(fcfg, ZUIKKIS_KERNNAME);
-					break;
-				case KL_DARKCOIN:
-					fprintf(fcfg, DARKCOIN_KERNNAME);
-					break;
-				case KL_QUBITCOIN:
-					fprintf(fcfg, QUBITCOIN_KERNNAME);
-					break;
-				case KL_FRESH:
-					fprintf(fcfg, FRESH_KERNNAME);
-					break;
-				case KL_QUARKCOIN:
-					fprintf(fcfg, QUARKCOIN_KERNNAME);
-					break;
-				case KL_MYRIADCOIN_GROESTL:
-					fprintf(fcfg, MYRIADCOIN_GROESTL_KERNNAME);
-					break;
-				case KL_FUGUECOIN:
-					fprintf(fcfg, FUGUECOIN_KERNNAME);
-					break;
-				case KL_INKCOIN:
-					fprintf(fcfg, INKCOIN_KERNNAME);
-					break;
-				case KL_ANIMECOIN:
-					fprintf(fcfg, ANIMECOIN_KERNNAME);
-					break;
-				case KL_GROESTLCOIN:
-					fprintf(fcfg, GROESTLCOIN_KERNNAME);
-					break;
-				case KL_SIFCOIN:
-					fprintf(fcfg, SIFCOIN_KERNNAME);
-					break;
-				case KL_TWECOIN:
-					fprintf(fcfg, TWECOIN_KERNNAME);
-					break;
-				case KL_MARUCOIN:
-					fprintf(fcfg, MARUCOIN_KERNNAME);
-					break;
-				case KL_X11MOD:
-					fprintf(fcfg, X11MOD_KERNNAME);
-					break;
-				case KL_X13MOD:
-					fprintf(fcfg, X13MOD_KERNNAME);
-					break;
-				case KL_X13MODOLD:
-					fprintf(fcfg, X13MODOLD_KERNNAME);
-					break;
-			}
+			fprintf(fcfg, "%s", kernel_algorithm(gpus[i].kernel)->name);
 		}
 
 		fputs("\",\n\"lookup-gap\" : \"", fcfg);
@@ -4447,6 +4582,12 @@ void write_config(FILE *fcfg)
 
 	/* Special case options */
 	fprintf(fcfg, ",\n\"shares\" : \"%d\"", opt_shares);
+	if (opt_dynamic_headless)
+		fputs(",\n\"gpu-dynmode\" : \"headless\"", fcfg);
+	if (opt_cl_device_type != CL_SELECT_GPU)
+		fprintf(fcfg, ",\n\"cl-device-type\" : \"%s\"", cl_device_select_names[opt_cl_device_type]);
+	if (cpu_algorithm)
+		fprintf(fcfg, ",\n\"cpu-kernel\" : \"%s\"", cpu_algorithm->name);
 	if (pool_strategy == POOL_BALANCE)
 		fputs(",\n\"balance\" : true", fcfg);
 	if (pool_strategy == POOL_LOADBALANCE)
@@ -4494,6 +4635,8 @@ void write_config(FILE *fcfg)
 		fprintf(fcfg, ",\n\"remove-disabled\" : true");
 	if (opt_api_allow)
 		fprintf(fcfg, ",\n\"api-allow\" : \"%s\"", json_escape(opt_api_allow));
+	if (opt_stratum_proxy_allow)
+		fprintf(fcfg, ",\n\"stratum-proxy-allow\" : \"%s\"", json_escape(opt_stratum_proxy_allow));
 	if (strcmp(opt_api_mcast_addr, API_MCAST_ADDR) != 0)
 		fprintf(fcfg, ",\n\"api-mcast-addr\" : \"%s\"", json_escape(opt_api_mcast_addr));
 	if (strcmp(opt_api_mcast_code, API_MCAST_CODE) != 0)
@@ -4554,6 +4697,7 @@ void zero_stats(void)
 		pool->accepted = 0;
 		pool->rejected = 0;
 		pool->stale_shares = 0;
+		pool->duplicate_shares = 0;
 		pool->discarded_work = 0;
 		pool->getfail_occasions = 0;
 		pool->remotefail_occasions = 0;
@@ -5177,6 +5321,7 @@ static void stratum_share_result(json_t *val, json_t *res_val, json_t *err_val,
 {
 	struct work *work = sshare->work;
 	time_t now_t = time(NULL);
+	struct timeval now;
 	char hashshow[64];
 	int srdiff;
 
@@ -5185,10 +5330,35 @@ static void stratum_share_result(json_t *val, json_t *res_val, json_t *err_val,
 		applog(LOG_INFO, "Pool %d stratum share result lag time %d seconds",
 		       work->pool->pool_no, srdiff);
 	}
+	cgtime(&now);
+	mutex_lock(&stats_lock);
+	latency_add(&work->pool->sgminer_pool_stats.submit_ack, &now, &sshare->tv_sent);
+	mutex_unlock(&stats_lock);
+	if (sshare->block) {
+		applog(LOG_NOTICE, "%s answered block candidate in %d ms",
+		       work->pool->poolname, ms_tdiff(&now, &sshare->tv_sent));
+	}
 	show_hash(work, hashshow);
 	share_result(val, res_val, err_val, work, hashshow, false, "");
 }
 
+/* An accepted share, by far the most common response, needs nothing but its
+ * id so is recognised without decoding the line with jansson */
+static bool stratum_share_accepted(const char *s, int *id)
+{
+	struct stratum_msg msg;
+	char *end;
+
+	if (!stratum_fast_parse(s, &msg) || !span_is(&msg.result, "true"))
+		return false;
+	if (msg.error.s && !span_is(&msg.error, "null"))
+		return false;
+	if (!msg.id.s || msg.id.str)
+		return false;
+	*id = strtol(msg.id.s, &end, 10);
+	return end == msg.id.s + msg.id.len;
+}
+
 /* Parses stratum json responses and tries to find the id that the request
  * matched to and treat it accordingly. */
 static bool parse_stratum_response(struct pool *pool, char *s)
@@ -5199,6 +5369,12 @@ static bool parse_stratum_response(struct pool *pool, char *s)
 	bool ret = false;
 	int id;
 
+	if (stratum_share_accepted(s, &id)) {
+		res_val = json_true();
+		err_val = NULL;
+		goto found;
+	}
+
 	val = JSON_LOADS(s, &err);
 	if (!val) {
 		applog(LOG_INFO, "JSON decode failed(%d): %s", err.line, err.text);
@@ -5225,7 +5401,11 @@ static bool parse_stratum_response(struct pool *pool, char *s)
 	}
 
 	id = json_integer_value(id_val);
-
+found:
+	if (opt_stratum_proxy && stratum_proxy_response(id, res_val, err_val)) {
+		ret = true;
+		goto out;
+	}
 	mutex_lock(&sshare_lock);
 	HASH_FIND_INT(stratum_shares, &id, sshare);
 	if (sshare) {
@@ -5336,6 +5516,50 @@ static int cp_prio(void)
 	return prio;
 }
 
+/* The first --standby-pools enabled stratum pools by priority other than the
+ * current one stay connected, so failing over to them needs no connect,
+ * subscribe or authorise and work comes from the job they already have. */
+static bool pool_standby(struct pool *pool)
+{
+	struct pool *cp = current_pool();
+	int i, ahead = 0;
+
+	if (!opt_standby_pools || !pool->has_stratum || pool == cp)
+		return false;
+	for (i = 0; i < total_pools; i++) {
+		struct pool *other = priority_pool(i);
+
+		if (other == pool)
+			return true;
+		if (other == cp || other->state != POOL_ENABLED || !other->has_stratum)
+			continue;
+		if (++ahead >= opt_standby_pools)
+			break;
+	}
+	return false;
+}
+
+/* Devices whose kernel can't mine the current pool's algorithm get their
+ * work from the first pool that has theirs */
+static bool pool_algorithm_needed(struct pool *pool)
+{
+	const struct algorithm *algo = pool_algorithm(pool);
+	int i;
+
+	if (algorithm_compatible(pool_algorithm(current_pool()), algo))
+		return false;
+	if (select_algorithm_pool(algo) != pool)
+		return false;
+	for (i = 0; i < total_devices; i++) {
+		struct cgpu_info *cgpu = get_devices(i);
+
+		if (cgpu->deven != DEV_DISABLED &&
+		    algorithm_compatible(kernel_algorithm(cgpu->kernel), algo))
+			return true;
+	}
+	return false;
+}
+
 /* We only need to maintain a secondary pool connection when we need the
  * capacity to get work from the backup pools while still on the primary */
 static bool cnx_needed(struct pool *pool)
@@ -5350,6 +5574,10 @@ static bool cnx_needed(struct pool *pool)
 		return true;
 	if (pool_strategy == POOL_LOADBALANCE)
 		return true;
+	if (pool_standby(pool))
+		return true;
+	if (pool_algorithm_needed(pool))
+		return true;
 
 	/* Idle stratum pool needs something to kick it alive again */
 	if (pool->has_stratum && pool->idle)
@@ -5379,7 +5607,7 @@ static bool cnx_needed(struct pool *pool)
 	return false;
 }
 
-static void wait_lpcurrent(struct pool *pool);
+static bool pool_lpcurrent(struct pool *pool);
 static void pool_resus(struct pool *pool);
 static void gen_stratum_work(struct pool *pool, struct work *work);
 
@@ -5404,258 +5632,485 @@ static bool supports_resume(struct pool *pool)
 	return ret;
 }
 
-/* One stratum receive thread per pool that has stratum waits on the socket
- * checking for new messages and for the integrity of the socket connection. We
- * reset the connection based on the integrity of the receive side only as the
- * send side will eventually expire data it fails to send. */
-static void *stratum_rthread(void *userdata)
+/* Hands a line received from a stratum pool to the handlers */
+static void stratum_dispatch(struct pool *pool, char *s)
 {
-	struct pool *pool = (struct pool *)userdata;
-	char threadname[16];
+	/* Check this pool hasn't died while being a backup pool and
+	 * has not had its idle flag cleared */
+	stratum_resumed(pool);
 
-	pthread_detach(pthread_self());
+	if (opt_stratum_proxy)
+		stratum_proxy_relay(pool, s);
+	if (!parse_method(pool, s) && !parse_stratum_response(pool, s))
+		applog(LOG_INFO, "Unknown stratum msg: %s", s);
+	else if (pool->swork.clean) {
+		struct work *work = make_work();
 
-	snprintf(threadname, sizeof(threadname), "%d/RStratum", pool->pool_no);
-	RenameThread(threadname);
+		/* Generate a single work item to update the current
+		 * block database */
+		pool->swork.clean = false;
+		gen_stratum_work(pool, work);
+		work->longpoll = true;
+		/* Return value doesn't matter. We're just informing
+		 * that we may need to restart. */
+		test_work_current(work);
+		free_work(work);
+	}
+}
 
-	while (42) {
-		struct timeval timeout;
-		int sel_ret;
-		fd_set rd;
-		char *s;
+/* The longest mining.submit line */
+#define STRATUM_LINE 1024
 
-		if (unlikely(pool->removed))
-			break;
+/* Formats the mining.submit line for sshare at s, after the part of the
+ * params common to every share of the pool. Returns its length including
+ * the newline, or 0 if it does not fit in a line. */
+static int stratum_submit_line(char *s, const char *prefix, int prefix_len,
+			       const struct stratum_share *sshare)
+{
+	struct work *work = sshare->work;
+	char noncehex[12], nonce2hex[20];
+	unsigned char nonce2[8];
+	uint64_t *nonce2_64;
+	uint32_t nonce;
+	int len;
 
-		/* Check to see whether we need to maintain this connection
-		 * indefinitely or just bring it up when we switch to this
-		 * pool */
-		if (!sock_full(pool) && !cnx_needed(pool)) {
-			applog(LOG_INFO, "Suspending stratum on %s",
-			       pool->poolname);
-			suspend_stratum(pool);
-			clear_stratum_shares(pool);
-			clear_pool_work(pool);
-
-			wait_lpcurrent(pool);
-			if (!restart_stratum(pool)) {
-				pool_died(pool);
-				while (!restart_stratum(pool)) {
-					if (pool->removed)
-						goto out;
-					cgsleep_ms(30000);
-				}
-			}
-		}
+	nonce = *((uint32_t *)(work->data + 76));
+	__bin2hex(noncehex, (const unsigned char *)&nonce, 4);
+	nonce2_64 = (uint64_t *)nonce2;
+	*nonce2_64 = htole64(work->nonce2);
+	__bin2hex(nonce2hex, nonce2, work->nonce2_len);
 
-		FD_ZERO(&rd);
-		FD_SET(pool->sock, &rd);
-		timeout.tv_sec = 90;
-		timeout.tv_usec = 0;
-
-		/* The protocol specifies that notify messages should be sent
-		 * every minute so if we fail to receive any for 90 seconds we
-		 * assume the connection has been dropped and treat this pool
-		 * as dead */
-		if (!sock_full(pool) && (sel_ret = select(pool->sock + 1, &rd, NULL, NULL, &timeout)) < 1) {
-			applog(LOG_DEBUG, "Stratum select failed on %s with value %d", pool->poolname, sel_ret);
-			s = NULL;
-		} else
-			s = recv_line(pool);
-		if (!s) {
-			applog(LOG_NOTICE, "Stratum connection to %s interrupted", pool->poolname);
-			pool->getfail_occasions++;
-			total_go++;
+	memcpy(s, prefix, prefix_len);
+	len = snprintf(s + prefix_len, STRATUM_LINE - prefix_len,
+		"%s\", \"%s\", \"%s\", \"%s\"], \"id\": %d, \"method\": \"mining.submit\"}\n",
+		work->job_id, nonce2hex, work->ntime, noncehex, sshare->id);
+	if (len >= STRATUM_LINE - prefix_len)
+		return 0;
+	return prefix_len + len;
+}
 
-			/* If the socket to our stratum pool disconnects, all
-			 * tracked submitted shares are lost and we will leak
-			 * the memory if we don't discard their records. */
-			if (!supports_resume(pool) || opt_lowmem)
-				clear_stratum_shares(pool);
-			clear_pool_work(pool);
-			if (pool == current_pool())
-				restart_threads();
+/* The start of every mining.submit line from the pool, up to the job id */
+static int stratum_submit_prefix(struct pool *pool, char *prefix, size_t size)
+{
+	int len = snprintf(prefix, size, "{\"params\": [\"%s\", \"", pool->rpc_user);
 
-			if (restart_stratum(pool))
-				continue;
+	if (unlikely(len >= (int)size))
+		len = size - 1;
+	return len;
+}
 
-			pool_died(pool);
-			while (!restart_stratum(pool)) {
-				if (pool->removed)
-					goto out;
-				cgsleep_ms(30000);
-			}
-			stratum_resumed(pool);
-			continue;
-		}
+static struct stratum_share *new_stratum_share(struct work *work)
+{
+	struct stratum_share *sshare = calloc(sizeof(struct stratum_share), 1);
 
-		/* Check this pool hasn't died while being a backup pool and
-		 * has not had its idle flag cleared */
-		stratum_resumed(pool);
+	if (unlikely(!sshare))
+		quit(1, "Failed to calloc sshare in new_stratum_share");
+	sshare->sshare_time = time(NULL);
+	/* This work item is freed in parse_stratum_response */
+	sshare->work = work;
+	sshare->block = work->block;
 
-		if (!parse_method(pool, s) && !parse_stratum_response(pool, s))
-			applog(LOG_INFO, "Unknown stratum msg: %s", s);
-		else if (pool->swork.clean) {
-			struct work *work = make_work();
+	mutex_lock(&sshare_lock);
+	/* Give the stratum share a unique id */
+	sshare->id = swork_id++;
+	mutex_unlock(&sshare_lock);
+	return sshare;
+}
 
-			/* Generate a single work item to update the current
-			 * block database */
-			pool->swork.clean = false;
-			gen_stratum_work(pool, work);
-			work->longpoll = true;
-			/* Return value doesn't matter. We're just informing
-			 * that we may need to restart. */
-			test_work_current(work);
-			free_work(work);
-		}
-		free(s);
+static void discard_stratum_share(struct pool *pool, struct stratum_share *sshare)
+{
+	free_work(sshare->work);
+	free(sshare);
+	pool->stale_shares++;
+	total_stale++;
+}
+
+/* Queues the share in work for the stratum event loop to send, a block
+ * candidate ahead of the shares still waiting for the socket */
+static void stratum_submit_share(struct pool *pool, struct work *work)
+{
+	char prefix[STRATUM_LINE / 2], s[STRATUM_LINE];
+	uint32_t *hash32 = (uint32_t *)work->hash;
+	struct stratum_share *sshare;
+	bool block = work->block;
+	struct timeval now;
+	int len;
+
+	if (unlikely(work->nonce2_len > 8)) {
+		applog(LOG_ERR, "%s asking for inappropriately long nonce2 length %d", pool->poolname, (int)work->nonce2_len);
+		applog(LOG_ERR, "Not attempting to submit shares");
+		free_work(work);
+		return;
 	}
 
-out:
-	return NULL;
+	sshare = new_stratum_share(work);
+	len = stratum_submit_line(s, prefix, stratum_submit_prefix(pool, prefix, sizeof(prefix)), sshare);
+	if (unlikely(!len)) {
+		applog(LOG_ERR, "%s share submission too long, discarding", pool->poolname);
+		discard_stratum_share(pool, sshare);
+		return;
+	}
+
+	if (block)
+		applog(LOG_NOTICE, "Submitting block candidate to %s ahead of queued shares", pool->poolname);
+	else
+		applog(LOG_INFO, "Submitting share %08lx to %s", (long unsigned int)htole32(hash32[6]), pool->poolname);
+
+	cgtime(&now);
+	mutex_lock(&stats_lock);
+	latency_add(&pool->sgminer_pool_stats.found_submit, &now, &work->tv_work_found);
+	mutex_unlock(&stats_lock);
+
+	/* Tracked before it goes out so the pool's answer always finds it */
+	sshare->tv_sent = now;
+	sshare->sshare_sent = now.tv_sec;
+	mutex_lock(&sshare_lock);
+	HASH_ADD_INT(stratum_shares, id, sshare);
+	pool->sshares++;
+	mutex_unlock(&sshare_lock);
+
+	stratum_queue_lines(pool, s, len, block);
+}
+
+/* One event loop thread owns every stratum pool once it has first connected.
+ * It reads the pools' lines, writes what is queued for them when their
+ * sockets take it, times out the quiet ones and suspends those that aren't
+ * needed. Connecting, subscribing and authorising block, so when its timers
+ * say a pool should be connected the loop hands it to a short lived connect
+ * thread, which gives it back live or to be retried. Without epoll the loop
+ * selects on the live pools' sockets instead. */
+#define STRATUM_EVENTS 64
+/* Seconds between attempts to connect a dead pool */
+#define STRATUM_RETRY_SECS 30
+
+static pthread_mutex_t stratum_pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pool **stratum_pools;
+static int stratum_npools;
+static pthread_once_t stratum_loop_once = PTHREAD_ONCE_INIT;
+#ifdef HAVE_SYS_EPOLL_H
+static int stratum_epfd = -1;
+#endif
+
+static bool stratum_watch(struct pool *pool)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event ev;
+#endif
+	bool ret = true;
+
+	pool->stratum_recvd = time(NULL);
+	mutex_lock(&pool->stratum_lock);
+#ifdef HAVE_SYS_EPOLL_H
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	/* Anything queued while the pool was away goes out first */
+	if (pool->stratum_out_len)
+		ev.events |= EPOLLOUT;
+	ev.data.ptr = pool;
+	ret = !epoll_ctl(stratum_epfd, EPOLL_CTL_ADD, pool->sock, &ev);
+#endif
+	if (ret)
+		pool->stratum_watched = pool->sock;
+	mutex_unlock(&pool->stratum_lock);
+
+	if (!ret)
+		applog(LOG_DEBUG, "Failed to add %s to the stratum event loop", pool->poolname);
+	return ret;
+}
+
+static void stratum_unwatch(struct pool *pool)
+{
+	mutex_lock(&pool->stratum_lock);
+#ifdef HAVE_SYS_EPOLL_H
+	/* A socket closed by suspend_stratum has left the epoll set already,
+	 * and its number may belong to another pool by now */
+	if (pool->sock == pool->stratum_watched)
+		epoll_ctl(stratum_epfd, EPOLL_CTL_DEL, pool->stratum_watched, NULL);
+#endif
+	pool->stratum_watched = 0;
+	mutex_unlock(&pool->stratum_lock);
 }
 
-/* Each pool has one stratum send thread for sending shares to avoid many
- * threads being created for submission since all sends need to be serialised
- * anyway. */
-static void *stratum_sthread(void *userdata)
+#ifdef HAVE_SYS_EPOLL_H
+/* Called under stratum_lock as the pool's queued output fills or drains, so
+ * the loop only waits for the socket to be writable while there is some */
+void stratum_loop_write(struct pool *pool, bool want)
+{
+	struct epoll_event ev;
+
+	if (!pool->stratum_watched || pool->sock != pool->stratum_watched)
+		return;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = want ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	ev.data.ptr = pool;
+	epoll_ctl(stratum_epfd, EPOLL_CTL_MOD, pool->stratum_watched, &ev);
+}
+#endif
+
+/* Shares queued or sent on a session that is gone won't be answered */
+static void drop_stratum_shares(struct pool *pool)
+{
+	mutex_lock(&pool->stratum_lock);
+	pool->stratum_out_len = 0;
+	pool->stratum_out_cut = false;
+	mutex_unlock(&pool->stratum_lock);
+	clear_stratum_shares(pool);
+}
+
+/* Connects a pool for the stratum event loop and hands it back, live or to
+ * be retried. What was queued on the last session only goes out if the pool
+ * resumed it. */
+static void *stratum_connect_thread(void *userdata)
 {
 	struct pool *pool = (struct pool *)userdata;
-	char threadname[16];
+	char threadname[16], *nonce1;
+	bool live, resumed;
 
 	pthread_detach(pthread_self());
 
-	snprintf(threadname, sizeof(threadname), "%d/SStratum", pool->pool_no);
+	snprintf(threadname, sizeof(threadname), "%d/CStratum", pool->pool_no);
 	RenameThread(threadname);
 
-	pool->stratum_q = tq_new();
-	if (!pool->stratum_q)
-		quit(1, "Failed to create stratum_q in stratum_sthread");
-
-	while (42) {
-		char noncehex[12], nonce2hex[20], s[1024];
-		struct stratum_share *sshare;
-		uint32_t *hash32, nonce;
-		unsigned char nonce2[8];
-		uint64_t *nonce2_64;
-		struct work *work;
-		bool submitted;
+	cg_rlock(&pool->data_lock);
+	nonce1 = pool->nonce1 ? strdup(pool->nonce1) : NULL;
+	cg_runlock(&pool->data_lock);
 
-		if (unlikely(pool->removed))
-			break;
+	live = restart_stratum(pool);
+	if (live) {
+		cg_rlock(&pool->data_lock);
+		resumed = (nonce1 && pool->nonce1 && !strcmp(nonce1, pool->nonce1));
+		cg_runlock(&pool->data_lock);
+		if (!resumed)
+			drop_stratum_shares(pool);
+	}
+	if (live && stratum_watch(pool)) {
+		stratum_resumed(pool);
+		pool->stratum_state = STRATUM_LIVE;
+	} else {
+		pool_died(pool);
+		drop_stratum_shares(pool);
+		pool->stratum_retry = time(NULL) + STRATUM_RETRY_SECS;
+		pool->stratum_state = STRATUM_RETRY;
+	}
 
-		work = tq_pop(pool->stratum_q, NULL);
-		if (unlikely(!work))
-			quit(1, "Stratum q returned empty work");
+	free(nonce1);
+	return NULL;
+}
 
-		if (unlikely(work->nonce2_len > 8)) {
-			applog(LOG_ERR, "%s asking for inappropriately long nonce2 length %d", pool->poolname, (int)work->nonce2_len);
-			applog(LOG_ERR, "Not attempting to submit shares");
-			free_work(work);
-			continue;
-		}
+static void stratum_loop_connect(struct pool *pool)
+{
+	pthread_t pth;
 
-		sshare = calloc(sizeof(struct stratum_share), 1);
-		hash32 = (uint32_t *)work->hash;
-		submitted = false;
+	pool->stratum_state = STRATUM_CONNECTING;
+	if (unlikely(pthread_create(&pth, NULL, stratum_connect_thread, (void *)pool)))
+		quit(1, "Failed to create stratum connect thread");
+}
 
-		sshare->sshare_time = time(NULL);
-		/* This work item is freed in parse_stratum_response */
-		sshare->work = work;
-		nonce = *((uint32_t *)(work->data + 76));
-		__bin2hex(noncehex, (const unsigned char *)&nonce, 4);
-		memset(s, 0, 1024);
+/* The connection to a live pool dropped or went quiet */
+static void stratum_lost(struct pool *pool)
+{
+	applog(LOG_NOTICE, "Stratum connection to %s interrupted", pool->poolname);
+	pool->getfail_occasions++;
+	total_go++;
+	stratum_unwatch(pool);
 
-		mutex_lock(&sshare_lock);
-		/* Give the stratum share a unique id */
-		sshare->id = swork_id++;
-		mutex_unlock(&sshare_lock);
+	/* If the socket to our stratum pool disconnects, all tracked
+	 * submitted shares are lost and we will leak the memory if we don't
+	 * discard their records. */
+	if (!supports_resume(pool) || opt_lowmem)
+		drop_stratum_shares(pool);
+	clear_pool_work(pool);
+	if (pool == current_pool())
+		restart_threads();
 
-		nonce2_64 = (uint64_t *)nonce2;
-		*nonce2_64 = htole64(work->nonce2);
-		__bin2hex(nonce2hex, nonce2, work->nonce2_len);
+	stratum_loop_connect(pool);
+}
 
-		snprintf(s, sizeof(s),
-			"{\"params\": [\"%s\", \"%s\", \"%s\", \"%s\", \"%s\"], \"id\": %d, \"method\": \"mining.submit\"}",
-			pool->rpc_user, work->job_id, nonce2hex, work->ntime, noncehex, sshare->id);
+static void stratum_loop_io(struct pool *pool, bool readable, bool writable)
+{
+	bool dead = false;
+	char *s;
 
-		applog(LOG_INFO, "Submitting share %08lx to %s", (long unsigned int)htole32(hash32[6]), pool->poolname);
+	if (pool->stratum_state != STRATUM_LIVE)
+		return;
+	if (writable && !stratum_flush(pool))
+		return;
 
-		/* Try resubmitting for up to 2 minutes if we fail to submit
-		 * once and the stratum pool nonce1 still matches suggesting
-		 * we may be able to resume. */
-		while (time(NULL) < sshare->sshare_time + 120) {
-			bool sessionid_match;
+	while (readable && pool->stratum_watched && pool->stratum_watched == pool->sock &&
+	       (s = recv_line_async(pool, &dead))) {
+		pool->stratum_recvd = time(NULL);
+		stratum_dispatch(pool, s);
+	}
+	if (dead) {
+		applog(LOG_DEBUG, "Socket closed in stratum event loop on %s", pool->poolname);
+		suspend_stratum(pool);
+	}
+}
+
+/* The loop's timers, run once a second for each of its pools */
+static void stratum_loop_tick(struct pool *pool, time_t now)
+{
+	switch (pool->stratum_state) {
+		case STRATUM_LIVE:
+			if (pool->removed) {
+				stratum_unwatch(pool);
+				suspend_stratum(pool);
+				stratum_resolve_free(pool);
+				pool->stratum_state = STRATUM_GONE;
+			} else if (pool->stratum_reconnect) {
+				pool->stratum_reconnect = false;
+				stratum_unwatch(pool);
+				stratum_loop_connect(pool);
+			} else if (!pool->stratum_active)
+				stratum_lost(pool);
+			/* The protocol specifies that notify messages should
+			 * be sent every minute so if we fail to receive any
+			 * for 90 seconds we assume the connection has been
+			 * dropped */
+			else if (now - pool->stratum_recvd >= 90) {
+				applog(LOG_DEBUG, "Stratum event loop timed out on %s", pool->poolname);
+				stratum_lost(pool);
+			} else if (pool->sockbuf_head == pool->sockbuf_tail &&
+				   !pool->stratum_out_len && !cnx_needed(pool)) {
+				applog(LOG_INFO, "Suspending stratum on %s", pool->poolname);
+				stratum_unwatch(pool);
+				suspend_stratum(pool);
+				drop_stratum_shares(pool);
+				clear_pool_work(pool);
+				pool->stratum_state = STRATUM_IDLE;
+			}
+			break;
+		case STRATUM_IDLE:
+		case STRATUM_RETRY:
+			if (pool->removed) {
+				stratum_resolve_free(pool);
+				pool->stratum_state = STRATUM_GONE;
+			} else if (pool->stratum_state == STRATUM_IDLE ?
+				   pool_lpcurrent(pool) : now >= pool->stratum_retry)
+				stratum_loop_connect(pool);
+			break;
+		default:
+			break;
+	}
+}
 
-			if (likely(stratum_send(pool, s, strlen(s)))) {
-				if (pool_tclear(pool, &pool->submit_fail))
-						applog(LOG_WARNING, "%s communication resumed, submitting work", pool->poolname);
+#ifndef HAVE_SYS_EPOLL_H
+static void stratum_loop_select(void)
+{
+	struct timeval timeout = {1, 0};
+	SOCKETTYPE socks[STRATUM_EVENTS], maxfd = 0;
+	struct pool *live[STRATUM_EVENTS];
+	fd_set rd, wr;
+	int i, n = 0;
 
-				mutex_lock(&sshare_lock);
-				HASH_ADD_INT(stratum_shares, id, sshare);
-				pool->sshares++;
-				mutex_unlock(&sshare_lock);
+	FD_ZERO(&rd);
+	FD_ZERO(&wr);
+	mutex_lock(&stratum_pools_lock);
+	for (i = 0; i < stratum_npools && n < STRATUM_EVENTS; i++) {
+		struct pool *pool = stratum_pools[i];
+		SOCKETTYPE sock = pool->stratum_watched;
 
-				applog(LOG_DEBUG, "Successfully submitted, adding to stratum_shares db");
-				submitted = true;
-				break;
-			}
-			if (!pool_tset(pool, &pool->submit_fail) && cnx_needed(pool)) {
-				applog(LOG_WARNING, "%s stratum share submission failure", pool->poolname);
-				total_ro++;
-				pool->remotefail_occasions++;
-			}
+		if (pool->stratum_state != STRATUM_LIVE || !sock || sock != pool->sock)
+			continue;
+		FD_SET(sock, &rd);
+		if (pool->stratum_out_len)
+			FD_SET(sock, &wr);
+		if (sock > maxfd)
+			maxfd = sock;
+		socks[n] = sock;
+		live[n++] = pool;
+	}
+	mutex_unlock(&stratum_pools_lock);
+
+	if (!n) {
+		cgsleep_ms(1000);
+		return;
+	}
+	if (select(maxfd + 1, &rd, &wr, NULL, &timeout) < 1)
+		return;
+	for (i = 0; i < n; i++)
+		stratum_loop_io(live[i], FD_ISSET(socks[i], &rd), FD_ISSET(socks[i], &wr));
+}
+#endif
 
-			if (opt_lowmem) {
-				applog(LOG_DEBUG, "Lowmem option prevents resubmitting stratum share");
-				break;
-			}
+static void *stratum_loop(void __maybe_unused *userdata)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event events[STRATUM_EVENTS];
+#endif
+	time_t ticked = 0;
 
-			cg_rlock(&pool->data_lock);
-			sessionid_match = (pool->nonce1 && !strcmp(work->nonce1, pool->nonce1));
-			cg_runlock(&pool->data_lock);
+	pthread_detach(pthread_self());
+	RenameThread("StratumLoop");
 
-			if (!sessionid_match) {
-				applog(LOG_DEBUG, "No matching session id for resubmitting stratum share");
-				break;
-			}
-			/* Retry every 5 seconds */
-			sleep(5);
+	while (42) {
+		time_t now;
+		int i, n;
+
+#ifdef HAVE_SYS_EPOLL_H
+		n = epoll_wait(stratum_epfd, events, STRATUM_EVENTS, 1000);
+		for (i = 0; i < n; i++) {
+			stratum_loop_io((struct pool *)events[i].data.ptr,
+					events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR),
+					events[i].events & EPOLLOUT);
 		}
+#else
+		stratum_loop_select();
+#endif
 
-		if (unlikely(!submitted)) {
-			applog(LOG_DEBUG, "Failed to submit stratum share, discarding");
-			free_work(work);
-			free(sshare);
-			pool->stale_shares++;
-			total_stale++;
-		} else {
-			int ssdiff;
+		now = time(NULL);
+		if (now == ticked)
+			continue;
+		ticked = now;
 
-			sshare->sshare_sent = time(NULL);
-			ssdiff = sshare->sshare_sent - sshare->sshare_time;
-			if (opt_debug || ssdiff > 0) {
-				applog(LOG_INFO, "Pool %d stratum share submission lag time %d seconds",
-				       pool->pool_no, ssdiff);
-			}
+		mutex_lock(&stratum_pools_lock);
+		for (i = n = 0; i < stratum_npools; i++) {
+			struct pool *pool = stratum_pools[i];
+
+			stratum_loop_tick(pool, now);
+			if (pool->stratum_state != STRATUM_GONE)
+				stratum_pools[n++] = pool;
 		}
+		stratum_npools = n;
+		mutex_unlock(&stratum_pools_lock);
 	}
 
-	/* Freeze the work queue but don't free up its memory in case there is
-	 * work still trying to be submitted to the removed pool. */
-	tq_freeze(pool->stratum_q);
-
 	return NULL;
 }
 
-static void init_stratum_threads(struct pool *pool)
+static void init_stratum_loop(void)
+{
+	pthread_t pth;
+
+#ifdef HAVE_SYS_EPOLL_H
+	stratum_epfd = epoll_create(STRATUM_EVENTS);
+	if (stratum_epfd < 0)
+		quit(1, "Failed to create stratum event loop");
+#endif
+	if (unlikely(pthread_create(&pth, NULL, stratum_loop, NULL)))
+		quit(1, "Failed to create stratum event loop thread");
+}
+
+/* Hands a pool that has just connected for the first time to the stratum
+ * event loop, which owns it from then on */
+static void stratum_loop_add(struct pool *pool)
 {
 	have_longpoll = true;
 
-	if (unlikely(pthread_create(&pool->stratum_sthread, NULL, stratum_sthread, (void *)pool)))
-		quit(1, "Failed to create stratum sthread");
-	if (unlikely(pthread_create(&pool->stratum_rthread, NULL, stratum_rthread, (void *)pool)))
-		quit(1, "Failed to create stratum rthread");
+	pthread_once(&stratum_loop_once, init_stratum_loop);
+
+	mutex_lock(&stratum_pools_lock);
+	stratum_pools = realloc(stratum_pools, sizeof(struct pool *) * (stratum_npools + 1));
+	if (unlikely(!stratum_pools))
+		quit(1, "Failed to realloc stratum_pools in stratum_loop_add");
+	stratum_pools[stratum_npools++] = pool;
+	if (stratum_watch(pool))
+		pool->stratum_state = STRATUM_LIVE;
+	else {
+		pool->stratum_retry = time(NULL);
+		pool->stratum_state = STRATUM_RETRY;
+	}
+	mutex_unlock(&stratum_pools_lock);
 }
 
 static void *longpoll_thread(void *userdata);
@@ -5688,9 +6143,9 @@ static bool pool_active(struct pool *pool, bool pinging)
 	/* This is the central point we activate stratum when we can */
 retry_stratum:
 	if (pool->has_stratum) {
-		/* We create the stratum thread for each pool just after
+		/* We hand each pool to the stratum event loop just after
 		 * successful authorisation. Once the init flag has been set
-		 * we never unset it and the stratum thread is responsible for
+		 * we never unset it and the event loop is responsible for
 		 * setting/unsetting the active flag */
 		bool init = pool_tset(pool, &pool->stratum_init);
 
@@ -5698,7 +6153,7 @@ retry_stratum:
 			bool ret = initiate_stratum(pool) && auth_stratum(pool);
 
 			if (ret)
-				init_stratum_threads(pool);
+				stratum_loop_add(pool);
 			else
 				pool_tclear(pool, &pool->stratum_init);
 			return ret;
@@ -5863,15 +6318,48 @@ static void pool_resus(struct pool *pool)
 		applog(LOG_INFO, "%s alive", pool->poolname);
 }
 
+static bool work_fits(const struct work *work, const struct algorithm *algo)
+{
+	return !algo || algorithm_compatible(pool_algorithm(work->pool), algo);
+}
+
+/* Every pool's work fits algo, so all staged work does */
+static bool pools_fit(const struct algorithm *algo)
+{
+	int i;
+
+	if (!algo)
+		return true;
+	for (i = 0; i < total_pools; i++) {
+		if (!algorithm_compatible(pool_algorithm(pools[i]), algo))
+			return false;
+	}
+	return true;
+}
+
+/* Staged work exists that algo's kernel can mine, stgd_lock held */
+static bool __staged_fits(const struct algorithm *algo, bool all_fit)
+{
+	struct work *work, *tmp;
+
+	if (all_fit)
+		return HASH_COUNT(staged_work) > 0;
+	HASH_ITER(hh, staged_work, work, tmp) {
+		if (work_fits(work, algo))
+			return true;
+	}
+	return false;
+}
+
 /* If this is called non_blocking, it will return NULL for work so that must
- * be handled. */
-static struct work *hash_pop(bool blocking)
+ * be handled. A NULL algo takes work of any pool. */
+static struct work *hash_pop(const struct algorithm *algo, bool blocking)
 {
-	struct work *work = NULL, *tmp;
-	int hc;
+	struct work *work = NULL, *tmp, *tmp2;
+	bool all_fit = pools_fit(algo);
 
 	mutex_lock(stgd_lock);
-	if (!HASH_COUNT(staged_work)) {
+	if (!__staged_fits(algo, all_fit)) {
 		if (!blocking)
 			goto out_unlock;
 		do {
@@ -5882,6 +6370,10 @@ static struct work *hash_pop(bool blocking)
 			cgtime(&now);
 			then.tv_sec = now.tv_sec + 10;
 			then.tv_nsec = now.tv_usec * 1000;
+			/* Have the getwork scheduler make work for this
+			 * kernel if what it stages is for other devices */
+			if (algo && HASH_COUNT(staged_work))
+				algo_starved = algo;
 			pthread_cond_signal(&gws_cond);
 			rc = pthread_cond_timedwait(&getq->cond, stgd_lock, &then);
 			/* Check again for !no_work as multiple threads may be
@@ -5898,7 +6390,7 @@ static struct work *hash_pop(bool blocking)
 				adl_reset_device(i, true, false);
 				#endif
 			}
-		} while (!HASH_COUNT(staged_work));
+		} while (!__staged_fits(algo, all_fit));
 	}
 
 	if (no_work) {
@@ -5906,9 +6398,21 @@ static struct work *hash_pop(bool blocking)
 		no_work = false;
 	}
 
-	hc = HASH_COUNT(staged_work);
-	/* Find clone work if possible, to allow masters to be reused */
-	if (hc > staged_rollable) {
+	/* Find clone work if possible, to allow masters to be reused. With
+	 * pools of one family any staged work will do, and only the rollable
+	 * masters need skipping */
+	if (!all_fit) {
+		HASH_ITER(hh, staged_work, tmp, tmp2) {
+			if (!work_fits(tmp, algo))
+				continue;
+			if (!work)
+				work = tmp;
+			if (!work_rollable(tmp)) {
+				work = tmp;
+				break;
+			}
+		}
+	} else if (HASH_COUNT(staged_work) > staged_rollable) {
 		HASH_ITER(hh, staged_work, work, tmp) {
 			if (!work_rollable(work))
 				break;
@@ -5941,7 +6445,7 @@ static void gen_hash(unsigned char *data, unsigned char *hash, int len)
 	sha256(hash1, 32, hash);
 }
 
-void set_target(unsigned char *dest_target, double diff)
+void set_target(unsigned char *dest_target, double diff, const struct algorithm *algo)
 {
 	unsigned char target[32];
 	uint64_t *data64, h64;
@@ -5954,7 +6458,7 @@ void set_target(unsigned char *dest_target, double diff)
 	}
 
 	// FIXME: is target set right?
-	d64 = (double) DM_SELECT(1, 256, 65536) * truediffone;
+	d64 = (double) DM_SELECT(algo, 1, 256, 65536) * truediffone;
 	d64 /= diff;
 
 	dcut64 = d64 / bits192;
@@ -5994,6 +6498,25 @@ void set_target(unsigned char *dest_target, double diff)
 	memcpy(dest_target, target, 32);
 }
 
+/* Times the first work staged from each notify */
+static void stratum_work_staged(struct pool *pool)
+{
+	struct timeval now, notified;
+
+	if (!pool->tv_notify.tv_sec)
+		return;
+	cgtime(&now);
+	cg_wlock(&pool->data_lock);
+	notified = pool->tv_notify;
+	pool->tv_notify.tv_sec = 0;
+	cg_wunlock(&pool->data_lock);
+	if (notified.tv_sec) {
+		mutex_lock(&stats_lock);
+		latency_add(&pool->sgminer_pool_stats.notify_work, &now, &notified);
+		mutex_unlock(&stats_lock);
+	}
+}
+
 /* Generates stratum based work based on the most recent notify information
  * from the pool. This will keep generating work while a pool is down so we use
  * other means to detect when the pool has died in stratum_thread */
@@ -6010,14 +6533,16 @@ static void gen_stratum_work(struct pool *pool, struct work *work)
 	 * from left to right and prevent overflow errors with small n2sizes */
 	nonce2le = htole64(pool->nonce2);
 	memcpy(pool->coinbase + pool->nonce2_offset, &nonce2le, pool->n2size);
-	work->nonce2 = pool->nonce2++;
+	work->nonce2 = pool->nonce2;
+	/* Stratum proxy clients have the other values of the low bytes */
+	pool->nonce2 += (uint64_t)1 << (8 * stratum_proxy_prefix_len(pool));
 	work->nonce2_len = pool->n2size;
 
 	/* Downgrade to a read lock to read off the pool variables */
 	cg_dwlock(&pool->data_lock);
 
 	/* Generate merkle root */
-	if (gpus[0].kernel == KL_FUGUECOIN || gpus[0].kernel == KL_GROESTLCOIN || gpus[0].kernel == KL_TWECOIN)
+	if (pool_algorithm(pool)->flags & ALGO_SHA256_MERKLE)
 		sha256(pool->coinbase, pool->swork.cb_len, merkle_root);
 	else
 		gen_hash(pool->coinbase, merkle_root, pool->swork.cb_len);
@@ -6059,7 +6584,7 @@ static void gen_stratum_work(struct pool *pool, struct work *work)
 	}
 
 	calc_midstate(work);
-	set_target(work->target, work->sdiff);
+	set_target(work->target, work->sdiff, pool_algorithm(pool));
 
 	local_work++;
 	work->pool = pool;
@@ -6068,7 +6593,7 @@ static void gen_stratum_work(struct pool *pool, struct work *work)
 	work->id = total_work++;
 	work->longpoll = false;
 	work->getwork_mode = GETWORK_MODE_STRATUM;
-	work->work_block = work_block;
+	work->work_block = block_family(work)->work_block;
 	/* Nominally allow a driver to ntime roll 60 seconds */
 	work->drv_rolllimit = 60;
 	calc_diff(work, work->sdiff);
@@ -6085,7 +6610,7 @@ struct work *get_work(struct thr_info *thr, const int thr_id)
 	applog(LOG_DEBUG, "Popping work from get queue to get work");
 	diff_t = time(NULL);
 	while (!work) {
-		work = hash_pop(true);
+		work = hash_pop(kernel_algorithm(thr->cgpu->kernel), true);
 		if (stale_work(work, false)) {
 			discard_work(work);
 			work = NULL;
@@ -6109,6 +6634,57 @@ struct work *get_work(struct thr_info *thr, const int thr_id)
 	return work;
 }
 
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--)
+		hash = (hash ^ *p++) * 1099511628211ULL;
+	return hash;
+}
+
+/* Whether this exact share has already been submitted to the pool since its
+ * last clean job, as happens after restarts re-stage work, remembering it if
+ * not. The open addressed set is emptied when half full. */
+static bool stratum_duplicate(struct pool *pool, struct work *work)
+{
+	uint32_t nonce = *((uint32_t *)(work->data + 76));
+	uint64_t hash = 14695981039346656037ULL;
+	unsigned int slot;
+	bool dup = false;
+
+	hash = fnv1a(hash, work->job_id, strlen(work->job_id) + 1);
+	hash = fnv1a(hash, &work->nonce2, sizeof(work->nonce2));
+	hash = fnv1a(hash, work->ntime, strlen(work->ntime) + 1);
+	hash = fnv1a(hash, &nonce, sizeof(nonce));
+	if (unlikely(!hash))
+		hash = 1;
+
+	cg_wlock(&pool->data_lock);
+	if (unlikely(!pool->shares_seen)) {
+		pool->shares_seen = calloc(SHARES_SEEN, sizeof(uint64_t));
+		if (unlikely(!pool->shares_seen))
+			quit(1, "Failed to calloc shares_seen in stratum_duplicate");
+	}
+	if (pool->shares_seen_count >= SHARES_SEEN / 2) {
+		memset(pool->shares_seen, 0, sizeof(uint64_t) * SHARES_SEEN);
+		pool->shares_seen_count = 0;
+	}
+	for (slot = hash % SHARES_SEEN; pool->shares_seen[slot]; slot = (slot + 1) % SHARES_SEEN) {
+		if (pool->shares_seen[slot] == hash) {
+			dup = true;
+			break;
+		}
+	}
+	if (!dup) {
+		pool->shares_seen[slot] = hash;
+		pool->shares_seen_count++;
+	}
+	cg_wunlock(&pool->data_lock);
+
+	return dup;
+}
+
 /* Submit a copy of the tested, statistic recorded work item asynchronously */
 static void submit_work_async(struct work *work)
 {
@@ -6140,11 +6716,19 @@ static void submit_work_async(struct work *work)
 	}
 
 	if (work->stratum) {
-		applog(LOG_DEBUG, "Pushing %s work to stratum queue", pool->poolname);
-		if (unlikely(!tq_push(pool->stratum_q, work))) {
-			applog(LOG_DEBUG, "Discarding work from removed pool");
+		if (unlikely(stratum_duplicate(pool, work))) {
+			applog(LOG_INFO, "%s duplicate share detected, discarding", pool->poolname);
+			mutex_lock(&stats_lock);
+			pool->duplicate_shares++;
+			mutex_unlock(&stats_lock);
 			free_work(work);
+			return;
 		}
+		if (unlikely(pool->removed)) {
+			applog(LOG_DEBUG, "Discarding work from removed pool");
+			free_work(work);
+		} else
+			stratum_submit_share(pool, work);
 	} else {
 		applog(LOG_DEBUG, "Pushing submit work to work thread");
 		if (unlikely(pthread_create(&submit_thread, NULL, submit_work_thread, (void *)work)))
@@ -6166,68 +6750,34 @@ void inc_hw_errors(struct thr_info *thr)
 }
 
 /* Fills in the work nonce and builds the output data in work->hash */
-static void rebuild_nonce(struct work *work, uint32_t nonce)
+void rebuild_nonce(struct work *work, uint32_t nonce)
 {
 	uint32_t *work_nonce = (uint32_t *)(work->data + 64 + 12);
+	/* The kernel of the device that found it, they may differ */
+	const struct chain *chain = algorithm_chain(kernel_algorithm(get_thr_cgpu(work->thr_id)->kernel));
 
 	*work_nonce = htole32(nonce);
 
-	switch (gpus[0].kernel) {
-		case KL_DARKCOIN:
-		case KL_X11MOD:
-			darkcoin_regenhash(work);
-			break;
-		case KL_QUBITCOIN:
-			qubitcoin_regenhash(work);
-			break;
-		case KL_FRESH:
-			fresh_regenhash(work);
-			break;
-		case KL_QUARKCOIN:
-			quarkcoin_regenhash(work);
-			break;
-		case KL_MYRIADCOIN_GROESTL:
-			myriadcoin_groestl_regenhash(work);
-			break;
-		case KL_FUGUECOIN:
-			fuguecoin_regenhash(work);
-			break;
-		case KL_INKCOIN:
-			inkcoin_regenhash(work);
-			break;
-		case KL_ANIMECOIN:
-			animecoin_regenhash(work);
-			break;
-		case KL_GROESTLCOIN:
-			groestlcoin_regenhash(work);
-			break;
-		case KL_SIFCOIN:
-			sifcoin_regenhash(work);
-			break;
-		case KL_TWECOIN:
-			twecoin_regenhash(work);
-			break;
-		case KL_MARUCOIN:
-		case KL_X13MOD:
-		case KL_X13MODOLD:
-			marucoin_regenhash(work);
-			break;
-		default:
-			scrypt_regenhash(work);
-			break;
-	}
+	if (chain)
+		chain_regenhash(chain, work);
+	else
+		scrypt_regenhash(work);
+}
+
+/* For testing work->hash against diff 1 */
+static bool hash_diff1(const struct work *work)
+{
+	const uint32_t *hash_32 = (const uint32_t *)(work->hash + 28);
+	uint32_t diff1targ = 0x0000ffffUL;
+
+	return (le32toh(*hash_32) <= diff1targ);
 }
 
 /* For testing a nonce against diff 1 */
 bool test_nonce(struct work *work, uint32_t nonce)
 {
-	uint32_t *hash_32 = (uint32_t *)(work->hash + 28);
-	uint32_t diff1targ;
-
 	rebuild_nonce(work, nonce);
-	diff1targ = 0x0000ffffUL;
-
-	return (le32toh(*hash_32) <= diff1targ);
+	return hash_diff1(work);
 }
 
 /* For testing a nonce against an arbitrary diff */
@@ -6236,7 +6786,7 @@ bool test_nonce_diff(struct work *work, uint32_t nonce, double diff)
 	uint64_t *hash64 = (uint64_t *)(work->hash + 24), diff64;
 
 	rebuild_nonce(work, nonce);
-	diff64 = DM_SELECT(0x00000000ffff0000ULL, 0x000000ffff000000ULL, 0x0000ffff00000000ULL);
+	diff64 = DM_SELECT(pool_algorithm(work->pool), 0x00000000ffff0000ULL, 0x000000ffff000000ULL, 0x0000ffff00000000ULL);
 	diff64 /= diff;
 
 	return (le64toh(*hash64) <= diff64);
@@ -6244,12 +6794,12 @@ bool test_nonce_diff(struct work *work, uint32_t nonce, double diff)
 
 static void update_work_stats(struct thr_info *thr, struct work *work)
 {
-	double test_diff = current_diff;
-	test_diff *= DM_SELECT(1, 256, 65536);
+	double test_diff = block_family(work)->diff;
+	test_diff *= DM_SELECT(pool_algorithm(work->pool), 1, 256, 65536);
 
 	work->share_diff = share_diff(work);
 
-	test_diff *= DM_SELECT(1, 256, 65536);
+	test_diff *= DM_SELECT(pool_algorithm(work->pool), 1, 256, 65536);
 
 	if (unlikely(work->share_diff >= test_diff)) {
 		work->block = true;
@@ -6297,6 +6847,63 @@ bool submit_nonce(struct thr_info *thr, struct work *work, uint32_t nonce)
 	return true;
 }
 
+/* Submit the entries nonces a device found in one launch for work. With
+ * hashes, the device already checked each against the full device target
+ * and hashes holds the 32 bytes it got for each: only one in
+ * opt_verify_sample is hashed again, and a device that got one wrong has all
+ * its results hashed from then on. The nonces that are hashed share one
+ * midstate of the header up to the nonce, so a chain only hashes each from
+ * the last block of its first hash on. */
+void submit_nonces(struct thr_info *thr, struct work *work, const uint32_t *nonces, unsigned int entries,
+		   const unsigned char *hashes)
+{
+	struct cgpu_info *cgpu = thr->cgpu;
+	const struct chain *chain = algorithm_chain(kernel_algorithm(cgpu->kernel));
+	uint32_t *work_nonce = (uint32_t *)(work->data + 64 + 12);
+	struct chain_midstate *mid = NULL;
+	unsigned int i;
+
+	for (i = 0; i < entries; i++) {
+		const unsigned char *hash = hashes ? hashes + i * 32 : NULL;
+		bool verify = true;
+
+		applog(LOG_DEBUG, "%s %d: nonce %u found in slot %u", cgpu->drv->name, cgpu->device_id,
+		       nonces[i], i);
+		*work_nonce = htole32(nonces[i]);
+		if (hash) {
+			mutex_lock(&stats_lock);
+			verify = cgpu->verify_all || !(cgpu->verify_count++ % opt_verify_sample);
+			mutex_unlock(&stats_lock);
+		}
+		if (!verify) {
+			memcpy(work->hash, hash, 32);
+			submit_tested_work(thr, work);
+			continue;
+		}
+
+		if (chain) {
+			if (!mid) {
+				mid = chain_midstate_alloc();
+				chain_work_midstate(chain, mid, work);
+			}
+			chain_regenhash_mid(chain, mid, work);
+		} else
+			scrypt_regenhash(work);
+		if (!hash_diff1(work)) {
+			inc_hw_errors(thr);
+			continue;
+		}
+		if (hash && unlikely(memcmp(work->hash, hash, 32))) {
+			if (!cgpu->verify_all)
+				applog(LOG_WARNING, "%s %d: Device hash differs from the CPU one, rehashing all its results",
+				       cgpu->drv->name, cgpu->device_id);
+			cgpu->verify_all = true;
+		}
+		submit_tested_work(thr, work);
+	}
+	free(mid);
+}
+
 /* Allows drivers to submit work items where the driver has changed the ntime
  * value by noffset. Must be only used with a work protocol that does not ntime
  * roll itself intrinsically to generate work (eg stratum). We do not touch
@@ -6402,7 +7009,7 @@ static void hash_sole_work(struct thr_info *mythr)
 			work->device_diff = MIN(drv->working_diff, work->work_difficulty);
 		} else if (drv->working_diff > work->work_difficulty)
 			drv->working_diff = work->work_difficulty;
-		set_target(work->device_target, work->device_diff);
+		set_target(work->device_target, work->device_diff, pool_algorithm(work->pool));
 
 		do {
 			cgtime(&tv_start);
@@ -6843,7 +7450,12 @@ void *miner_thread(void *userdata)
 	applog(LOG_DEBUG, "Waiting on sem in miner thread");
 	cgsem_wait(&mythr->sem);
 
-	set_highprio();
+	/* CPU hashing threads would starve the rest of sgminer at high
+	 * priority */
+	if (drv->drv_id == DRIVER_cpu)
+		set_lowprio();
+	else
+		set_highprio();
 	drv->hash_work(mythr);
 out:
 	drv->thread_shutdown(mythr);
@@ -6930,14 +7542,21 @@ static struct pool *select_longpoll_pool(struct pool *cp)
 }
 #endif /* HAVE_LIBCURL */
 
+/* Whether a pool's longpoll or stratum connection should be open: it's the
+ * current pool, or it has been flagged as rejecting, or all pools are used */
+static bool pool_lpcurrent(struct pool *pool)
+{
+	return cnx_needed(pool) || (pool->state != POOL_DISABLED &&
+	       (pool == current_pool() || pool_strategy == POOL_LOADBALANCE ||
+		pool_strategy == POOL_BALANCE));
+}
+
 /* This will make the longpoll thread wait till it's the current pool, or it
  * has been flagged as rejecting, before attempting to open any connections.
  */
 static void wait_lpcurrent(struct pool *pool)
 {
-	while (!cnx_needed(pool) && (pool->state == POOL_DISABLED ||
-	       (pool != current_pool() && pool_strategy != POOL_LOADBALANCE &&
-	       pool_strategy != POOL_BALANCE))) {
+	while (!pool_lpcurrent(pool)) {
 		mutex_lock(&lp_lock);
 		pthread_cond_wait(&lp_cond, &lp_lock);
 		mutex_unlock(&lp_lock);
@@ -7931,7 +8550,6 @@ int main(int argc, char *argv[])
 {
 	struct sigaction handler;
 	struct thr_info *thr;
-	struct block *block;
 	unsigned int k;
 	int i, j;
 	char *s;
@@ -8009,13 +8627,8 @@ int main(int argc, char *argv[])
 	logstart = devcursor + 1;
 	logcursor = logstart + 1;
 
-	block = calloc(sizeof(struct block), 1);
-	if (unlikely(!block))
-		quit (1, "main OOM");
 	for (i = 0; i < 36; i++)
-		strcat(block->hash, "0");
-	HASH_ADD_STR(blocks, hash, block);
-	strcpy(current_hash, block->hash);
+		strcat(current_hash, "0");
 
 	INIT_LIST_HEAD(&scan_devices);
 
@@ -8036,6 +8649,9 @@ int main(int argc, char *argv[])
 	if (!config_loaded)
 		load_default_config();
 
+	if (!init_algorithms())
+		quit(1, "Failed to parse the algorithm chains");
+
 	if (opt_benchmark) {
 		struct pool *pool;
 
@@ -8052,7 +8668,7 @@ int main(int argc, char *argv[])
 	}
 
 #ifdef HAVE_CURSES
-	if (opt_realquiet || opt_display_devs)
+	if (opt_realquiet || opt_display_devs || opt_autotune)
 		use_curses = false;
 
 	if (use_curses)
@@ -8095,6 +8711,7 @@ int main(int argc, char *argv[])
 	DRIVER_PARSE_COMMANDS(DRIVER_FILL_DEVICE_DRV)
 
 	opencl_drv.drv_detect(false);
+	cpu_drv.drv_detect(false);
 
 	if (opt_display_devs) {
 		applog(LOG_ERR, "Devices detected:");
@@ -8130,6 +8747,11 @@ int main(int argc, char *argv[])
 	if (!total_devices)
 		quit(1, "All devices disabled, cannot mine!");
 
+	if (opt_autotune) {
+		autotune_devices();
+		quit(0, "Autotune finished");
+	}
+
 	most_devices = total_devices;
 
 	load_temp_cutoffs();
@@ -8327,6 +8949,9 @@ begin_bench:
 	if (thr_info_create(thr, NULL, reinit_gpu, thr))
 		quit(1, "reinit_gpu thread create failed");
 
+	if (opt_stratum_proxy)
+		stratum_proxy_start();
+
 	/* Create API socket thread */
 	api_thr_id = 5;
 	thr = &control_thr[api_thr_id];
@@ -8351,6 +8976,7 @@ begin_bench:
 	/* Once everything is set up, main() becomes the getwork scheduler */
 	while (42) {
 		int ts, max_staged = opt_queue;
+		const struct algorithm *starved;
 		struct pool *pool, *cp;
 		bool lagging = false;
 		struct timespec then;
@@ -8377,18 +9003,26 @@ begin_bench:
 		if (!pool_localgen(cp) && !ts && !opt_fail_only)
 			lagging = true;
 
-		/* Wait until hash_pop tells us we need to create more work */
-		if (ts > max_staged) {
+		/* Wait until hash_pop tells us we need to create more work.
+		 * A starved kernel no pool can feed is ignored: staging work
+		 * for it would only wake its device to starve again. */
+		if (algo_starved && !select_algorithm_pool(algo_starved))
+			algo_starved = NULL;
+		if (ts > max_staged && !algo_starved) {
 			pthread_cond_timedwait(&gws_cond, stgd_lock, &then);
 			ts = __total_staged();
+			if (algo_starved && !select_algorithm_pool(algo_starved))
+				algo_starved = NULL;
 		}
+		starved = algo_starved;
+		algo_starved = NULL;
 		mutex_unlock(stgd_lock);
 
-		if (ts > max_staged) {
+		if (ts > max_staged && !starved) {
 			/* Keeps slowly generating work even if it's not being
 			 * used to keep last_getwork incrementing and to see
 			 * if pools are still alive. */
-			work = hash_pop(false);
+			work = hash_pop(NULL, false);
 			if (work)
 				discard_work(work);
 			continue;
@@ -8403,14 +9037,19 @@ begin_bench:
 			if (!pool_localgen(cp))
 				applog(LOG_INFO, "Increasing queue to %d", ++opt_queue);
 		}
-		pool = select_pool(lagging);
+		pool = select_work_pool(lagging, starved);
+		/* The starved kernel's last pool went since the check above */
+		if (unlikely(!pool)) {
+			free_work(work);
+			continue;
+		}
 retry:
 		if (pool->has_stratum) {
 			while (!pool->stratum_active || !pool->stratum_notify) {
-				struct pool *altpool = select_pool(true);
+				struct pool *altpool = select_work_pool(true, starved);
 
 				cgsleep_ms(5000);
-				if (altpool != pool) {
+				if (altpool && altpool != pool) {
 					pool = altpool;
 					goto retry;
 				}
@@ -8418,6 +9057,7 @@ retry:
 			gen_stratum_work(pool, work);
 			applog(LOG_DEBUG, "Generated stratum work");
 			stage_work(work);
+			stratum_work_staged(pool);
 			continue;
 		}
 
@@ -8433,10 +9073,10 @@ retry:
 
 		if (pool->has_gbt) {
 			while (pool->idle) {
-				struct pool *altpool = select_pool(true);
+				struct pool *altpool = select_work_pool(true, starved);
 
 				cgsleep_ms(5000);
-				if (altpool != pool) {
+				if (altpool && altpool != pool) {
 					pool = altpool;
 					goto retry;
 				}
@@ -8457,6 +9097,8 @@ retry:
 		ce = pop_curl_entry(pool);
 		/* obtain new work from bitcoin via JSON-RPC */
 		if (!get_upstream_work(work, ce->curl)) {
+			struct pool *altpool;
+
 			applog(LOG_DEBUG, "%s json_rpc_call failed on get work, retrying in 5s", pool->poolname);
 			/* Make sure the pool just hasn't stopped serving
 			 * requests but is up as we'll keep hammering it */
@@ -8464,7 +9106,9 @@ retry:
 				pool_died(pool);
 			cgsleep_ms(5000);
 			push_curl_entry(ce, pool);
-			pool = select_pool(!opt_fail_only);
+			altpool = select_work_pool(!opt_fail_only, starved);
+			if (altpool)
+				pool = altpool;
 			goto retry;
 		}
 		if (ts >= max_staged)
@@ -787,6 +787,24 @@ bool tq_push(struct thread_q *tq, void *data)
 	return rc;
 }
 
+/* Pops without waiting, NULL if the queue is empty */
+void *tq_trypop(struct thread_q *tq)
+{
+	struct tq_ent *ent;
+	void *rval = NULL;
+
+	mutex_lock(&tq->mutex);
+	if (!list_empty(&tq->q)) {
+		ent = list_entry(tq->q.next, struct tq_ent, q_node);
+		rval = ent->data;
+		list_del(&ent->q_node);
+		free(ent);
+	}
+	mutex_unlock(&tq->mutex);
+
+	return rval;
+}
+
 void *tq_pop(struct thread_q *tq, const struct timespec *abstime)
 {
 	struct tq_ent *ent;
@@ -1188,6 +1206,37 @@ double tdiff(struct timeval *end, struct timeval *start)
 	return end->tv_sec - start->tv_sec + (end->tv_usec - start->tv_usec) / 1000000.0;
 }
 
+/* Called with stats_lock held, samples come from several threads */
+void latency_add(struct latency_histogram *hist, struct timeval *end, struct timeval *start)
+{
+	double us = us_tdiff(end, start);
+	int i = 0;
+
+	while (i < LATENCY_BUCKETS - 1 && us >= (double)(1 << i))
+		i++;
+	hist->bucket[i]++;
+	hist->count++;
+}
+
+/* The latency in ms under which pct percent of the samples fell, to within
+ * a factor of two as the bucket's upper bound, 0 without samples */
+double latency_percentile(const struct latency_histogram *hist, double pct)
+{
+	uint64_t seen = 0;
+	double want;
+	int i;
+
+	if (!hist->count)
+		return 0;
+	want = hist->count * pct / 100;
+	for (i = 0; i < LATENCY_BUCKETS - 1; i++) {
+		seen += hist->bucket[i];
+		if (seen >= want)
+			break;
+	}
+	return (double)(1 << i) / 1000;
+}
+
 bool extract_sockaddr(char *url, char **sockaddr_url, char **sockaddr_port)
 {
 	char *url_begin, *url_end, *ipv6_begin, *ipv6_end, *port_start = NULL;
@@ -1245,16 +1294,23 @@ enum send_ret {
 	SEND_INACTIVE
 };
 
-/* Send a single command across a socket, appending \n to it. This should all
- * be done under stratum lock except when first establishing the socket */
-static enum send_ret __stratum_send(struct pool *pool, char *s, ssize_t len)
+static ssize_t sock_send(SOCKETTYPE sock, const char *s, size_t len)
+{
+#ifdef __APPLE__
+	return send(sock, s, len, SO_NOSIGPIPE);
+#elif WIN32
+	return send(sock, s, len, 0);
+#else
+	return send(sock, s, len, MSG_NOSIGNAL);
+#endif
+}
+
+/* Sends len bytes of s, which are already newline terminated */
+static enum send_ret __stratum_write(struct pool *pool, const char *s, ssize_t len)
 {
 	SOCKETTYPE sock = pool->sock;
 	ssize_t ssent = 0;
 
-	strcat(s, "\n");
-	len++;
-
 	while (len > 0 ) {
 		struct timeval timeout = {1, 0};
 		ssize_t sent;
@@ -1267,13 +1323,7 @@ retry:
 				goto retry;
 			return SEND_SELECTFAIL;
 		}
-#ifdef __APPLE__
-		sent = send(pool->sock, s + ssent, len, SO_NOSIGPIPE);
-#elif WIN32
-		sent = send(pool->sock, s + ssent, len, 0);
-#else
-		sent = send(pool->sock, s + ssent, len, MSG_NOSIGNAL);
-#endif
+		sent = sock_send(sock, s + ssent, len);
 		if (sent < 0) {
 			if (!sock_blocks())
 				return SEND_SENDFAIL;
@@ -1289,18 +1339,132 @@ retry:
 	return SEND_OK;
 }
 
-bool stratum_send(struct pool *pool, char *s, ssize_t len)
+/* Send a single command across a socket, appending \n to it. This should all
+ * be done under stratum lock except when first establishing the socket */
+static enum send_ret __stratum_send(struct pool *pool, char *s, ssize_t len)
 {
-	enum send_ret ret = SEND_INACTIVE;
+	strcat(s, "\n");
+	return __stratum_write(pool, s, len + 1);
+}
+
+/* Sends what the socket takes of the pool's queued output without blocking,
+ * under stratum_lock. Returns false if the send failed. */
+static bool __stratum_flush(struct pool *pool)
+{
+	ssize_t sent;
+
+	if (!pool->stratum_out_len)
+		return true;
+	sent = sock_send(pool->sock, pool->stratum_out, pool->stratum_out_len);
+	if (sent < 0)
+		return sock_blocks() || interrupted();
+
+	if (!sent)
+		return true;
+	pool->stratum_out_len -= sent;
+	pool->stratum_out_cut = pool->stratum_out_len && pool->stratum_out[sent - 1] != '\n';
+	memmove(pool->stratum_out, pool->stratum_out + sent, pool->stratum_out_len);
+	pool->sgminer_pool_stats.times_sent++;
+	pool->sgminer_pool_stats.bytes_sent += sent;
+	pool->sgminer_pool_stats.net_bytes_sent += sent;
+#ifdef HAVE_SYS_EPOLL_H
+	if (!pool->stratum_out_len)
+		stratum_loop_write(pool, false);
+#endif
+	return true;
+}
+
+/* For the stratum event loop: sends what it can of the pool's queued output
+ * when the socket is writable. A failed send closes the socket. */
+bool stratum_flush(struct pool *pool)
+{
+	bool ret;
+
+	mutex_lock(&pool->stratum_lock);
+	/* Once closed, the loop finds the pool inactive */
+	ret = (pool->sock != pool->stratum_watched || __stratum_flush(pool));
+	mutex_unlock(&pool->stratum_lock);
+
+	if (!ret) {
+		applog(LOG_DEBUG, "Failed to send in stratum_flush");
+		suspend_stratum(pool);
+	}
+	return ret;
+}
+
+/* Queues len bytes of newline terminated lines for the stratum event loop to
+ * send on the pool's connection, now or once it is back. With first set they
+ * go ahead of everything queued that isn't part sent. */
+void stratum_queue_lines(struct pool *pool, const char *s, size_t len, bool first)
+{
+	bool ok = true;
+	size_t at;
 
 	if (opt_protocol)
-		applog(LOG_DEBUG, "SEND: %s", s);
+		applog(LOG_DEBUG, "SEND: %.*s", (int)len - 1, s);
 
 	mutex_lock(&pool->stratum_lock);
-	if (pool->stratum_active)
-		ret = __stratum_send(pool, s, len);
+	if (pool->stratum_out_len + len > pool->stratum_out_size) {
+		size_t new = pool->stratum_out_len + len;
+
+		new += RBUFSIZE - (new % RBUFSIZE);
+		pool->stratum_out = realloc(pool->stratum_out, new);
+		if (unlikely(!pool->stratum_out))
+			quithere(1, "Failed to realloc pool stratum_out");
+		pool->stratum_out_size = new;
+	}
+	at = pool->stratum_out_len;
+	if (first) {
+		char *eol = NULL;
+
+		if (pool->stratum_out_cut)
+			eol = memchr(pool->stratum_out, '\n', pool->stratum_out_len);
+		at = eol ? (size_t)(eol - pool->stratum_out) + 1 : 0;
+		memmove(pool->stratum_out + at + len, pool->stratum_out + at, pool->stratum_out_len - at);
+	}
+	memcpy(pool->stratum_out + at, s, len);
+	pool->stratum_out_len += len;
+
+	if (pool->stratum_out_len == len && pool->stratum_watched &&
+	    pool->sock == pool->stratum_watched) {
+#ifdef HAVE_SYS_EPOLL_H
+		stratum_loop_write(pool, true);
+#else
+		/* The select loop only builds its sets once a second, so
+		 * don't leave the send waiting for it */
+		ok = __stratum_flush(pool);
+#endif
+	}
+	mutex_unlock(&pool->stratum_lock);
+
+	if (!ok) {
+		applog(LOG_DEBUG, "Failed to send in stratum_queue_lines");
+		suspend_stratum(pool);
+	}
+}
+
+/* Sends one or more newline terminated lines, queued for the stratum event
+ * loop once it has the connection and written straight out while the pool
+ * is still being connected */
+bool stratum_send_lines(struct pool *pool, const char *s, ssize_t len)
+{
+	enum send_ret ret = SEND_INACTIVE;
+	bool queue;
+
+	if (opt_protocol && !pool->stratum_watched)
+		applog(LOG_DEBUG, "SEND: %.*s", (int)len - 1, s);
+
+	mutex_lock(&pool->stratum_lock);
+	queue = pool->stratum_active && pool->stratum_watched;
+	if (pool->stratum_active && !queue)
+		ret = __stratum_write(pool, s, len);
 	mutex_unlock(&pool->stratum_lock);
 
+	if (queue) {
+		stratum_queue_lines(pool, s, len, false);
+		return true;
+	}
+
 	/* This is to avoid doing applog under stratum_lock */
 	switch (ret) {
 		default:
@@ -1321,6 +1485,12 @@ bool stratum_send(struct pool *pool, char *s, ssize_t len)
 	return (ret == SEND_OK);
 }
 
+bool stratum_send(struct pool *pool, char *s, ssize_t len)
+{
+	strcat(s, "\n");
+	return stratum_send_lines(pool, s, len + 1);
+}
+
 static bool socket_full(struct pool *pool, int wait)
 {
 	SOCKETTYPE sock = pool->sock;
@@ -1341,7 +1511,7 @@ static bool socket_full(struct pool *pool, int wait)
 /* Check to see if Santa's been good to you */
 bool sock_full(struct pool *pool)
 {
-	if (strlen(pool->sockbuf))
+	if (pool->sockbuf_head < pool->sockbuf_tail)
 		return true;
 
 	return (socket_full(pool, 0));
@@ -1349,7 +1519,7 @@ bool sock_full(struct pool *pool)
 
 static void clear_sockbuf(struct pool *pool)
 {
-	strcpy(pool->sockbuf, "");
+	pool->sockbuf_head = pool->sockbuf_tail = pool->sockbuf_scan = 0;
 }
 
 static void clear_sock(struct pool *pool)
@@ -1368,36 +1538,79 @@ static void clear_sock(struct pool *pool)
 	clear_sockbuf(pool);
 }
 
-/* Make sure the pool sockbuf is large enough to cope with any coinbase size
- * by reallocing it to a large enough size rounded up to a multiple of RBUFSIZE
- * and zeroing the new memory */
+/* Make room for len more bytes after the unread data in the pool sockbuf,
+ * first by moving what is unread back to the start and only then by
+ * reallocing it to a large enough size rounded up to a multiple of RBUFSIZE */
 static void recalloc_sock(struct pool *pool, size_t len)
 {
-	size_t old, new;
+	size_t used = pool->sockbuf_tail - pool->sockbuf_head, new;
 
-	old = strlen(pool->sockbuf);
-	new = old + len + 1;
-	if (new < pool->sockbuf_size)
+	if (pool->sockbuf_tail + len + 1 <= pool->sockbuf_size)
 		return;
+	if (pool->sockbuf_head) {
+		memmove(pool->sockbuf, pool->sockbuf + pool->sockbuf_head, used);
+		pool->sockbuf_scan -= pool->sockbuf_head;
+		pool->sockbuf_tail = used;
+		pool->sockbuf_head = 0;
+		if (used + len + 1 <= pool->sockbuf_size)
+			return;
+	}
+	new = used + len + 1;
 	new = new + (RBUFSIZE - (new % RBUFSIZE));
 	// Avoid potentially recursive locking
 	// applog(LOG_DEBUG, "Recallocing pool sockbuf to %d", new);
 	pool->sockbuf = realloc(pool->sockbuf, new);
 	if (!pool->sockbuf)
 		quithere(1, "Failed to realloc pool sockbuf");
-	memset(pool->sockbuf + old, 0, new - old);
 	pool->sockbuf_size = new;
 }
 
-/* Peeks at a socket to find the first end of line and then reads just that
- * from the socket and returns that as a malloced char */
+/* Finds the end of the first line in the unread data, searching only the
+ * bytes that arrived since the last look. Empty lines are skipped. */
+static char *sockbuf_eol(struct pool *pool)
+{
+	char *eol;
+
+	while (pool->sockbuf_head < pool->sockbuf_tail && pool->sockbuf[pool->sockbuf_head] == '\n')
+		pool->sockbuf_head++;
+	if (pool->sockbuf_scan < pool->sockbuf_head)
+		pool->sockbuf_scan = pool->sockbuf_head;
+
+	eol = memchr(pool->sockbuf + pool->sockbuf_scan, '\n', pool->sockbuf_tail - pool->sockbuf_scan);
+	pool->sockbuf_scan = eol ? (size_t)(eol - pool->sockbuf) : pool->sockbuf_tail;
+	return eol;
+}
+
+/* Takes the line ending at eol out of sockbuf, replacing the \n with a \0.
+ * The line itself stays where it is until the next read. */
+static char *sockbuf_line(struct pool *pool, char *eol)
+{
+	char *line = pool->sockbuf + pool->sockbuf_head;
+	size_t len = eol - line;
+
+	*eol = '\0';
+	pool->sockbuf_head = pool->sockbuf_scan = eol - pool->sockbuf + 1;
+	if (pool->sockbuf_head == pool->sockbuf_tail)
+		clear_sockbuf(pool);
+
+	pool->sgminer_pool_stats.times_received++;
+	pool->sgminer_pool_stats.bytes_received += len;
+	pool->sgminer_pool_stats.net_bytes_received += len;
+	if (opt_protocol)
+		applog(LOG_DEBUG, "RECVD: %s", line);
+	return line;
+}
+
+/* Reads from the socket until the pool sockbuf holds a whole line and
+ * returns that line where it lies in sockbuf, with the \n replaced by a \0.
+ * It stays valid until the next recv_line on the pool and is not freed. */
 char *recv_line(struct pool *pool)
 {
-	char *tok, *sret = NULL;
-	ssize_t len, buflen;
+	char *eol, *sret = NULL;
 	int waited = 0;
 
-	if (!strstr(pool->sockbuf, "\n")) {
+	eol = sockbuf_eol(pool);
+	if (!eol) {
 		struct timeval rstart, now;
 
 		cgtime(&rstart);
@@ -1407,12 +1620,10 @@ char *recv_line(struct pool *pool)
 		}
 
 		do {
-			char s[RBUFSIZE];
-			size_t slen;
 			ssize_t n;
 
-			memset(s, 0, RBUFSIZE);
-			n = recv(pool->sock, s, RECVSIZE, 0);
+			recalloc_sock(pool, RECVSIZE);
+			n = recv(pool->sock, pool->sockbuf + pool->sockbuf_tail, RECVSIZE, 0);
 			if (!n) {
 				applog(LOG_DEBUG, "Socket closed waiting in recv_line");
 				suspend_stratum(pool);
@@ -1427,40 +1638,47 @@ char *recv_line(struct pool *pool)
 					break;
 				}
 			} else {
-				slen = strlen(s);
-				recalloc_sock(pool, slen);
-				strcat(pool->sockbuf, s);
+				pool->sockbuf_tail += n;
+				eol = sockbuf_eol(pool);
 			}
-		} while (waited < DEFAULT_SOCKWAIT && !strstr(pool->sockbuf, "\n"));
+		} while (waited < DEFAULT_SOCKWAIT && !eol);
 	}
 
-	buflen = strlen(pool->sockbuf);
-	tok = strtok(pool->sockbuf, "\n");
-	if (!tok) {
+	if (!eol) {
 		applog(LOG_DEBUG, "Failed to parse a \\n terminated string in recv_line");
 		goto out;
 	}
-	sret = strdup(tok);
-	len = strlen(sret);
-
-	/* Copy what's left in the buffer after the \n, including the
-	 * terminating \0 */
-	if (buflen > len + 1)
-		memmove(pool->sockbuf, pool->sockbuf + len + 1, buflen - len + 1);
-	else
-		strcpy(pool->sockbuf, "");
-
-	pool->sgminer_pool_stats.times_received++;
-	pool->sgminer_pool_stats.bytes_received += len;
-	pool->sgminer_pool_stats.net_bytes_received += len;
+	sret = sockbuf_line(pool, eol);
 out:
 	if (!sret)
 		clear_sock(pool);
-	else if (opt_protocol)
-		applog(LOG_DEBUG, "RECVD: %s", sret);
 	return sret;
 }
 
+/* For the stratum event loop: takes in whatever the socket has without
+ * blocking and returns the next whole line as recv_line does. NULL with
+ * dead clear means the rest of the line hasn't arrived yet. */
+char *recv_line_async(struct pool *pool, bool *dead)
+{
+	char *eol = sockbuf_eol(pool);
+	ssize_t n;
+
+	*dead = false;
+	if (eol)
+		return sockbuf_line(pool, eol);
+
+	recalloc_sock(pool, RECVSIZE);
+	n = recv(pool->sock, pool->sockbuf + pool->sockbuf_tail, RECVSIZE, 0);
+	if (n > 0) {
+		pool->sockbuf_tail += n;
+		eol = sockbuf_eol(pool);
+		return eol ? sockbuf_line(pool, eol) : NULL;
+	}
+	if (!n || (!sock_blocks() && !interrupted()))
+		*dead = true;
+	return NULL;
+}
+
 /* Extracts a string value from a json array with error checking. To be used
  * when the value of the string returned is only examined and not to be stored.
  * See json_array_string below */
@@ -1493,91 +1711,79 @@ static char *json_array_string(json_t *val, unsigned int entry)
 
 static char *blank_merkel = "0000000000000000000000000000000000000000000000000000000000000000";
 
-static bool parse_notify(struct pool *pool, json_t *val)
-{
-	char *job_id, *prev_hash, *coinbase1, *coinbase2, *bbversion, *nbit,
-	     *ntime, *header;
-	size_t cb1_len, cb2_len, alloc_len;
-	unsigned char *cb1, *cb2;
-	bool clean, ret = false;
-	int merkles, i;
-	json_t *arr;
+/* Blocks never carry anywhere near 2^32 transactions */
+#define MAX_MERKLES 32
 
-	arr = json_array_get(val, 4);
-	if (!arr || !json_is_array(arr))
-		goto out;
+/* The fields of a mining.notify, pointing into the message they came from */
+struct stratum_notify {
+	struct stratum_span job_id, prev_hash, coinbase1, coinbase2, bbversion,
+			    nbit, ntime;
+	struct stratum_span merkle[MAX_MERKLES];
+	int merkles;
+	bool clean;
+};
 
-	merkles = json_array_size(arr);
-
-	job_id = json_array_string(val, 0);
-	prev_hash = json_array_string(val, 1);
-	coinbase1 = json_array_string(val, 2);
-	coinbase2 = json_array_string(val, 3);
-	bbversion = json_array_string(val, 5);
-	nbit = json_array_string(val, 6);
-	ntime = json_array_string(val, 7);
-	clean = json_is_true(json_array_get(val, 8));
-
-	if (!job_id || !prev_hash || !coinbase1 || !coinbase2 || !bbversion || !nbit || !ntime) {
-		/* Annoying but we must not leak memory */
-		if (job_id)
-			free(job_id);
-		if (prev_hash)
-			free(prev_hash);
-		if (coinbase1)
-			free(coinbase1);
-		if (coinbase2)
-			free(coinbase2);
-		if (bbversion)
-			free(bbversion);
-		if (nbit)
-			free(nbit);
-		if (ntime)
-			free(ntime);
-		goto out;
+/* Copies span into *str, only reallocing when it has grown */
+static void swork_string(char **str, const struct stratum_span *span)
+{
+	if (!*str || strlen(*str) < span->len) {
+		free(*str);
+		*str = malloc(span->len + 1);
+		if (unlikely(!*str))
+			quit(1, "Failed to malloc swork string in parse_notify");
 	}
+	memcpy(*str, span->s, span->len);
+	(*str)[span->len] = '\0';
+}
+
+/* Installs a new stratum job. The swork strings, merkle branches and
+ * coinbase are reused across notifies rather than allocated afresh. */
+static bool stratum_notify(struct pool *pool, const struct stratum_notify *n)
+{
+	size_t cb1_len, cb2_len, alloc_len;
+	char *header;
+	int i;
+
+	cb1_len = n->coinbase1.len / 2;
+	cb2_len = n->coinbase2.len / 2;
 
 	cg_wlock(&pool->data_lock);
-	free(pool->swork.job_id);
-	free(pool->swork.prev_hash);
-	free(pool->swork.bbversion);
-	free(pool->swork.nbit);
-	free(pool->swork.ntime);
-	pool->swork.job_id = job_id;
-	pool->swork.prev_hash = prev_hash;
-	cb1_len = strlen(coinbase1) / 2;
-	cb2_len = strlen(coinbase2) / 2;
-	pool->swork.bbversion = bbversion;
-	pool->swork.nbit = nbit;
-	pool->swork.ntime = ntime;
-	pool->swork.clean = clean;
+	cgtime(&pool->tv_notify);
+	swork_string(&pool->swork.job_id, &n->job_id);
+	swork_string(&pool->swork.prev_hash, &n->prev_hash);
+	swork_string(&pool->swork.bbversion, &n->bbversion);
+	swork_string(&pool->swork.nbit, &n->nbit);
+	swork_string(&pool->swork.ntime, &n->ntime);
+	pool->swork.clean = n->clean;
 	alloc_len = pool->swork.cb_len = cb1_len + pool->n1_len + pool->n2size + cb2_len;
 	pool->nonce2_offset = cb1_len + pool->n1_len;
 
-	for (i = 0; i < pool->swork.merkles; i++)
-		free(pool->swork.merkle_bin[i]);
-	if (merkles) {
+	if (n->merkles > pool->swork.merkle_alloc) {
 		pool->swork.merkle_bin = realloc(pool->swork.merkle_bin,
-						 sizeof(char *) * merkles + 1);
-		for (i = 0; i < merkles; i++) {
-			char *merkle = json_array_string(arr, i);
-
+						 sizeof(char *) * n->merkles);
+		if (unlikely(!pool->swork.merkle_bin))
+			quit(1, "Failed to realloc pool swork merkle_bin");
+		for (i = pool->swork.merkle_alloc; i < n->merkles; i++) {
 			pool->swork.merkle_bin[i] = malloc(32);
 			if (unlikely(!pool->swork.merkle_bin[i]))
 				quit(1, "Failed to malloc pool swork merkle_bin");
-			hex2bin(pool->swork.merkle_bin[i], merkle, 32);
-			free(merkle);
 		}
+		pool->swork.merkle_alloc = n->merkles;
 	}
-	pool->swork.merkles = merkles;
-	if (clean)
+	for (i = 0; i < n->merkles; i++)
+		hex2bin(pool->swork.merkle_bin[i], n->merkle[i].s, 32);
+	pool->swork.merkles = n->merkles;
+	if (n->clean) {
 		pool->nonce2 = 0;
-	pool->merkle_offset = strlen(pool->swork.bbversion) +
-			      strlen(pool->swork.prev_hash);
+		if (pool->shares_seen)
+			memset(pool->shares_seen, 0, sizeof(uint64_t) * SHARES_SEEN);
+		pool->shares_seen_count = 0;
+	}
+	pool->merkle_offset = n->bbversion.len + n->prev_hash.len;
 	pool->swork.header_len = pool->merkle_offset +
 	/* merkle_hash */	 32 +
-				 strlen(pool->swork.ntime) +
-				 strlen(pool->swork.nbit) +
+				 n->ntime.len +
+				 n->nbit.len +
 	/* nonce */		 8 +
 	/* workpadding */	 96;
 	pool->merkle_offset /= 2;
@@ -1596,54 +1802,86 @@ static bool parse_notify(struct pool *pool, json_t *val)
 	if (unlikely(!hex2bin(pool->header_bin, header, 128)))
 		quit(1, "Failed to convert header to header_bin in parse_notify");
 
-	cb1 = calloc(cb1_len, 1);
-	if (unlikely(!cb1))
-		quithere(1, "Failed to calloc cb1 in parse_notify");
-	hex2bin(cb1, coinbase1, cb1_len);
-	cb2 = calloc(cb2_len, 1);
-	if (unlikely(!cb2))
-		quithere(1, "Failed to calloc cb2 in parse_notify");
-	hex2bin(cb2, coinbase2, cb2_len);
-	free(pool->coinbase);
 	align_len(&alloc_len);
-	pool->coinbase = calloc(alloc_len, 1);
-	if (unlikely(!pool->coinbase))
-		quit(1, "Failed to calloc pool coinbase in parse_notify");
-	memcpy(pool->coinbase, cb1, cb1_len);
+	if (alloc_len > pool->coinbase_alloc) {
+		free(pool->coinbase);
+		pool->coinbase = calloc(alloc_len, 1);
+		if (unlikely(!pool->coinbase))
+			quit(1, "Failed to calloc pool coinbase in parse_notify");
+		pool->coinbase_alloc = alloc_len;
+	}
+	hex2bin(pool->coinbase, n->coinbase1.s, cb1_len);
 	memcpy(pool->coinbase + cb1_len, pool->nonce1bin, pool->n1_len);
-	memcpy(pool->coinbase + cb1_len + pool->n1_len + pool->n2size, cb2, cb2_len);
+	hex2bin(pool->coinbase + cb1_len + pool->n1_len + pool->n2size,
+		n->coinbase2.s, cb2_len);
 	cg_wunlock(&pool->data_lock);
 
 	if (opt_protocol) {
-		applog(LOG_DEBUG, "job_id: %s", job_id);
-		applog(LOG_DEBUG, "prev_hash: %s", prev_hash);
-		applog(LOG_DEBUG, "coinbase1: %s", coinbase1);
-		applog(LOG_DEBUG, "coinbase2: %s", coinbase2);
-		applog(LOG_DEBUG, "bbversion: %s", bbversion);
-		applog(LOG_DEBUG, "nbit: %s", nbit);
-		applog(LOG_DEBUG, "ntime: %s", ntime);
-		applog(LOG_DEBUG, "clean: %s", clean ? "yes" : "no");
-	}
-	free(coinbase1);
-	free(coinbase2);
-	free(cb1);
-	free(cb2);
+		applog(LOG_DEBUG, "job_id: %.*s", (int)n->job_id.len, n->job_id.s);
+		applog(LOG_DEBUG, "prev_hash: %.*s", (int)n->prev_hash.len, n->prev_hash.s);
+		applog(LOG_DEBUG, "coinbase1: %.*s", (int)n->coinbase1.len, n->coinbase1.s);
+		applog(LOG_DEBUG, "coinbase2: %.*s", (int)n->coinbase2.len, n->coinbase2.s);
+		applog(LOG_DEBUG, "bbversion: %.*s", (int)n->bbversion.len, n->bbversion.s);
+		applog(LOG_DEBUG, "nbit: %.*s", (int)n->nbit.len, n->nbit.s);
+		applog(LOG_DEBUG, "ntime: %.*s", (int)n->ntime.len, n->ntime.s);
+		applog(LOG_DEBUG, "clean: %s", n->clean ? "yes" : "no");
+	}
 
 	/* A notify message is the closest stratum gets to a getwork */
 	pool->getwork_requested++;
 	total_getworks++;
-	ret = true;
 	if (pool == current_pool())
 		opt_work_update = true;
-out:
-	return ret;
+	return true;
 }
 
-static bool parse_diff(struct pool *pool, json_t *val)
+static bool json_array_span(json_t *val, unsigned int entry, struct stratum_span *span)
 {
-	double old_diff, diff;
+	const char *s = __json_array_string(val, entry);
+
+	if (!s)
+		return false;
+	span->s = s;
+	span->len = strlen(s);
+	span->str = true;
+	return true;
+}
+
+static bool parse_notify(struct pool *pool, json_t *val)
+{
+	struct stratum_notify n;
+	json_t *arr;
+	int i;
 
-	diff = json_number_value(json_array_get(val, 0)) * opt_diff_mult;
+	arr = json_array_get(val, 4);
+	if (!arr || !json_is_array(arr))
+		return false;
+
+	n.merkles = json_array_size(arr);
+	if (n.merkles > MAX_MERKLES)
+		return false;
+	for (i = 0; i < n.merkles; i++) {
+		if (!json_array_span(arr, i, &n.merkle[i]))
+			return false;
+	}
+	if (!json_array_span(val, 0, &n.job_id) ||
+	    !json_array_span(val, 1, &n.prev_hash) ||
+	    !json_array_span(val, 2, &n.coinbase1) ||
+	    !json_array_span(val, 3, &n.coinbase2) ||
+	    !json_array_span(val, 5, &n.bbversion) ||
+	    !json_array_span(val, 6, &n.nbit) ||
+	    !json_array_span(val, 7, &n.ntime))
+		return false;
+	n.clean = json_is_true(json_array_get(val, 8));
+
+	return stratum_notify(pool, &n);
+}
+
+static bool stratum_diff(struct pool *pool, double diff)
+{
+	double old_diff;
+
+	diff *= opt_diff_mult;
 	if (diff == 0)
 		return false;
 
@@ -1665,6 +1903,202 @@ static bool parse_diff(struct pool *pool, json_t *val)
 	return true;
 }
 
+static bool parse_diff(struct pool *pool, json_t *val)
+{
+	return stratum_diff(pool, json_number_value(json_array_get(val, 0)));
+}
+
+static const char *span_ws(const char *p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+		p++;
+	return p;
+}
+
+/* Spans the JSON value starting at p, returning what follows it or NULL when
+ * it is not one the fast path understands. Strings with escapes and objects
+ * are left to jansson so that a string span is always the string itself. */
+static const char *span_value(const char *p, struct stratum_span *span, int depth)
+{
+	const char *start = p;
+
+	span->str = false;
+	if (*p == '"') {
+		for (p++; *p != '"'; p++) {
+			if (!*p || *p == '\\')
+				return NULL;
+		}
+		span->s = start + 1;
+		span->len = p - span->s;
+		span->str = true;
+		return p + 1;
+	}
+	if (*p == '[') {
+		struct stratum_span elem;
+
+		if (!depth)
+			return NULL;
+		p = span_ws(p + 1);
+		while (*p != ']') {
+			p = span_value(p, &elem, depth - 1);
+			if (!p)
+				return NULL;
+			p = span_ws(p);
+			if (*p == ',')
+				p = span_ws(p + 1);
+			else if (*p != ']')
+				return NULL;
+		}
+		span->s = start;
+		span->len = p + 1 - start;
+		return p + 1;
+	}
+	/* Numbers, true, false and null */
+	while (*p && !strchr(",]} \t\r\n", *p))
+		p++;
+	if (p == start || strchr("{:", *start))
+		return NULL;
+	span->s = start;
+	span->len = p - start;
+	return p;
+}
+
+bool span_is(const struct stratum_span *span, const char *s)
+{
+	return span->s && strlen(s) == span->len && !strncasecmp(span->s, s, span->len);
+}
+
+/* Splits the array in span into at most max elements, returning how many
+ * there were or -1 if there were more */
+static int span_array(const struct stratum_span *span, struct stratum_span *elem, int max)
+{
+	const char *p;
+	int n = 0;
+
+	if (!span->s || *span->s != '[')
+		return -1;
+	p = span_ws(span->s + 1);
+	while (*p != ']') {
+		if (n == max)
+			return -1;
+		p = span_value(p, &elem[n++], 1);
+		if (!p)
+			return -1;
+		p = span_ws(p);
+		if (*p == ',')
+			p = span_ws(p + 1);
+	}
+	return n;
+}
+
+/* Finds the top level members of a stratum message without allocating. Only
+ * messages shaped like the common notify, difficulty and share responses are
+ * recognised, anything else returns false and must be parsed by jansson. */
+bool stratum_fast_parse(const char *s, struct stratum_msg *msg)
+{
+	const char *p = span_ws(s);
+
+	memset(msg, 0, sizeof(*msg));
+	if (*p != '{')
+		return false;
+	p = span_ws(p + 1);
+	while (*p != '}') {
+		struct stratum_span key, val;
+
+		if (*p != '"')
+			return false;
+		p = span_value(p, &key, 0);
+		if (!p)
+			return false;
+		p = span_ws(p);
+		if (*p != ':')
+			return false;
+		p = span_value(span_ws(p + 1), &val, 2);
+		if (!p)
+			return false;
+		if (span_is(&key, "id"))
+			msg->id = val;
+		else if (span_is(&key, "method"))
+			msg->method = val;
+		else if (span_is(&key, "params"))
+			msg->params = val;
+		else if (span_is(&key, "result"))
+			msg->result = val;
+		else if (span_is(&key, "error"))
+			msg->error = val;
+		p = span_ws(p);
+		if (*p == ',')
+			p = span_ws(p + 1);
+		else if (*p != '}')
+			return false;
+	}
+	return true;
+}
+
+static bool fast_notify(struct pool *pool, const struct stratum_span *params)
+{
+	struct stratum_span field[9];
+	struct stratum_notify n;
+	int i;
+
+	if (span_array(params, field, 9) != 9)
+		return false;
+	for (i = 0; i < 8; i++) {
+		if (i != 4 && !field[i].str)
+			return false;
+	}
+	n.merkles = span_array(&field[4], n.merkle, MAX_MERKLES);
+	if (n.merkles < 0)
+		return false;
+	for (i = 0; i < n.merkles; i++) {
+		if (!n.merkle[i].str)
+			return false;
+	}
+	n.job_id = field[0];
+	n.prev_hash = field[1];
+	n.coinbase1 = field[2];
+	n.coinbase2 = field[3];
+	n.bbversion = field[5];
+	n.nbit = field[6];
+	n.ntime = field[7];
+	n.clean = span_is(&field[8], "true");
+
+	return stratum_notify(pool, &n);
+}
+
+static bool fast_diff(struct pool *pool, const struct stratum_span *params)
+{
+	struct stratum_span field;
+	char *end;
+	double diff;
+
+	if (span_array(params, &field, 1) != 1 || field.str)
+		return false;
+	diff = strtod(field.s, &end);
+	if (end != field.s + field.len)
+		return false;
+	return stratum_diff(pool, diff);
+}
+
+/* Handles notify and set_difficulty straight from the receive buffer,
+ * returning false to have parse_method go through jansson instead */
+static bool parse_method_fast(struct pool *pool, const struct stratum_msg *msg)
+{
+	if (!msg->method.str)
+		return false;
+	if (msg->error.s && !span_is(&msg->error, "null"))
+		return false;
+	if (span_is(&msg->method, "mining.notify")) {
+		if (!fast_notify(pool, &msg->params))
+			return false;
+		pool->stratum_notify = true;
+		return true;
+	}
+	if (span_is(&msg->method, "mining.set_difficulty"))
+		return fast_diff(pool, &msg->params);
+	return false;
+}
+
 static void __suspend_stratum(struct pool *pool)
 {
 	clear_sockbuf(pool);
@@ -1708,6 +2142,13 @@ static bool parse_reconnect(struct pool *pool, json_t *val)
 	free(tmp);
 	mutex_unlock(&pool->stratum_lock);
 
+	/* Connecting blocks, so the stratum event loop leaves it to a
+	 * connect thread rather than stall every other pool */
+	if (pool->stratum_watched) {
+		pool->stratum_reconnect = true;
+		return true;
+	}
+
 	if (!restart_stratum(pool))
 		return false;
 
@@ -1745,6 +2186,7 @@ static bool show_message(struct pool *pool, json_t *val)
 bool parse_method(struct pool *pool, char *s)
 {
 	json_t *val = NULL, *method, *err_val, *params;
+	struct stratum_msg msg;
 	json_error_t err;
 	bool ret = false;
 	char *buf;
@@ -1752,6 +2194,14 @@ bool parse_method(struct pool *pool, char *s)
 	if (!s)
 		return ret;
 
+	if (stratum_fast_parse(s, &msg)) {
+		/* A response, left for parse_stratum_response */
+		if (!msg.method.s)
+			return ret;
+		if (parse_method_fast(pool, &msg))
+			return true;
+	}
+
 	val = JSON_LOADS(s, &err);
 	if (!val) {
 		applog(LOG_INFO, "JSON decode failed(%d): %s", err.line, err.text);
@@ -1842,14 +2292,11 @@ bool auth_stratum(struct pool *pool)
 		sret = recv_line(pool);
 		if (!sret)
 			return ret;
-		if (parse_method(pool, sret))
-			free(sret);
-		else
+		if (!parse_method(pool, sret))
 			break;
 	}
 
 	val = JSON_LOADS(sret, &err);
-	free(sret);
 	res_val = json_object_get(val, "result");
 	err_val = json_object_get(val, "error");
 
@@ -2116,12 +2563,197 @@ static bool sock_connecting(void)
 	return WSAGetLastError() == WSAEWOULDBLOCK;
 #endif
 }
+
+/* Resolved addresses are reused for STRATUM_DNS_TTL seconds, and connects to
+ * all of them race for STRATUM_CONNECT_SECS before the pool is unreachable */
+#define STRATUM_DNS_TTL		300
+#define STRATUM_CONNECT_SECS	3
+#define STRATUM_MAX_ADDRS	16
+
+struct stratum_addr {
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	int family, socktype, protocol;
+};
+
+static pthread_mutex_t stratum_dns_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Copies up to STRATUM_MAX_ADDRS addresses for host:port into addrs,
+ * resolving again only when the pool's cached answer is stale or for another
+ * host. A stale answer is still used if resolving fails. */
+static int stratum_resolve(struct pool *pool, const char *host, const char *port,
+			   struct stratum_addr *addrs)
+{
+	struct addrinfo *hints = &pool->stratum_hints, *servinfo, *p;
+	time_t now = time(NULL);
+	bool cached;
+	int ret, n = 0;
+
+	mutex_lock(&stratum_dns_lock);
+	cached = pool->stratum_addrs && !strcmp(pool->stratum_addrs_host, host) &&
+		 !strcmp(pool->stratum_addrs_port, port);
+	if (!cached || now - pool->stratum_addrs_time >= STRATUM_DNS_TTL) {
+		memset(hints, 0, sizeof(struct addrinfo));
+		hints->ai_family = AF_UNSPEC;
+		hints->ai_socktype = SOCK_STREAM;
+		ret = getaddrinfo(host, port, hints, &servinfo);
+		if (!ret) {
+			if (pool->stratum_addrs)
+				freeaddrinfo(pool->stratum_addrs);
+			free(pool->stratum_addrs_host);
+			free(pool->stratum_addrs_port);
+			pool->stratum_addrs = servinfo;
+			pool->stratum_addrs_host = strdup(host);
+			pool->stratum_addrs_port = strdup(port);
+			pool->stratum_addrs_time = now;
+		} else {
+			applog(LOG_ERR, "getaddrinfo() in setup_stratum_socket() returned %i: %s", ret, gai_strerror(ret));
+			if (!pool->probed) {
+				applog(LOG_WARNING, "Failed to resolve (wrong URL?) %s:%s",
+				       host, port);
+				pool->probed = true;
+			} else {
+				applog(LOG_INFO, "Failed to getaddrinfo for %s:%s",
+				       host, port);
+			}
+			if (!cached) {
+				mutex_unlock(&stratum_dns_lock);
+				return 0;
+			}
+			applog(LOG_INFO, "Using previously resolved addresses for %s:%s", host, port);
+		}
+	}
+	for (p = pool->stratum_addrs; p && n < STRATUM_MAX_ADDRS; p = p->ai_next) {
+		if (p->ai_addrlen > sizeof(addrs[n].addr))
+			continue;
+		memcpy(&addrs[n].addr, p->ai_addr, p->ai_addrlen);
+		addrs[n].addrlen = p->ai_addrlen;
+		addrs[n].family = p->ai_family;
+		addrs[n].socktype = p->ai_socktype;
+		addrs[n].protocol = p->ai_protocol;
+		n++;
+	}
+	mutex_unlock(&stratum_dns_lock);
+
+	return n;
+}
+
+/* Resolve again on the next connect, the cached addresses having failed */
+static void stratum_resolve_stale(struct pool *pool)
+{
+	mutex_lock(&stratum_dns_lock);
+	pool->stratum_addrs_time = 0;
+	mutex_unlock(&stratum_dns_lock);
+}
+
+/* Drops the pool's cached addresses once it is removed */
+void stratum_resolve_free(struct pool *pool)
+{
+	mutex_lock(&stratum_dns_lock);
+	if (pool->stratum_addrs)
+		freeaddrinfo(pool->stratum_addrs);
+	pool->stratum_addrs = NULL;
+	free(pool->stratum_addrs_host);
+	pool->stratum_addrs_host = NULL;
+	free(pool->stratum_addrs_port);
+	pool->stratum_addrs_port = NULL;
+	mutex_unlock(&stratum_dns_lock);
+}
+
+/* Starts non blocking connects to every address at once, so dead entries in
+ * round robin DNS cost nothing once a live one answers, and keeps the first
+ * to complete. Returns the connected blocking socket or INVSOCK. */
+static SOCKETTYPE stratum_connect(const struct stratum_addr *addrs, int n)
+{
+	SOCKETTYPE socks[STRATUM_MAX_ADDRS], sockd = INVSOCK;
+	struct timeval tv_end, now;
+	int i, pending = 0;
+
+	cgtime(&tv_end);
+	tv_end.tv_sec += STRATUM_CONNECT_SECS;
+
+	for (i = 0; i < n; i++) {
+		socks[i] = socket(addrs[i].family, addrs[i].socktype, addrs[i].protocol);
+		if (socks[i] == INVSOCK) {
+			applog(LOG_DEBUG, "Failed socket");
+			continue;
+		}
+		noblock_socket(socks[i]);
+		if (connect(socks[i], (const struct sockaddr *)&addrs[i].addr, addrs[i].addrlen) != -1) {
+			applog(LOG_DEBUG, "Succeeded immediate connect");
+			sockd = socks[i];
+			socks[i] = INVSOCK;
+			n = i + 1;
+			goto out;
+		}
+		if (!sock_connecting()) {
+			CLOSESOCKET(socks[i]);
+			socks[i] = INVSOCK;
+			applog(LOG_DEBUG, "Failed sock connect");
+			continue;
+		}
+		pending++;
+	}
+
+	while (pending) {
+		struct timeval tv_timeout;
+		SOCKETTYPE maxfd = 0;
+		int selret;
+		fd_set rw;
+
+		cgtime(&now);
+		if (!time_less(&now, &tv_end))
+			break;
+		timersub(&tv_end, &now, &tv_timeout);
+		FD_ZERO(&rw);
+		for (i = 0; i < n; i++) {
+			if (socks[i] == INVSOCK)
+				continue;
+			FD_SET(socks[i], &rw);
+			if (socks[i] > maxfd)
+				maxfd = socks[i];
+		}
+		selret = select(maxfd + 1, NULL, &rw, NULL, &tv_timeout);
+		if (selret < 0 && interrupted())
+			continue;
+		if (selret < 1)
+			break;
+		for (i = 0; i < n; i++) {
+			socklen_t len;
+			int err, ret;
+
+			if (socks[i] == INVSOCK || !FD_ISSET(socks[i], &rw))
+				continue;
+			len = sizeof(err);
+			ret = getsockopt(socks[i], SOL_SOCKET, SO_ERROR, (void *)&err, &len);
+			if (!ret && !err) {
+				applog(LOG_DEBUG, "Succeeded delayed connect");
+				sockd = socks[i];
+				socks[i] = INVSOCK;
+				goto out;
+			}
+			CLOSESOCKET(socks[i]);
+			socks[i] = INVSOCK;
+			pending--;
+		}
+	}
+	applog(LOG_DEBUG, "Select timeout/failed connect");
+out:
+	for (i = 0; i < n; i++) {
+		if (socks[i] != INVSOCK)
+			CLOSESOCKET(socks[i]);
+	}
+	if (sockd != INVSOCK)
+		block_socket(sockd);
+	return sockd;
+}
+
 static bool setup_stratum_socket(struct pool *pool)
 {
-	struct addrinfo servinfobase, *servinfo, *hints, *p;
+	struct stratum_addr addrs[STRATUM_MAX_ADDRS];
 	char *sockaddr_url, *sockaddr_port;
-	int sockd;
-	int ret;
+	SOCKETTYPE sockd;
+	int n;
 
 	mutex_lock(&pool->stratum_lock);
 	pool->stratum_active = false;
@@ -2133,12 +2765,6 @@ static bool setup_stratum_socket(struct pool *pool)
 	pool->sock = 0;
 	mutex_unlock(&pool->stratum_lock);
 
-	hints = &pool->stratum_hints;
-	memset(hints, 0, sizeof(struct addrinfo));
-	hints->ai_family = AF_UNSPEC;
-	hints->ai_socktype = SOCK_STREAM;
-	servinfo = &servinfobase;
-
 	if (!pool->rpc_proxy && opt_socks_proxy) {
 		pool->rpc_proxy = opt_socks_proxy;
 		extract_sockaddr(pool->rpc_proxy, &pool->sockaddr_proxy_url, &pool->sockaddr_proxy_port);
@@ -2153,75 +2779,16 @@ static bool setup_stratum_socket(struct pool *pool)
 		sockaddr_port = pool->stratum_port;
 	}
 
-	ret = getaddrinfo(sockaddr_url, sockaddr_port, hints, &servinfo);
-	if (ret) {
-		applog(LOG_ERR, "getaddrinfo() in setup_stratum_socket() returned %i: %s", ret, gai_strerror(ret));
-		if (!pool->probed) {
-			applog(LOG_WARNING, "Failed to resolve (wrong URL?) %s:%s",
-			       sockaddr_url, sockaddr_port);
-			pool->probed = true;
-		} else {
-			applog(LOG_INFO, "Failed to getaddrinfo for %s:%s",
-			       sockaddr_url, sockaddr_port);
-		}
+	n = stratum_resolve(pool, sockaddr_url, sockaddr_port, addrs);
+	if (!n)
 		return false;
-	}
-
-	for (p = servinfo; p != NULL; p = p->ai_next) {
-		sockd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-		if (sockd == -1) {
-			applog(LOG_DEBUG, "Failed socket");
-			continue;
-		}
-
-		/* Iterate non blocking over entries returned by getaddrinfo
-		 * to cope with round robin DNS entries, finding the first one
-		 * we can connect to quickly. */
-		noblock_socket(sockd);
-		if (connect(sockd, p->ai_addr, p->ai_addrlen) == -1) {
-			struct timeval tv_timeout = {1, 0};
-			int selret;
-			fd_set rw;
-
-			if (!sock_connecting()) {
-				CLOSESOCKET(sockd);
-				applog(LOG_DEBUG, "Failed sock connect");
-				continue;
-			}
-retry:
-			FD_ZERO(&rw);
-			FD_SET(sockd, &rw);
-			selret = select(sockd + 1, NULL, &rw, NULL, &tv_timeout);
-			if  (selret > 0 && FD_ISSET(sockd, &rw)) {
-				socklen_t len;
-				int err, n;
-
-				len = sizeof(err);
-				n = getsockopt(sockd, SOL_SOCKET, SO_ERROR, (void *)&err, &len);
-				if (!n && !err) {
-					applog(LOG_DEBUG, "Succeeded delayed connect");
-					block_socket(sockd);
-					break;
-				}
-			}
-			if (selret < 0 && interrupted())
-				goto retry;
-			CLOSESOCKET(sockd);
-			applog(LOG_DEBUG, "Select timeout/failed connect");
-			continue;
-		}
-		applog(LOG_WARNING, "Succeeded immediate connect");
-		block_socket(sockd);
-
-		break;
-	}
-	if (p == NULL) {
+	sockd = stratum_connect(addrs, n);
+	if (sockd == INVSOCK) {
 		applog(LOG_INFO, "Failed to connect to stratum on %s:%s",
 		       sockaddr_url, sockaddr_port);
-		freeaddrinfo(servinfo);
+		stratum_resolve_stale(pool);
 		return false;
 	}
-	freeaddrinfo(servinfo);
 
 	if (pool->rpc_proxy) {
 		switch (pool->rpc_proxytype) {
@@ -2261,6 +2828,9 @@ retry:
 		pool->sockbuf_size = RBUFSIZE;
 	}
 
+	/* The stratum event loop never waits on it, and recv_line and
+	 * __stratum_write select before retrying */
+	noblock_socket(sockd);
 	pool->sock = sockd;
 	keep_sockalive(sockd);
 	return true;
@@ -2349,7 +2919,6 @@ resend:
 	recvd = true;
 
 	val = JSON_LOADS(sret, &err);
-	free(sret);
 	if (!val) {
 		applog(LOG_INFO, "JSON decode failed(%d): %s", err.line, err.text);
 		goto out;
@@ -131,15 +131,37 @@ void cgtimer_sub(cgtimer_t *a, cgtimer_t *b, cgtimer_t *res);
 double us_tdiff(struct timeval *end, struct timeval *start);
 int ms_tdiff(struct timeval *end, struct timeval *start);
 double tdiff(struct timeval *end, struct timeval *start);
+struct latency_histogram;
+void latency_add(struct latency_histogram *hist, struct timeval *end, struct timeval *start);
+double latency_percentile(const struct latency_histogram *hist, double pct);
 bool stratum_send(struct pool *pool, char *s, ssize_t len);
+bool stratum_send_lines(struct pool *pool, const char *s, ssize_t len);
+void stratum_queue_lines(struct pool *pool, const char *s, size_t len, bool first);
+bool stratum_flush(struct pool *pool);
 bool sock_full(struct pool *pool);
 char *recv_line(struct pool *pool);
+char *recv_line_async(struct pool *pool, bool *dead);
+/* A value inside a stratum line, not NUL terminated. Strings exclude their
+ * quotes, arrays include their brackets and a missing member has no s. */
+struct stratum_span {
+	const char *s;
+	size_t len;
+	bool str;
+};
+
+struct stratum_msg {
+	struct stratum_span id, method, params, result, error;
+};
+
+bool span_is(const struct stratum_span *span, const char *s);
+bool stratum_fast_parse(const char *s, struct stratum_msg *msg);
 bool parse_method(struct pool *pool, char *s);
 bool extract_sockaddr(char *url, char **sockaddr_url, char **sockaddr_port);
 bool auth_stratum(struct pool *pool);
 bool initiate_stratum(struct pool *pool);
 bool restart_stratum(struct pool *pool);
 void suspend_stratum(struct pool *pool);
+void stratum_resolve_free(struct pool *pool);
 void dev_error(struct cgpu_info *dev, enum dev_reason reason);
 void *realloc_strcat(char *ptr, char *s);
 void *str_text(char *ptr);